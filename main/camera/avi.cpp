@@ -252,6 +252,11 @@ int CAVI::closeFile(const char* audioFileName)
 }
 
 int CAVI::writeFrame(camera_fb_t* fb)
+{
+    return writeFrame(fb->buf, fb->len);
+}
+
+int CAVI::writeFrame(const uint8_t* buf, size_t len)
 {
     if(!hFile) {
         ESP_LOGI(CAVI_TAG, "writeFrame: Unable to write frame: File is not open");
@@ -268,8 +273,8 @@ int CAVI::writeFrame(camera_fb_t* fb)
     uint32_t fTime = CurrentTime.ms();
   
     // align end of jpeg on 4 byte boundary for AVI
-    uint16_t filler = (4 - (fb->len & 0x00000003)) & 0x00000003; 
-    size_t jpegSize = fb->len + filler;
+    uint16_t filler = (4 - (len & 0x00000003)) & 0x00000003; 
+    size_t jpegSize = len + filler;
   
     // add avi frame header
     memcpy(iSDbuffer + highPoint, dcBuf, 4); 
@@ -289,7 +294,7 @@ int CAVI::writeFrame(camera_fb_t* fb)
     uint32_t wTime = CurrentTime.ms();
     while (jpegRemain >= RAMSIZE - highPoint) {
         // write to SD when RAMSIZE is filled in buffer
-        memcpy(iSDbuffer + highPoint, fb->buf + jpegSize - jpegRemain, RAMSIZE - highPoint);
+        memcpy(iSDbuffer + highPoint, buf + jpegSize - jpegRemain, RAMSIZE - highPoint);
         fwrite(iSDbuffer, RAMSIZE, 1, hFile);
         jpegRemain -= RAMSIZE - highPoint;
         highPoint = 0;
@@ -298,7 +303,7 @@ int CAVI::writeFrame(camera_fb_t* fb)
     wTimeTot += wTime;
   
     // whats left or small frame
-    memcpy(iSDbuffer+highPoint, fb->buf + jpegSize - jpegRemain, jpegRemain);
+    memcpy(iSDbuffer+highPoint, buf + jpegSize - jpegRemain, jpegRemain);
     highPoint += jpegRemain;
     addAviIndex(jpegSize); // save avi index for frame
     vidSize += jpegSize + CHUNK_HDR;
@@ -310,6 +315,37 @@ int CAVI::writeFrame(camera_fb_t* fb)
     return AVI_RET_OK;
 }
 
+int CAVI::writePreBuffer(CPreBuffer* preBuffer)
+{
+    if(!hFile) {
+        return AVI_RET_NOT_OPEN;
+    }
+
+    // write buffered frames first so the recording includes the lead up to the trigger,
+    // straight from the ring while it is locked
+    uint32_t frameCount = 0;
+    int ret = preBuffer->drain(writePreBufferFrame, this, &frameCount);
+    if(ret != AVI_RET_OK) {
+        return ret;
+    }
+
+    ESP_LOGI(CAVI_TAG, "writePreBuffer: Wrote %lu buffered frames", frameCount);
+
+    return AVI_RET_OK;
+}
+
+int CAVI::writePreBufferFrame(void* arg, uint32_t index, const uint8_t* buf, uint32_t len, uint32_t timeMs)
+{
+    CAVI* pAVI = (CAVI*)arg;
+
+    // recording time starts at the oldest buffered frame so the header fps is correct
+    if(index == 0) {
+        pAVI->startTime = timeMs;
+    }
+
+    return pAVI->writeFrame(buf, len);
+}
+
 bool CAVI::isOpen()
 {
     if(!hFile) {
@@ -3,6 +3,7 @@
 
 #include "esp_camera.h"
 #include "fat32.h"
+#include "prebuffer.h"
 
 #define AVI_RET_OK            0
 #define AVI_RET_INVALID       1
@@ -27,9 +28,12 @@ public:
     int       startFile(const char* fileName, uint32_t fWidth, uint32_t fHeight, uint8_t FPS, bool audio, uint32_t maxFrameCount);
     int       closeFile(const char* audioFileName);
     int       writeFrame(camera_fb_t* fb);
+    int       writeFrame(const uint8_t* buf, size_t len);
+    int       writePreBuffer(CPreBuffer* preBuffer);
     bool      isOpen();
     
 private:
+    static int  writePreBufferFrame(void* arg, uint32_t index, const uint8_t* buf, uint32_t len, uint32_t timeMs);
     void        addAviIndex(uint32_t dataSize);
     void        writeAviIndex();
     int         writeWavFile(const char* fileName);
@@ -0,0 +1,138 @@
+#include "bandpool.h"
+#include "taskconfig.h"
+
+#define CBAND_TAG "CBandPool"
+
+CBandPool::CBandPool()
+{
+    workerCnt       = 0;
+    allowTasks      = false;
+    job             = NULL;
+    jobArg          = NULL;
+    syncSemaphore   = xSemaphoreCreateBinary();
+    doneSemaphore   = xSemaphoreCreateCounting(BAND_MAX_WORKERS, 0);
+
+    for (uint8_t i = 0; i < BAND_MAX_WORKERS; i++) {
+        workers[i].pool     = this;
+        workers[i].index    = i;
+        workers[i].handle   = NULL;
+        workers[i].mutex    = xSemaphoreCreateMutex();
+    }
+}
+
+CBandPool::~CBandPool()
+{
+    stop();
+
+    for (uint8_t i = 0; i < BAND_MAX_WORKERS; i++) {
+        if (workers[i].mutex) {
+            vSemaphoreDelete(workers[i].mutex);
+        }
+    }
+
+    if (syncSemaphore) {
+        vSemaphoreDelete(syncSemaphore);
+    }
+
+    if (doneSemaphore) {
+        vSemaphoreDelete(doneSemaphore);
+    }
+}
+
+int CBandPool::start()
+{
+    if (workerCnt) {
+        return BAND_RET_OK;
+    }
+
+    // a single core gains nothing from a worker, the caller does the job itself
+    uint8_t count = portNUM_PROCESSORS < BAND_MAX_WORKERS ? portNUM_PROCESSORS : BAND_MAX_WORKERS;
+    if (count < 2) {
+        return BAND_RET_OK;
+    }
+
+    allowTasks = true;
+    xSemaphoreTake(syncSemaphore, 0);
+    for (uint8_t i = 0; i < count; i++) {
+        if (TaskConfig.create(TASK_BAND_0 + i, bandTask, &workers[i], &workers[i].handle) != TASK_RET_OK) {
+            ESP_LOGE(CBAND_TAG, "start: Unable to create band worker [%u]", i);
+            stop();
+
+            return BAND_RET_CREATE_FAIL;
+        }
+        xSemaphoreTake(syncSemaphore, portMAX_DELAY);
+        workerCnt++;
+    }
+
+    ESP_LOGI(CBAND_TAG, "start: %u band workers", workerCnt);
+
+    return BAND_RET_OK;
+}
+
+void CBandPool::stop()
+{
+    allowTasks = false;
+    for (uint8_t i = 0; i < workerCnt; i++) {
+        xTaskNotifyGive(workers[i].handle);
+        xSemaphoreTake(workers[i].mutex, portMAX_DELAY);
+        xSemaphoreGive(workers[i].mutex);
+        workers[i].handle = NULL;
+    }
+    workerCnt = 0;
+}
+
+uint8_t CBandPool::size()
+{
+    return workerCnt;
+}
+
+void CBandPool::run(CBandJob newJob, void* arg, uint8_t count)
+{
+    // without workers, or with more bands than workers, the caller runs them in turn
+    if (count > workerCnt) {
+        for (uint8_t i = 0; i < count; i++) {
+            newJob(arg, i);
+        }
+
+        return;
+    }
+
+    job     = newJob;
+    jobArg  = arg;
+    for (uint8_t i = 0; i < count; i++) {
+        xTaskNotifyGive(workers[i].handle);
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        xSemaphoreTake(doneSemaphore, portMAX_DELAY);
+    }
+}
+
+void CBandPool::bandTask(void* vPtr)
+{
+    //subscribe to WDT
+    ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
+    ESP_ERROR_CHECK(esp_task_wdt_status(NULL));
+
+    CBandWorker* worker = (CBandWorker*)vPtr;
+    CBandPool* pool = worker->pool;
+    xSemaphoreTake(worker->mutex, portMAX_DELAY);
+
+    ESP_LOGI(CBAND_TAG, "Band Task: Started [%u]", worker->index);
+    xSemaphoreGive(pool->syncSemaphore);
+    while (pool->allowTasks) {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BAND_TIMEOUT)) && pool->allowTasks) {
+            pool->job(pool->jobArg, worker->index);
+            xSemaphoreGive(pool->doneSemaphore);
+        }
+
+        esp_task_wdt_reset();
+    }
+
+    xSemaphoreGive(worker->mutex);
+
+    //unsubscribe to WDT and deinit
+    ESP_ERROR_CHECK(esp_task_wdt_delete(NULL));
+
+    vTaskDelete(NULL);
+}
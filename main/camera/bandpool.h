@@ -0,0 +1,49 @@
+#ifndef BANDPOOL_H
+#define BANDPOOL_H
+
+#include "globals.h"
+
+//Return values
+#define BAND_RET_OK             0
+#define BAND_RET_CREATE_FAIL    1
+
+#define BAND_MAX_WORKERS        2 // one per core
+#define BAND_TIMEOUT            250
+
+//one band of a job, band is 0 .. count - 1
+typedef void (*CBandJob)(void* arg, uint8_t band);
+
+class CBandPool;
+
+typedef struct {
+    CBandPool*          pool;
+    uint8_t             index;
+    TaskHandle_t        handle;
+    SemaphoreHandle_t   mutex;      // held while the task runs
+} CBandWorker;
+
+// a worker task pinned to each core, run() hands band i of a job to worker i
+// and returns once every band is done
+class CBandPool {
+  public:
+    CBandPool();
+    ~CBandPool();
+
+    int         start();
+    void        stop();
+    uint8_t     size();
+    void        run(CBandJob job, void* arg, uint8_t count);
+
+  private:
+    static void bandTask(void* vPtr);
+
+    CBandWorker         workers[BAND_MAX_WORKERS];
+    uint8_t             workerCnt;
+    volatile bool       allowTasks;
+    SemaphoreHandle_t   syncSemaphore;
+    SemaphoreHandle_t   doneSemaphore;  // given once per finished band
+    CBandJob            job;
+    void*               jobArg;
+};
+
+#endif
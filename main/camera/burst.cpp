@@ -0,0 +1,131 @@
+#include "esp_heap_caps.h"
+#include "burst.h"
+
+#define CBST_TAG "CBurstBuffer"
+
+CBurstBuffer::CBurstBuffer()
+{
+    arena       = NULL;
+    arenaSize   = 0;
+    writePos    = 0;
+    maxFrames   = 0;
+    frameCnt    = 0;
+}
+
+CBurstBuffer::~CBurstBuffer()
+{
+    deinit();
+}
+
+int CBurstBuffer::init(uint32_t frames, uint32_t frameBytes)
+{
+    deinit();
+
+    // only as much as the frames asked for are expected to need, capped by what PSRAM can spare
+    frames = frames < BST_MAX_FRAMES ? frames : BST_MAX_FRAMES;
+    uint64_t wanted = ((uint64_t)frames * frameBytes + 3) & ~3ULL;
+    uint32_t spare  = available();
+    uint32_t size   = wanted < spare ? (uint32_t)wanted : spare;
+    if (!size || (size < wanted && size < BST_MIN_BUDGET)) {
+        ESP_LOGE(CBST_TAG, "init: Not enough PSRAM [%lu]", spare);
+
+        return BST_RET_ALLOC_ERROR;
+    }
+
+    arena = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (!arena) {
+        ESP_LOGE(CBST_TAG, "init: Unable to allocate [%lu] bytes", size);
+
+        return BST_RET_ALLOC_ERROR;
+    }
+
+    arenaSize   = size;
+    maxFrames   = frames;
+
+    ESP_LOGI(CBST_TAG, "init: %lu frames, %lu bytes", maxFrames, arenaSize);
+
+    return BST_RET_OK;
+}
+
+void CBurstBuffer::deinit()
+{
+    if (arena) {
+        heap_caps_free(arena);
+        arena = NULL;
+    }
+
+    arenaSize   = 0;
+    writePos    = 0;
+    maxFrames   = 0;
+    frameCnt    = 0;
+}
+
+bool CBurstBuffer::isReady()
+{
+    return arena != NULL;
+}
+
+int CBurstBuffer::add(const uint8_t* buf, uint32_t len, uint32_t timeUs)
+{
+    if (!arena) {
+        return BST_RET_NOT_READY;
+    }
+
+    if (frameCnt == maxFrames || arenaSize - writePos < len) {
+        return BST_RET_FULL;
+    }
+
+    frames[frameCnt].offset = writePos;
+    frames[frameCnt].len    = len;
+    frames[frameCnt].time   = timeUs;
+    memcpy(arena + writePos, buf, len);
+
+    writePos = (writePos + len + 3) & ~3;
+    if (writePos > arenaSize) {
+        writePos = arenaSize;
+    }
+    frameCnt++;
+
+    return BST_RET_OK;
+}
+
+uint32_t CBurstBuffer::count()
+{
+    return frameCnt;
+}
+
+uint32_t CBurstBuffer::bytes()
+{
+    return writePos;
+}
+
+uint32_t CBurstBuffer::budget()
+{
+    return arenaSize;
+}
+
+bool CBurstBuffer::getFrame(uint32_t index, const uint8_t** buf, uint32_t* len, uint32_t* timeUs)
+{
+    if (index >= frameCnt) {
+        return false;
+    }
+
+    *buf    = arena + frames[index].offset;
+    *len    = frames[index].len;
+    *timeUs = frames[index].time;
+
+    return true;
+}
+
+uint32_t CBurstBuffer::available()
+{
+    // one contiguous block, keeping a reserve back for the rest of the system
+    uint32_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+    if (largest <= BST_PSRAM_RESERVE) {
+        return 0;
+    }
+
+    largest -= BST_PSRAM_RESERVE;
+
+    return (largest < BST_MAX_BUDGET ? largest : BST_MAX_BUDGET) & ~3;
+}
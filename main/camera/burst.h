@@ -0,0 +1,49 @@
+#ifndef BURST_H
+#define BURST_H
+
+#include "globals.h"
+
+//Return values
+#define BST_RET_OK              0
+#define BST_RET_ALLOC_ERROR     1
+#define BST_RET_FULL            2
+#define BST_RET_NOT_READY       3
+
+#define BST_MAX_FRAMES          64
+#define BST_MAX_BUDGET          (4 * 1024 * 1024) // most PSRAM a burst will take
+#define BST_PSRAM_RESERVE       (512 * 1024) // left free for everything else while a burst is held
+#define BST_MIN_BUDGET          (64 * 1024)
+
+typedef struct {
+    uint32_t    offset;
+    uint32_t    len;
+    uint32_t    time;   // capture time [us]
+} CBurstFrame;
+
+// PSRAM arena the burst is captured into at sensor speed, frames are
+// packed back to back and drained to SD once the burst is complete
+class CBurstBuffer {
+public:
+    CBurstBuffer();
+    ~CBurstBuffer();
+
+    int             init(uint32_t frames, uint32_t frameBytes);
+    void            deinit();
+    bool            isReady();
+    int             add(const uint8_t* buf, uint32_t len, uint32_t timeUs);
+    uint32_t        count();
+    uint32_t        bytes();
+    uint32_t        budget();
+    bool            getFrame(uint32_t index, const uint8_t** buf, uint32_t* len, uint32_t* timeUs);
+    static uint32_t available();
+
+private:
+    uint8_t*        arena;
+    uint32_t        arenaSize;
+    uint32_t        writePos;
+    uint32_t        maxFrames;
+    CBurstFrame     frames[BST_MAX_FRAMES];
+    uint32_t        frameCnt;
+};
+
+#endif
@@ -1,5 +1,7 @@
 #include "camera.h"
 #include "currenttime.h"
+#include "taskconfig.h"
+#include "fat32.h"
 
 #define CCAMERA_TAG "CCamera"
 
@@ -42,12 +44,40 @@ const frameStruct frameData[] = {
 CCamera::CCamera()
 {
     captureTaskMutex    = xSemaphoreCreateMutex();
-    triggerTaskMutex    = xSemaphoreCreateMutex();
+    storageTaskMutex    = xSemaphoreCreateMutex();
     motionTaskMutex     = xSemaphoreCreateMutex();
     syncTaskSemaphore   = xSemaphoreCreateBinary();
-    triggerSemaphore    = xSemaphoreCreateCounting(3, 0);
-    motionQueue         = xQueueCreate(1, sizeof(camera_fb_t*));
+    configMutex         = xSemaphoreCreateMutex();
+    motionMutex         = xSemaphoreCreateMutex();
+    runMutex            = xSemaphoreCreateRecursiveMutex();
+    triggerQueue        = xQueueCreate(CAM_TRIGGER_QUEUE_SIZE, sizeof(CFrameTrigger));
+    motionQueue         = xQueueCreate(1, sizeof(CFrame*));
+    fbCount             = frameBufferCount(); // PSRAM is up before the global constructors run
+    storageQueue        = xQueueCreate(fbCount - 2, sizeof(CStorageJob));
+    recording           = false;
+    pauseCapture        = false;
+    capturePaused       = false;
+    storagePolicy       = CAM_STORE_DROP_OLDEST;
+    baseInterval        = 0;
+    emptyQueueCount     = 0;
     allowMotion         = true;
+    frameRate           = 0;
+    timeLapse           = 0;
+    frameSize           = CAM_MAX_FRAMESIZE;
+    jpegQuality         = CAM_DEFAULT_QUALITY;
+    discardFrames       = 0;
+    configGen           = 0;
+    switchStart         = 0;
+    switchTime          = 0;
+    watchMode           = false;
+    watchSize           = CAM_WATCH_FRAMESIZE;
+    recordSize          = CAM_MAX_FRAMESIZE;
+    frameSource         = &SensorSource;
+    memset(&burstStats, 0, sizeof(CBurstStats));
+    cellFile            = NULL;
+    cellLock            = portMUX_INITIALIZER_UNLOCKED;
+    storageLock         = portMUX_INITIALIZER_UNLOCKED;
+    motion.getGrid(&cellGrid);
     onFrame             = NULL;
 }
 
@@ -59,12 +89,16 @@ CCamera::~CCamera()
         vQueueDelete(motionQueue);
     }
 
+    if(storageQueue) {
+        vQueueDelete(storageQueue);
+    }
+
     if(captureTaskMutex) {
         vSemaphoreDelete(captureTaskMutex);
     }
 
-    if(triggerTaskMutex) {
-        vSemaphoreDelete(triggerTaskMutex);
+    if(storageTaskMutex) {
+        vSemaphoreDelete(storageTaskMutex);
     }
 
     if(motionTaskMutex) {
@@ -75,17 +109,202 @@ CCamera::~CCamera()
         vSemaphoreDelete(syncTaskSemaphore);
     }
 
-    if(triggerSemaphore) {
-        vSemaphoreDelete(triggerSemaphore);
+    if(configMutex) {
+        vSemaphoreDelete(configMutex);
+    }
+
+    if(runMutex) {
+        vSemaphoreDelete(runMutex);
+    }
+
+    if(motionMutex) {
+        vSemaphoreDelete(motionMutex);
+    }
+
+    if(triggerQueue) {
+        vQueueDelete(triggerQueue);
     }
 }
 
 int CCamera::start()
 {
-    stop();
+    xSemaphoreTakeRecursive(runMutex, portMAX_DELAY);
+    int ret = startCamera();
+    xSemaphoreGiveRecursive(runMutex);
+
+    return ret;
+}
+
+int CCamera::stop()
+{
+    xSemaphoreTakeRecursive(runMutex, portMAX_DELAY);
+    int ret = stopCamera();
+    xSemaphoreGiveRecursive(runMutex);
+
+    return ret;
+}
+
+int CCamera::restart()
+{
+    //held across both so the main loop can not start the camera in between
+    xSemaphoreTakeRecursive(runMutex, portMAX_DELAY);
+    stopCamera();
+    int ret = startCamera();
+    xSemaphoreGiveRecursive(runMutex);
+
+    return ret;
+}
+
+int CCamera::startCamera()
+{
+    stopCamera();
   
     ESP_LOGD(CCAMERA_TAG, "start: Starting Camera");
+
+    //watch mode always starts small and waits for motion
+    if (watchMode) {
+        frameSize = watchSize;
+    }
   
+    //bring up the sensor or the replay source
+    if (frameSource->isSensor()) {
+        int ret = startSensor();
+        if (ret != CAM_RET_OK) {
+            return ret;
+        }
+    }
+    else {
+        if (frameSource->start() != SRC_RET_OK) {
+            ESP_LOGE(CCAMERA_TAG, "start: Frame source failed");
+
+            return CAM_RET_INIT_FAIL;
+        }
+
+        //replayed frames are whatever size they were recorded at, motion and the AVI
+        //header are set up from frameData so a size it does not list can not be replayed
+        uint16_t width = 0, height = 0;
+        uint32_t i = 0;
+        if (frameSource->getSize(&width, &height)) {
+            for (; i <= CAM_MAX_FRAMESIZE; i++) {
+                if (frameData[i].frameWidth == width && frameData[i].frameHeight == height) {
+                    break;
+                }
+            }
+        }
+        if (i > CAM_MAX_FRAMESIZE || !width) {
+            ESP_LOGE(CCAMERA_TAG, "start: Unsupported replay size [%ux%u]", width, height);
+            frameSource->stop();
+
+            return CAM_RET_INVALID;
+        }
+        frameSize = (framesize_t)i;
+    }
+  
+    //configure motion
+    motion.setImageParameters(frameData[frameSize].scaleFactor, frameData[frameSize].sampleRate, frameData[frameSize].frameWidth, frameData[frameSize].frameHeight);
+    motion.setDetectionParameters(3, 6, 15);
+    configGen++;
+
+    //motion events go to the journal for the whole time the card is mounted
+    if (!journal.isOpen()) {
+        journal.open(JNL_FILE_NAME);
+    }
+
+    //configure pre-event buffer
+    if (preBuffer.isReady()) {
+        preBuffer.clear();
+    }
+    else {
+        //a share of what the frame buffers and the replay source left, burst and motion need the rest
+        uint32_t budget = heap_caps_get_free_size(MALLOC_CAP_SPIRAM) / PRE_DEFAULT_SHARE;
+        preBuffer.init(PRE_DEFAULT_SECONDS, budget < PRE_MAX_BUDGET ? budget : PRE_MAX_BUDGET);
+    }
+
+    //start tasks
+    allowTasks = true;
+    xSemaphoreTake(syncTaskSemaphore, 0);
+    recording       = false;
+    recordCountDown = 0;
+    discardFrames   = 0;
+    pauseCapture    = false;
+    capturePaused   = false;
+    setReduceLevel(0);
+    portENTER_CRITICAL(&storageLock);
+    memset(&storageStats, 0, sizeof(CStorageStats));
+    portEXIT_CRITICAL(&storageLock);
+    resetWatchStats();
+    motion.startWorkers();
+    TaskConfig.create(TASK_MOTION, cameraMotionTask, this);
+    xSemaphoreTake(syncTaskSemaphore, portMAX_DELAY);
+    TaskConfig.create(TASK_STORAGE, cameraStorageTask, this);
+    xSemaphoreTake(syncTaskSemaphore, portMAX_DELAY);
+    TaskConfig.create(TASK_CAPTURE, cameraCaptureTask, this);
+    xSemaphoreTake(syncTaskSemaphore, portMAX_DELAY);
+
+    //start frame triggers
+    xQueueReset(triggerQueue);
+    if (timeLapse) {
+        scheduler.setInterval((uint64_t)timeLapse * 1000);
+    }
+    else if (frameRate > 0) {
+        scheduler.setFPS(frameRate);
+    }
+    else {
+        scheduler.setFPS(frameData[frameSize].defaultFPS ? frameData[frameSize].defaultFPS : 1);
+    }
+    scheduler.start(triggerQueue);
+
+    ESP_LOGI(CCAMERA_TAG, "start: Complete");
+
+  return CAM_RET_OK;
+}
+
+int CCamera::stopCamera()
+{
+    if(allowTasks) {
+        allowTasks = false;
+        ESP_LOGD(CCAMERA_TAG, "stop: Stopping tasks");
+        scheduler.stop();
+        xSemaphoreTake(captureTaskMutex, portMAX_DELAY);
+        xSemaphoreGive(captureTaskMutex);
+        xSemaphoreTake(storageTaskMutex, portMAX_DELAY);
+        xSemaphoreGive(storageTaskMutex);
+        xSemaphoreTake(motionTaskMutex, portMAX_DELAY);
+        xSemaphoreGive(motionTaskMutex);
+        motion.stopWorkers();
+        //an event cut short by the stop still gets its stop record
+        if (journal.inEvent()) {
+            journal.stopEvent(CurrentTime.ms64());
+        }
+        journal.flush();
+        //a burst sees allowTasks and lets go of the sensor after its current frame
+        while (burstStats.state == CAM_BURST_CAPTURE) {
+            vTaskDelay(1);
+        }
+        xSemaphoreTake(configMutex, portMAX_DELAY);
+        xSemaphoreGive(configMutex);
+        ESP_LOGI(CCAMERA_TAG, "stop: Tasks stopped");
+    }
+
+    frameSource->stop();
+    if(frameSource->isSensor() && esp_camera_deinit() == ESP_OK) {
+        ESP_LOGI(CCAMERA_TAG, "stop: Camera shutdown");
+    }
+  
+    return CAM_RET_OK;
+}
+
+uint8_t CCamera::frameBufferCount()
+{
+    //buffers are sized for the largest jpeg the driver expects at CAM_MAX_FRAMESIZE
+    uint32_t fbBytes = frameData[CAM_MAX_FRAMESIZE].frameWidth * frameData[CAM_MAX_FRAMESIZE].frameHeight / CAM_BURST_JPEG_RATIO;
+    uint32_t count = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) / CAM_FB_PSRAM_SHARE / fbBytes;
+
+    return count < CAM_FB_COUNT_MIN ? CAM_FB_COUNT_MIN : count > CAM_FB_COUNT_MAX ? CAM_FB_COUNT_MAX : count;
+}
+
+int CCamera::startSensor()
+{
     camera_config_t config;
     config.ledc_channel = LEDC_CHANNEL_0;
     config.ledc_timer   = LEDC_TIMER_0;
@@ -106,12 +325,12 @@ int CCamera::start()
     config.pin_pwdn     = PWDN_GPIO_NUM;
     config.pin_reset    = RESET_GPIO_NUM;
     config.xclk_freq_hz = 20000000;
-    config.frame_size   = FRAMESIZE_UXGA;
+    config.frame_size   = CAM_MAX_FRAMESIZE;
     config.pixel_format = PIXFORMAT_JPEG; // for streaming
     config.grab_mode    = CAMERA_GRAB_LATEST; //CAMERA_GRAB_WHEN_EMPTY;
     config.fb_location  = CAMERA_FB_IN_PSRAM;
-    config.jpeg_quality = 10;
-    config.fb_count     = 3;
+    config.jpeg_quality = jpegQuality;
+    config.fb_count     = fbCount;
 
 #if defined(CAMERA_MODEL_ESP_EYE)
     pinMode(13, INPUT_PULLUP);
@@ -121,10 +340,11 @@ int CCamera::start()
     // camera init
     esp_err_t err = esp_camera_init(&config);
     if (err != ESP_OK) {
-        ESP_LOGE(CCAMERA_TAG, "start: Failed [0x%x]", err);
+        ESP_LOGE(CCAMERA_TAG, "startSensor: Failed [0x%x]", err);
     
         return CAM_RET_INIT_FAIL;
     }
+    ESP_LOGI(CCAMERA_TAG, "startSensor: %u frame buffers", fbCount);
 
     //configure sensors
     sensor_t * s = esp_camera_sensor_get();
@@ -135,6 +355,11 @@ int CCamera::start()
         s->set_saturation(s, -2); // lower the saturation
     }
 
+    //buffers are allocated for the largest size, switch down to the selected one
+    if (frameSize != CAM_MAX_FRAMESIZE) {
+        s->set_framesize(s, frameSize);
+    }
+
 #if defined(CAMERA_MODEL_M5STACK_WIDE) || defined(CAMERA_MODEL_M5STACK_ESP32CAM)
     s->set_vflip(s, 1);
     s->set_hmirror(s, 1);
@@ -151,76 +376,119 @@ int CCamera::start()
 
     switch (s->id.PID) {
     case (OV2640_PID):
-        ESP_LOGI(CCAMERA_TAG, "start: Camera Type [OV2640]");
+        ESP_LOGI(CCAMERA_TAG, "startSensor: Camera Type [OV2640]");
         break;
       
     case (OV3660_PID):
-        ESP_LOGI(CCAMERA_TAG, "start: Camera Type [OV3660]");
+        ESP_LOGI(CCAMERA_TAG, "startSensor: Camera Type [OV3660]");
         break;
       
     case (OV5640_PID):
-        ESP_LOGI(CCAMERA_TAG, "start: Camera Type [OV5640]");
+        ESP_LOGI(CCAMERA_TAG, "startSensor: Camera Type [OV5640]");
         break;
       
     default:
-        ESP_LOGI(CCAMERA_TAG, "start: Camera Type [Other]");
+        ESP_LOGI(CCAMERA_TAG, "startSensor: Camera Type [Other]");
         break;
     }
-  
-    //configure motion
-    motion.setImageParameters(frameData[s->status.framesize].scaleFactor, frameData[s->status.framesize].sampleRate, frameData[s->status.framesize].frameWidth, frameData[s->status.framesize].frameHeight);
-    motion.setDetectionParameters(3, 6, 15);
 
-    //start tasks
-    allowTasks = true;
-    xSemaphoreTake(syncTaskSemaphore, 0);
-    xTaskCreate(cameraMotionTask, "cameraMotionTask", TASK_STACK_SIZE, this, MOTI_TSK_PRIO, NULL);
-    xSemaphoreTake(syncTaskSemaphore, portMAX_DELAY);
-    xTaskCreate(cameraCaptureTask, "cameraCaptureTask", TASK_STACK_SIZE, this, CAPT_TSK_PRIO, NULL);
-    xSemaphoreTake(syncTaskSemaphore, portMAX_DELAY);
-    xTaskCreate(cameraTriggerTask, "cameraTriggerTask", TASK_STACK_SIZE, this, TRIG_TASK_PRIO, NULL);
-    xSemaphoreTake(syncTaskSemaphore, portMAX_DELAY);
+    return CAM_RET_OK;
+}
 
-    ESP_LOGI(CCAMERA_TAG, "start: Complete");
+int CCamera::startFile(const char* fileName, uint32_t maxFrameCount, framesize_t size)
+{
+    if (size >= FRAMESIZE_INVALID) {
+        size = frameSize;
+    }
 
-  return CAM_RET_OK;
+    int ret = aviFile.startFile(fileName, frameData[size].frameWidth, frameData[size].frameHeight, frameData[size].defaultFPS, false, maxFrameCount);
+    if (ret != AVI_RET_OK) {
+        return ret;
+    }
+
+    //flush the frames leading up to the trigger
+    return aviFile.writePreBuffer(&preBuffer);
 }
 
-int CCamera::stop()
+void CCamera::openCellFile(const char* aviName)
 {
-    if(allowTasks) {
-        allowTasks = false;
-        ESP_LOGD(CCAMERA_TAG, "stop: Stopping tasks");
-        xSemaphoreTake(triggerTaskMutex, portMAX_DELAY);
-        xSemaphoreGive(triggerTaskMutex);
-        xSemaphoreTake(captureTaskMutex, portMAX_DELAY);
-        xSemaphoreGive(captureTaskMutex);
-        xSemaphoreTake(motionTaskMutex, portMAX_DELAY);
-        xSemaphoreGive(motionTaskMutex);
-        ESP_LOGI(CCAMERA_TAG, "stop: Tasks stopped");
+    // the sidecar sits next to the recording with the same name
+    char fileName[MAX_FILE_NAME];
+    size_t nameLen = strlen(aviName);
+    if (nameLen < 4 || nameLen >= MAX_FILE_NAME) {
+        return;
     }
+    memcpy(fileName, aviName, nameLen - 4);
+    strcpy(fileName + nameLen - 4, CAM_CELL_EXT);
 
-    if(esp_camera_deinit() == ESP_OK) {
-        ESP_LOGI(CCAMERA_TAG, "stop: Camera shutdown");
+    CMotionGrid grid;
+    portENTER_CRITICAL(&cellLock);
+    grid = cellGrid;
+    portEXIT_CRITICAL(&cellLock);
+
+    cellFile = fopen(fileName, "w");
+    if (!cellFile) {
+        ESP_LOGW(CCAMERA_TAG, "openCellFile: Unable to open [%s]", fileName);
+
+        return;
     }
-  
-    return CAM_RET_OK;
+
+    fwrite(CAM_CELL_MAGIC, 4, 1, cellFile);
+    fwrite(&grid.cols, 1, 1, cellFile);
+    fwrite(&grid.rows, 1, 1, cellFile);
+    fwrite(&grid.mask, sizeof(uint64_t), 1, cellFile);
 }
 
-int CCamera::startFile(const char* fileName, uint32_t maxFrameCount)
+void CCamera::writeCellRecord(CFrame* frame, uint64_t time)
 {
-    sensor_t* s = esp_camera_sensor_get();
-    return aviFile.startFile(fileName, frameData[s->status.framesize].frameWidth, frameData[s->status.framesize].frameHeight, frameData[s->status.framesize].defaultFPS, false, maxFrameCount);
+    if (!cellFile) {
+        return;
+    }
+
+    // the frame's own result if the motion task got to it, otherwise the latest pair under the motion lock
+    uint64_t cells;
+    CMotionBox box;
+    if (!frame->getMotion(&box, &cells)) {
+        xSemaphoreTake(motionMutex, portMAX_DELAY);
+        motion.getBox(&box);
+        cells = motion.getCells();
+        xSemaphoreGive(motionMutex);
+    }
+
+    if (fwrite(&time, sizeof(uint64_t), 1, cellFile) != 1 || fwrite(&cells, sizeof(uint64_t), 1, cellFile) != 1 || fwrite(&box, sizeof(CMotionBox), 1, cellFile) != 1) {
+        ESP_LOGW(CCAMERA_TAG, "writeCellRecord: Write failed, closing sidecar");
+        fclose(cellFile);
+        cellFile = NULL;
+    }
 }
 
-int CCamera::closeFile()
+int CCamera::stopFile()
 {
+    if (cellFile) {
+        fclose(cellFile);
+        cellFile = NULL;
+    }
+    journal.setFile(NULL);
+
     return aviFile.closeFile("");
 }
 
+int CCamera::closeFile()
+{
+    if (!recording) {
+        return CAM_RET_FILE_NOT_OPEN;
+    }
+
+    //the storage task closes the file after the frames already queued
+    recording = false;
+    postStorageJob(CAM_JOB_CLOSE, CurrentTime.ms64());
+
+    return CAM_RET_OK;
+}
+
 bool CCamera::isRecording()
 {
-    return aviFile.isOpen();
+    return recording;
 }
 
 bool CCamera::isRunning()
@@ -238,39 +506,390 @@ void CCamera::setAllowMotion(bool allow)
     allowMotion = allow;
 }
 
-void CCamera::setOnFrameCallback(bool (*cb)(camera_fb_t*))
+void CCamera::setOnFrameCallback(bool (*cb)(CFrame*))
 {
     onFrame = cb;
 }
 
-void CCamera::cameraTriggerTask(void* vPtr)
+int CCamera::setFPS(float fps)
 {
-    //subscribe to WDT
-    ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
-    ESP_ERROR_CHECK(esp_task_wdt_status(NULL));
+    if (fps < 0) {
+        return CAM_RET_INVALID;
+    }
 
-    CCamera* pCamera = (CCamera*)vPtr;
-    xSemaphoreTake(pCamera->triggerTaskMutex, portMAX_DELAY);
+    // 0 selects the default fps of the current frame size
+    frameRate = fps;
+    timeLapse = 0;
+    setReduceLevel(0);
+    if (!allowTasks) {
+        return CAM_RET_OK;
+    }
 
-    ESP_LOGI(CCAMERA_TAG, "Trigger Task: Started");
-    xSemaphoreGive(pCamera->syncTaskSemaphore);
-    sensor_t * s = esp_camera_sensor_get();
-    uint32_t fps = frameData[s->status.framesize].defaultFPS ? frameData[s->status.framesize].defaultFPS : 1;
-    uint32_t frameDelay = 1000 / fps;
-    while(pCamera->allowTasks) {
-        xSemaphoreGive(pCamera->triggerSemaphore);
+    if (!frameRate) {
+        fps = frameData[frameSize].defaultFPS ? frameData[frameSize].defaultFPS : 1;
+    }
 
-        esp_task_wdt_reset();
+    return scheduler.setFPS(fps) == SCH_RET_OK ? CAM_RET_OK : CAM_RET_INVALID;
+}
 
-        vTaskDelay(pdMS_TO_TICKS(frameDelay));
+int CCamera::setTimeLapse(uint32_t intervalMs)
+{
+    if (!intervalMs) {
+        return setFPS(frameRate);
     }
-  
-    xSemaphoreGive(pCamera->triggerTaskMutex);
 
-    //unsubscribe to WDT and deinit
-    ESP_ERROR_CHECK(esp_task_wdt_delete(NULL));
+    timeLapse = intervalMs;
+    setReduceLevel(0);
+    if (!allowTasks) {
+        return CAM_RET_OK;
+    }
 
-    vTaskDelete(NULL);
+    return scheduler.setInterval((uint64_t)intervalMs * 1000) == SCH_RET_OK ? CAM_RET_OK : CAM_RET_INVALID;
+}
+
+void CCamera::getSchedulerStats(CSchedulerStats* stats)
+{
+    scheduler.getStats(stats);
+}
+
+void CCamera::setStoragePolicy(CStoragePolicy policy)
+{
+    storagePolicy = policy;
+    if (policy != CAM_STORE_REDUCE_FPS) {
+        setReduceLevel(0);
+    }
+}
+
+void CCamera::getStorageStats(CStorageStats* stats)
+{
+    portENTER_CRITICAL(&storageLock);
+    *stats = storageStats;
+    portEXIT_CRITICAL(&storageLock);
+    stats->policy       = storagePolicy;
+    stats->queueDepth   = uxQueueMessagesWaiting(storageQueue);
+}
+
+int CCamera::reconfigure(framesize_t size, int quality)
+{
+    if (size > CAM_MAX_FRAMESIZE || quality < 0 || quality > 63) {
+        ESP_LOGW(CCAMERA_TAG, "reconfigure: Invalid frame size [%u] or quality [%d]", size, quality);
+
+        return CAM_RET_INVALID;
+    }
+
+    if (!allowTasks) {
+        frameSize   = size;
+        jpegQuality = quality;
+
+        return CAM_RET_OK;
+    }
+
+    //hold capture and motion between frames while the sensor changes
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    int ret = applyConfig(size, quality);
+    xSemaphoreGive(configMutex);
+
+    return ret;
+}
+
+int CCamera::applyConfig(framesize_t size, int quality)
+{
+    //replayed frames cannot change size
+    if (!frameSource->isSensor()) {
+        return CAM_RET_INVALID;
+    }
+
+    uint32_t startTime = CurrentTime.us();
+
+    //roll the recording, capture starts a new file at the new size if motion is still ongoing
+    if (recording) {
+        closeFile();
+    }
+
+    sensor_t* s = esp_camera_sensor_get();
+    if (size != s->status.framesize && s->set_framesize(s, size)) {
+        ESP_LOGE(CCAMERA_TAG, "applyConfig: Unable to set frame size [%u]", size);
+
+        return CAM_RET_INVALID;
+    }
+    if (quality != s->status.quality) {
+        s->set_quality(s, quality);
+    }
+    frameSize   = size;
+    jpegQuality = quality;
+
+    //frames already tagged with the old generation are dropped by the motion task
+    xSemaphoreTake(motionMutex, portMAX_DELAY);
+    motion.setImageParameters(frameData[size].scaleFactor, frameData[size].sampleRate, frameData[size].frameWidth, frameData[size].frameHeight);
+    configGen++;
+    xSemaphoreGive(motionMutex);
+    preBuffer.clear();
+    discardFrames   = CAM_RECONFIG_DISCARD;
+    switchStart     = startTime;
+
+    if (!frameRate && !timeLapse) {
+        setReduceLevel(0);
+        scheduler.setFPS(frameData[size].defaultFPS ? frameData[size].defaultFPS : 1);
+    }
+
+    ESP_LOGI(CCAMERA_TAG, "applyConfig: Frame size [%s] quality [%d]", frameData[size].frameSizeStr, quality);
+
+    return CAM_RET_OK;
+}
+
+framesize_t CCamera::getFrameSize()
+{
+    return frameSize;
+}
+
+int CCamera::getQuality()
+{
+    return jpegQuality;
+}
+
+uint32_t CCamera::getSwitchTime()
+{
+    return switchTime;
+}
+
+int CCamera::startBurst(uint32_t count, framesize_t size, bool toAvi)
+{
+    if (!allowTasks || !count || size > CAM_MAX_FRAMESIZE) {
+        ESP_LOGW(CCAMERA_TAG, "startBurst: Invalid burst [%lu] size [%u]", count, size);
+
+        return CAM_RET_INVALID;
+    }
+
+    if (burstStats.state != CAM_BURST_IDLE) {
+        return CAM_RET_BUSY;
+    }
+
+    //replayed frames stay at the size they were recorded at
+    framesize_t burstSize = frameSource->isSensor() ? size : frameSize;
+    if (burstBuffer.init(count, (uint32_t)frameData[burstSize].frameWidth * frameData[burstSize].frameHeight / CAM_BURST_JPEG_RATIO) != BST_RET_OK) {
+        return CAM_RET_INVALID;
+    }
+
+    memset(&burstStats, 0, sizeof(CBurstStats));
+    burstStats.state        = CAM_BURST_CAPTURE;
+    burstStats.frameSize    = burstSize;
+    burstStats.toAvi        = toAvi;
+    burstStats.requested    = count < BST_MAX_FRAMES ? count : BST_MAX_FRAMES;
+    burstStats.budget       = burstBuffer.budget();
+
+    if (TaskConfig.create(TASK_BURST, cameraBurstTask, this) != TASK_RET_OK) {
+        burstBuffer.deinit();
+        burstStats.state = CAM_BURST_IDLE;
+
+        return CAM_RET_INVALID;
+    }
+
+    return CAM_RET_OK;
+}
+
+bool CCamera::isBursting()
+{
+    return burstStats.state != CAM_BURST_IDLE;
+}
+
+void CCamera::getBurstStats(CBurstStats* stats)
+{
+    *stats = burstStats;
+}
+
+int CCamera::setFrameSource(CFrameSource* source)
+{
+    //the source can only change while the capture task is stopped
+    if (allowTasks) {
+        ESP_LOGW(CCAMERA_TAG, "setFrameSource: Camera is running");
+
+        return CAM_RET_INVALID;
+    }
+
+    frameSource = source ? source : &SensorSource;
+    if (frameSource->isSensor() && watchMode) {
+        frameSize = watchSize;
+    }
+
+    return CAM_RET_OK;
+}
+
+bool CCamera::isReplay()
+{
+    return !frameSource->isSensor();
+}
+
+void CCamera::setMotionDecoder(CMotionDecoder decoder)
+{
+    xSemaphoreTake(motionMutex, portMAX_DELAY);
+    motion.setDecoder(decoder);
+    xSemaphoreGive(motionMutex);
+}
+
+void CCamera::setMotionPrefilter(bool enable)
+{
+    xSemaphoreTake(motionMutex, portMAX_DELAY);
+    motion.setPrefilter(enable);
+    xSemaphoreGive(motionMutex);
+}
+
+void CCamera::setMotionModel(CMotionModel model, uint8_t rateShift)
+{
+    xSemaphoreTake(motionMutex, portMAX_DELAY);
+    motion.setModel(model, rateShift);
+    xSemaphoreGive(motionMutex);
+}
+
+int CCamera::setMotionGrid(const CMotionGrid* grid)
+{
+    xSemaphoreTake(motionMutex, portMAX_DELAY);
+    bool ok = motion.setGrid(grid);
+    if (ok) {
+        portENTER_CRITICAL(&cellLock);
+        motion.getGrid(&cellGrid);
+        portEXIT_CRITICAL(&cellLock);
+    }
+    xSemaphoreGive(motionMutex);
+
+    return ok ? CAM_RET_OK : CAM_RET_INVALID;
+}
+
+void CCamera::getMotionGrid(CMotionGrid* grid)
+{
+    portENTER_CRITICAL(&cellLock);
+    *grid = cellGrid;
+    portEXIT_CRITICAL(&cellLock);
+}
+
+uint64_t CCamera::getMotionCells()
+{
+    return motion.getCells();
+}
+
+void CCamera::getMotionBox(CMotionBox* box)
+{
+    motion.getBox(box);
+}
+
+void CCamera::setMotionAutoThreshold(bool enable)
+{
+    xSemaphoreTake(motionMutex, portMAX_DELAY);
+    motion.setAutoThreshold(enable);
+    xSemaphoreGive(motionMutex);
+}
+
+void CCamera::setMotionIllumination(bool enable)
+{
+    xSemaphoreTake(motionMutex, portMAX_DELAY);
+    motion.setIllumination(enable);
+    xSemaphoreGive(motionMutex);
+}
+
+void CCamera::setMotionCascade(bool enable)
+{
+    xSemaphoreTake(motionMutex, portMAX_DELAY);
+    motion.setCascade(enable);
+    xSemaphoreGive(motionMutex);
+}
+
+void CCamera::setMotionBands(uint8_t count)
+{
+    xSemaphoreTake(motionMutex, portMAX_DELAY);
+    motion.setBands(count);
+    xSemaphoreGive(motionMutex);
+}
+
+void CCamera::setMotionDebug(bool enable)
+{
+    // resizes the motion buffers, so not while a frame is being compared
+    xSemaphoreTake(motionMutex, portMAX_DELAY);
+    motion.setDebug(enable);
+    xSemaphoreGive(motionMutex);
+}
+
+void CCamera::getJournalInfo(CJournalInfo* info)
+{
+    journal.getInfo(info);
+}
+
+int CCamera::findEvents(uint16_t fromBoot, uint64_t from, uint16_t toBoot, uint64_t to, uint32_t* first, uint32_t* count)
+{
+    return journal.search(fromBoot, from, toBoot, to, first, count) == JNL_RET_OK ? CAM_RET_OK : CAM_RET_INVALID;
+}
+
+uint32_t CCamera::readEvents(uint32_t index, uint32_t count, CJournalRecord* out)
+{
+    return journal.read(index, count, out);
+}
+
+void CCamera::getMotionStats(CMotionStats* stats)
+{
+    motion.getStats(stats);
+}
+
+int CCamera::setWatchMode(bool enable, framesize_t watch, framesize_t record)
+{
+    if (watch > CAM_MAX_FRAMESIZE || record > CAM_MAX_FRAMESIZE || watch > record) {
+        ESP_LOGW(CCAMERA_TAG, "setWatchMode: Invalid frame sizes [%u] [%u]", watch, record);
+
+        return CAM_RET_INVALID;
+    }
+
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    watchMode   = enable;
+    watchSize   = watch;
+    recordSize  = record;
+    xSemaphoreGive(configMutex);
+
+    ESP_LOGI(CCAMERA_TAG, "setWatchMode: %s, watch [%s] record [%s]", enable ? "Enabled" : "Disabled", frameData[watch].frameSizeStr, frameData[record].frameSizeStr);
+
+    //an active recording keeps its size, capture switches down when it ends
+    if (recording) {
+        return CAM_RET_OK;
+    }
+
+    return reconfigure(enable ? watchSize : recordSize, jpegQuality);
+}
+
+void CCamera::getWatchStats(CWatchStats* stats)
+{
+    *stats = watchStats;
+    stats->enabled      = watchMode;
+    stats->watchSize    = watchSize;
+    stats->recordSize   = recordSize;
+    stats->watchCheckUs = stats->watchChecks ? (uint32_t)(watchCheckTotal / stats->watchChecks) : 0;
+    stats->recordCheckUs = stats->recordChecks ? (uint32_t)(recordCheckTotal / stats->recordChecks) : 0;
+
+    //decode work avoided by not checking the watch frames at the record size
+    if (stats->recordCheckUs > stats->watchCheckUs) {
+        stats->savedMs = (uint32_t)(((uint64_t)(stats->recordCheckUs - stats->watchCheckUs) * stats->watchChecks) / 1000);
+    }
+}
+
+void CCamera::resetWatchStats()
+{
+    memset(&watchStats, 0, sizeof(CWatchStats));
+    watchCheckTotal     = 0;
+    recordCheckTotal    = 0;
+}
+
+int CCamera::setPreBuffer(uint32_t seconds, uint32_t byteBudget)
+{
+    // a budget of 0 releases the buffer
+    if (!seconds || !byteBudget) {
+        preBuffer.deinit();
+
+        return CAM_RET_OK;
+    }
+
+    // leave headroom in PSRAM for the frame buffers and motion
+    if (byteBudget > heap_caps_get_free_size(MALLOC_CAP_SPIRAM) / 2) {
+        ESP_LOGW(CCAMERA_TAG, "setPreBuffer: Budget [%lu] exceeds available PSRAM", byteBudget);
+
+        return CAM_RET_INVALID;
+    }
+
+    return preBuffer.init(seconds, byteBudget) == PRE_RET_OK ? CAM_RET_OK : CAM_RET_INVALID;
 }
 
 void CCamera::cameraCaptureTask(void* vPtr)
@@ -285,12 +904,72 @@ void CCamera::cameraCaptureTask(void* vPtr)
     ESP_LOGI(CCAMERA_TAG, "Capture Task: Started");
     xSemaphoreGive(pCamera->syncTaskSemaphore);
     while(pCamera->allowTasks) {
-        if(xSemaphoreTake(pCamera->triggerSemaphore, pdMS_TO_TICKS(TIMEOUT_TASK)) == pdTRUE) {
-            //are we waiting for a motion frame or are we recording?
-            if (pCamera->aviFile.isOpen() || (!uxQueueMessagesWaiting(pCamera->motionQueue) && pCamera->allowMotion)) {
-                // get camera frame
-                camera_fb_t* fb = esp_camera_fb_get();
-                if (fb) {
+        CFrameTrigger trigger;
+
+        //a burst has the sensor, stay between frames until it hands it back
+        if (pCamera->pauseCapture) {
+            pCamera->capturePaused = true;
+            xQueueReceive(pCamera->triggerQueue, &trigger, pdMS_TO_TICKS(TIMEOUT_TASK));
+            esp_task_wdt_reset();
+            continue;
+        }
+        pCamera->capturePaused = false;
+
+        if(xQueueReceive(pCamera->triggerQueue, &trigger, pdMS_TO_TICKS(TIMEOUT_TASK)) == pdTRUE) {
+            //if we fell behind skip to the newest deadline instead of capturing a burst
+            uint32_t dropped = 0;
+            while (xQueueReceive(pCamera->triggerQueue, &trigger, 0) == pdTRUE) {
+                dropped++;
+            }
+            if (dropped) {
+                pCamera->scheduler.reportMissed(dropped);
+            }
+
+            // get camera frame and wrap it so every consumer can share it, no lock is held while it waits
+            camera_fb_t* fb = pCamera->frameSource->get();
+            CFrame* frame = CFrame::acquire(fb, pCamera->frameSource);
+
+            //the config lock only covers a snapshot, changes land between frames
+            xSemaphoreTake(pCamera->configMutex, portMAX_DELAY);
+            bool discard            = frame && pCamera->discardFrames;
+            uint32_t gen            = pCamera->configGen;
+            framesize_t size        = pCamera->frameSize;
+            framesize_t watchSize   = pCamera->watchSize;
+            framesize_t recordSize  = pCamera->recordSize;
+            bool watchMode          = pCamera->watchMode && pCamera->frameSource->isSensor();
+            int quality             = pCamera->jpegQuality;
+
+            //drop frames captured before a frame size switch
+            if (discard) {
+                pCamera->discardFrames--;
+                if (!pCamera->discardFrames) {
+                    pCamera->switchTime = CurrentTime.us() - pCamera->switchStart;
+                    pCamera->watchStats.switches++;
+                    pCamera->watchStats.lastSwitchUs = pCamera->switchTime;
+                    if (pCamera->switchTime > pCamera->watchStats.maxSwitchUs) {
+                        pCamera->watchStats.maxSwitchUs = pCamera->switchTime;
+                    }
+                    ESP_LOGI(CCAMERA_TAG, "Capture Task: Frame size switched in %lu us", pCamera->switchTime);
+                }
+            }
+            xSemaphoreGive(pCamera->configMutex);
+
+            if (discard) {
+                frame->release();
+            }
+            else if (frame) {
+                frame->setGeneration(gen);
+                frame->stamp(TRACE_TRIGGER, (uint32_t)trigger.given);
+                frame->stamp(TRACE_ACQUIRED);
+                pCamera->scheduler.reportFrame(&trigger);
+
+                //are we waiting for motion or are we recording?
+                if (pCamera->recording || pCamera->allowMotion) {
+                    //keep recent frames so a new recording can start before the trigger
+                    if (!pCamera->recording) {
+                        pCamera->preBuffer.push(frame->buf(), frame->len(), CurrentTime.ms());
+                    }
+
                     //check for motion
                     if (!pCamera->motion.getMotion()) {
                         if (pCamera->recordCountDown) {
@@ -302,56 +981,146 @@ void CCamera::cameraCaptureTask(void* vPtr)
                     }
 
                     //check if file is recording and if not should it be
-                    if (pCamera->aviFile.isOpen()) {
-                        if (!pCamera->recordCountDown || pCamera->aviFile.writeFrame(fb) != AVI_RET_OK) {
-                            pCamera->aviFile.closeFile("");
+                    if (pCamera->recording) {
+                        if (!pCamera->recordCountDown) {
+                            pCamera->closeFile();
+
+                            //motion is over, go back to watching at the small size
+                            if (watchMode && size != watchSize) {
+                                xSemaphoreTake(pCamera->configMutex, portMAX_DELAY);
+                                pCamera->applyConfig(watchSize, quality);
+                                xSemaphoreGive(pCamera->configMutex);
+                            }
                         }
+                        else {
+                            pCamera->queueStorageFrame(frame);
+                        }
+                    }
+                    else if (pCamera->recordCountDown && watchMode && size != recordSize) {
+                        //switch up first, recording starts with the first frame at the record size
+                        xSemaphoreTake(pCamera->configMutex, portMAX_DELAY);
+                        pCamera->applyConfig(recordSize, quality);
+                        xSemaphoreGive(pCamera->configMutex);
                     }
                     else if (pCamera->recordCountDown) {
-                        uint32_t currentTime = CurrentTime.ms();
-                        uint32_t d = currentTime / 1000 / 60 / 60 / 24;
-                        uint32_t h = (currentTime / 1000 / 60 / 60) % 24;
-                        uint32_t m = (currentTime / 1000 / 60) % 60;
-                        uint32_t s = (currentTime / 1000) % 60;
-
-                        char fileName[256];
-                        sprintf(fileName, "/sdcard/recording_%lu_%lu_%lu_%lu.avi", d, h, m, s);
-                        pCamera->startFile(fileName, CAM_MAX_FRAMES);
+                        pCamera->recording = true;
+                        if (!pCamera->postStorageJob(CAM_JOB_START, CurrentTime.ms64())) {
+                            pCamera->recording = false;
+                        }
                     }
 
-                    //if the motion task is waiting feed it a new frame
-                    if (!uxQueueMessagesWaiting(pCamera->motionQueue)) {
-                        xQueueSend(pCamera->motionQueue, &fb, portMAX_DELAY);
-                    }
-                    else {
-                        esp_camera_fb_return(fb);
+                    //if the motion task is waiting share the frame with it
+                    if (pCamera->allowMotion && !uxQueueMessagesWaiting(pCamera->motionQueue)) {
+                        frame->addRef();
+                        if (xQueueSend(pCamera->motionQueue, &frame, 0) != pdTRUE) {
+                            frame->release();
+                        }
                     }
                 }
-                else {
-                    ESP_LOGW(CCAMERA_TAG, "Capture Task: fb is null");
+
+                //let the stream take its own reference if it wants the frame
+                if (pCamera->onFrame) {
+                    pCamera->onFrame(frame);
                 }
+
+                frame->release();
+            }
+            else if (fb) {
+                pCamera->frameSource->release(fb);
             }
             else {
-                camera_fb_t* fb = esp_camera_fb_get();
+                ESP_LOGW(CCAMERA_TAG, "Capture Task: fb is null");
+            }
+        }
 
-                //send frame to callback and check if its keeping the frame
-                if (pCamera->onFrame) {
-                    if (!pCamera->onFrame(fb) && fb) {
-                        esp_camera_fb_return(fb);
+        esp_task_wdt_reset();
+    }
+  
+    xSemaphoreGive(pCamera->captureTaskMutex);
+
+    //unsubscribe to WDT and deinit
+    ESP_ERROR_CHECK(esp_task_wdt_delete(NULL));
+
+    vTaskDelete(NULL);
+}
+
+void CCamera::cameraStorageTask(void* vPtr)
+{
+    //subscribe to WDT
+    ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
+    ESP_ERROR_CHECK(esp_task_wdt_status(NULL));
+
+    CCamera* pCamera = (CCamera*)vPtr;
+    xSemaphoreTake(pCamera->storageTaskMutex, portMAX_DELAY);
+
+    ESP_LOGI(CCAMERA_TAG, "Storage Task: Started");
+    xSemaphoreGive(pCamera->syncTaskSemaphore);
+    CStorageJob job;
+    while(pCamera->allowTasks || uxQueueMessagesWaiting(pCamera->storageQueue)) {
+        if(xQueueReceive(pCamera->storageQueue, &job, pdMS_TO_TICKS(TIMEOUT_TASK)) == pdTRUE) {
+            switch (job.type) {
+            case CAM_JOB_START: {
+                uint32_t d = job.time / 1000 / 60 / 60 / 24;
+                uint32_t h = (job.time / 1000 / 60 / 60) % 24;
+                uint32_t m = (job.time / 1000 / 60) % 60;
+                uint32_t s = (job.time / 1000) % 60;
+
+                char fileName[256];
+                sprintf(fileName, "/sdcard/recording_%lu_%lu_%lu_%lu.avi", d, h, m, s);
+                if (pCamera->startFile(fileName, CAM_MAX_FRAMES, (framesize_t)job.frameSize) != AVI_RET_OK) {
+                    pCamera->stopFile();
+                    pCamera->recording = false;
+                }
+                else {
+                    pCamera->openCellFile(fileName);
+                    pCamera->journal.setFile(fileName);
+                }
+                pCamera->scheduler.resetStats();
+                break;
+            }
+
+            case CAM_JOB_FRAME:
+                if (pCamera->aviFile.isOpen()) {
+                    if (pCamera->aviFile.writeFrame(job.frame->fb()) == AVI_RET_OK) {
+                        job.frame->stamp(TRACE_WRITTEN);
+                        pCamera->writeCellRecord(job.frame, job.time);
+                        pCamera->countStorage(&pCamera->storageStats.written);
+                    }
+                    else {
+                        //max frames or a write failure, close and let capture start a new file
+                        pCamera->countStorage(&pCamera->storageStats.writeErrors);
+                        pCamera->stopFile();
+                        pCamera->recording = false;
                     }
                 }
-                else if (fb) {
-                    esp_camera_fb_return(fb);
+                job.frame->release();
+                break;
+
+            case CAM_JOB_CLOSE:
+                if (pCamera->stopFile() == AVI_RET_OK) {
+                    CSchedulerStats stats;
+                    pCamera->scheduler.getStats(&stats);
+                    ESP_LOGI(CCAMERA_TAG, "Storage Task: Target FPS %0.2f, actual FPS %0.2f, late frames %lu, missed triggers %lu", 1000000.0f / stats.intervalUs, stats.actualFPS, stats.lateFrames, stats.missed + stats.skipped);
+                    ESP_LOGI(CCAMERA_TAG, "Storage Task: Frame lateness avg %lu us, max %lu us", stats.avgLateUs, stats.maxLateUs);
+                    CStorageStats storage;
+                    pCamera->getStorageStats(&storage);
+                    ESP_LOGI(CCAMERA_TAG, "Storage Task: Queue max %lu/%u, written %lu, dropped %lu, fps reductions %lu", storage.queueMax, pCamera->fbCount - 2, storage.written, storage.dropped, storage.fpsReductions);
                 }
+                break;
             }
         }
 
-        esp_task_wdt_reset();
+        //every journal write happens here, full sectors straight away and part filled ones once they have waited long enough
+        pCamera->journal.poll(CurrentTime.ms());
 
-        vTaskDelay(pdMS_TO_TICKS(10));
+        esp_task_wdt_reset();
     }
+
+    //close any recording left open by stop()
+    pCamera->stopFile();
+    pCamera->recording = false;
   
-    xSemaphoreGive(pCamera->captureTaskMutex);
+    xSemaphoreGive(pCamera->storageTaskMutex);
 
     //unsubscribe to WDT and deinit
     ESP_ERROR_CHECK(esp_task_wdt_delete(NULL));
@@ -371,19 +1140,61 @@ void CCamera::cameraMotionTask(void* vPtr)
     ESP_LOGI(CCAMERA_TAG, "Motion Task: Started");
     xSemaphoreGive(pCamera->syncTaskSemaphore);
     while(pCamera->allowTasks) {
-        camera_fb_t* fb;
-        if(xQueueReceive(pCamera->motionQueue, &fb, pdMS_TO_TICKS(TIMEOUT_TASK)) == pdTRUE) {
-            if(fb) {
-                pCamera->motion.checkMotion(fb);
-                esp_camera_fb_return(fb);
+        CFrame* frame;
+        if(xQueueReceive(pCamera->motionQueue, &frame, pdMS_TO_TICKS(TIMEOUT_TASK)) == pdTRUE) {
+            if(frame) {
+                //a frame captured before a size change does not match the motion buffers any more
+                xSemaphoreTake(pCamera->motionMutex, portMAX_DELAY);
+                if (frame->generation() != pCamera->configGen) {
+                    xSemaphoreGive(pCamera->motionMutex);
+                    ESP_LOGD(CCAMERA_TAG, "Motion Task: Dropped frame from config [%lu]", frame->generation());
+                    frame->release();
+                    esp_task_wdt_reset();
+                    continue;
+                }
+
+                int64_t checkStart = esp_timer_get_time();
+                frame->stamp(TRACE_MOTION_START);
+                pCamera->motion.checkMotion(frame->fb());
+                frame->stamp(TRACE_MOTION_END);
+                uint32_t checkTime = (uint32_t)(esp_timer_get_time() - checkStart);
+
+                //anyone still holding the frame can see where it changed
+                CMotionBox box;
+                pCamera->motion.getBox(&box);
+                uint64_t cells  = pCamera->motion.getCells();
+                frame->setMotion(&box, cells);
+                bool moving     = pCamera->motion.getMotion();
+                uint8_t light   = pCamera->motion.getLightLevel();
+                xSemaphoreGive(pCamera->motionMutex);
+
+                //every start and stop goes in the journal with the peak change, light and cells in between
+                if (moving) {
+                    if (!pCamera->journal.inEvent()) {
+                        pCamera->journal.startEvent(CurrentTime.ms64());
+                    }
+                    pCamera->journal.updateEvent(box.area, cells, light);
+                }
+                else if (pCamera->journal.inEvent()) {
+                    pCamera->journal.stopEvent(CurrentTime.ms64());
+                }
+
+                //motion cost per frame size, shows what watch mode saves
+                if (pCamera->watchMode && frame->fb()->width == frameData[pCamera->watchSize].frameWidth) {
+                    pCamera->watchStats.watchChecks++;
+                    pCamera->watchCheckTotal += checkTime;
+                }
+                else {
+                    pCamera->watchStats.recordChecks++;
+                    pCamera->recordCheckTotal += checkTime;
+                }
+                frame->release();
             } else {
-                ESP_LOGW(CCAMERA_TAG, "Motion Task: fb is null");
+                ESP_LOGW(CCAMERA_TAG, "Motion Task: frame is null");
             }
         }
 
         esp_task_wdt_reset();
-
-        vTaskDelay(pdMS_TO_TICKS(100));
     }
   
     xSemaphoreGive(pCamera->motionTaskMutex);
@@ -394,6 +1205,295 @@ void CCamera::cameraMotionTask(void* vPtr)
     vTaskDelete(NULL);
 }
 
+void CCamera::cameraBurstTask(void* vPtr)
+{
+    //subscribe to WDT
+    ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
+    ESP_ERROR_CHECK(esp_task_wdt_status(NULL));
+
+    CCamera* pCamera = (CCamera*)vPtr;
+
+    ESP_LOGI(CCAMERA_TAG, "Burst Task: Started");
+    pCamera->captureBurst();
+
+    //the frames are safe in PSRAM, write them out without starving capture
+    vTaskPrioritySet(NULL, TaskConfig.get(TASK_STORAGE)->priority);
+    pCamera->drainBurst();
+
+    pCamera->burstBuffer.deinit();
+    pCamera->burstStats.state = CAM_BURST_IDLE;
+
+    //unsubscribe to WDT and deinit
+    ESP_ERROR_CHECK(esp_task_wdt_delete(NULL));
+
+    vTaskDelete(NULL);
+}
+
+bool CCamera::holdCapture()
+{
+    //capture parks between frames, the wait keeps feeding the watchdog
+    pauseCapture = true;
+    uint32_t start = CurrentTime.ms();
+    while (allowTasks && !capturePaused) {
+        if (CurrentTime.ms() - start > CAM_PAUSE_TIMEOUT) {
+            ESP_LOGW(CCAMERA_TAG, "holdCapture: Capture did not pause");
+            pauseCapture = false;
+
+            return false;
+        }
+        vTaskDelay(1);
+        esp_task_wdt_reset();
+    }
+
+    if (!allowTasks) {
+        pauseCapture = false;
+
+        return false;
+    }
+
+    return true;
+}
+
+void CCamera::captureBurst()
+{
+    //capture is parked for the burst, the config lock is only taken to switch size
+    if (!holdCapture()) {
+        return;
+    }
+
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    framesize_t prevSize = frameSize;
+    if (burstStats.frameSize != frameSize) {
+        applyConfig((framesize_t)burstStats.frameSize, jpegQuality);
+    }
+    xSemaphoreGive(configMutex);
+
+    //flush the frames the driver captured at the old size
+    while (discardFrames) {
+        camera_fb_t* fb = frameSource->get();
+        if (fb) {
+            frameSource->release(fb);
+        }
+        discardFrames--;
+        esp_task_wdt_reset();
+    }
+
+    //grab frames straight from the source as fast as it delivers them
+    uint32_t fails = 0;
+    int64_t startTime = esp_timer_get_time();
+    while (allowTasks && burstBuffer.count() < burstStats.requested && fails < CAM_BURST_MAX_FAILS) {
+        camera_fb_t* fb = frameSource->get();
+        if (!fb) {
+            fails++;
+            continue;
+        }
+
+        int ret = burstBuffer.add(fb->buf, fb->len, (uint32_t)esp_timer_get_time());
+        frameSource->release(fb);
+        if (ret != BST_RET_OK) {
+            ESP_LOGW(CCAMERA_TAG, "captureBurst: PSRAM budget full after %lu frames", burstBuffer.count());
+            break;
+        }
+
+        esp_task_wdt_reset();
+    }
+    int64_t captureTime = esp_timer_get_time() - startTime;
+
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    if (frameSize != prevSize) {
+        applyConfig(prevSize, jpegQuality);
+    }
+    xSemaphoreGive(configMutex);
+    pauseCapture = false;
+
+    burstStats.captured     = burstBuffer.count();
+    burstStats.bytes        = burstBuffer.bytes();
+    burstStats.captureMs    = (uint32_t)(captureTime / 1000);
+    burstStats.fps          = captureTime > 0 ? (1000000.0f * burstStats.captured) / (float)captureTime : 0.0f;
+    burstStats.state        = CAM_BURST_DRAIN;
+
+    ESP_LOGI(CCAMERA_TAG, "captureBurst: %lu frames, %lu bytes in %lu ms (%0.2f fps)", burstStats.captured, burstStats.bytes, burstStats.captureMs, burstStats.fps);
+}
+
+void CCamera::drainBurst()
+{
+    if (!burstStats.captured) {
+        return;
+    }
+
+    uint32_t drainStart = CurrentTime.ms();
+    uint64_t now        = CurrentTime.ms64();
+    uint32_t d          = now / 1000 / 60 / 60 / 24;
+    uint32_t h          = (now / 1000 / 60 / 60) % 24;
+    uint32_t m          = (now / 1000 / 60) % 60;
+    uint32_t s          = (now / 1000) % 60;
+
+    const uint8_t* buf;
+    uint32_t len, timeUs;
+    char fileName[MAX_FILE_NAME];
+    if (burstStats.toAvi) {
+        // the AVI writer buffers a few sectors, keep it off the task stack
+        CAVI* pAvi = new CAVI();
+        sprintf(fileName, "/sdcard/burst_%lu_%lu_%lu_%lu.avi", d, h, m, s);
+        uint8_t fps = burstStats.fps < 1.0f ? 1 : (uint8_t)(burstStats.fps + 0.5f);
+        if (pAvi->startFile(fileName, frameData[burstStats.frameSize].frameWidth, frameData[burstStats.frameSize].frameHeight, fps, false, burstStats.captured) == AVI_RET_OK) {
+            for (uint32_t i = 0; burstBuffer.getFrame(i, &buf, &len, &timeUs); i++) {
+                if (pAvi->writeFrame(buf, len) != AVI_RET_OK) {
+                    burstStats.drainErrors++;
+                }
+                esp_task_wdt_reset();
+            }
+            pAvi->closeFile("");
+        }
+        else {
+            burstStats.drainErrors = burstStats.captured;
+        }
+        delete pAvi;
+    }
+    else {
+        char dirName[MAX_FILE_NAME];
+        sprintf(dirName, "/sdcard/burst_%lu_%lu_%lu_%lu", d, h, m, s);
+        Fat32.createDir(dirName);
+        for (uint32_t i = 0; burstBuffer.getFrame(i, &buf, &len, &timeUs); i++) {
+            snprintf(fileName, sizeof(fileName), "%s/frame_%03lu.jpg", dirName, i);
+            FILE* f = fopen(fileName, "w");
+            if (!f || fwrite(buf, len, 1, f) != 1) {
+                burstStats.drainErrors++;
+            }
+            if (f) {
+                fclose(f);
+            }
+            esp_task_wdt_reset();
+        }
+    }
+
+    burstStats.drainMs = CurrentTime.ms() - drainStart;
+
+    ESP_LOGI(CCAMERA_TAG, "drainBurst: %lu frames written in %lu ms, %lu errors", burstStats.captured - burstStats.drainErrors, burstStats.drainMs, burstStats.drainErrors);
+}
+
+bool CCamera::postStorageJob(uint8_t type, uint64_t time)
+{
+    CStorageJob job;
+    job.type        = type;
+    job.frameSize   = frameSize;
+    job.time        = time;
+    job.frame       = NULL;
+
+    //control jobs are never dropped, make room by discarding the oldest frame
+    while (xQueueSend(storageQueue, &job, 0) != pdTRUE) {
+        CStorageJob oldest;
+        if (xQueueReceive(storageQueue, &oldest, 0) == pdTRUE) {
+            if (oldest.type == CAM_JOB_FRAME) {
+                oldest.frame->release();
+                countStorage(&storageStats.dropped);
+            }
+            else if (xQueueSendToFront(storageQueue, &oldest, 0) != pdTRUE || xQueueSend(storageQueue, &job, pdMS_TO_TICKS(TIMEOUT_TASK)) != pdTRUE) {
+                ESP_LOGW(CCAMERA_TAG, "postStorageJob: Unable to queue job [%u]", type);
+
+                return false;
+            }
+            else {
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+void CCamera::queueStorageFrame(CFrame* frame)
+{
+    CStorageJob job;
+    job.type        = CAM_JOB_FRAME;
+    job.frameSize   = frameSize;
+    job.time        = CurrentTime.ms64();
+    job.frame       = frame->addRef();
+    frame->stamp(TRACE_QUEUED);
+
+    uint32_t depth = uxQueueMessagesWaiting(storageQueue);
+    portENTER_CRITICAL(&storageLock);
+    if (depth > storageStats.queueMax) {
+        storageStats.queueMax = depth;
+    }
+    portEXIT_CRITICAL(&storageLock);
+
+    //step a reduced fps back up once the writer has kept up for a while
+    if (!depth) {
+        if (storageStats.reduceLevel && ++emptyQueueCount >= CAM_STORE_RESTORE_FRAMES) {
+            setReduceLevel(storageStats.reduceLevel - 1);
+        }
+    }
+    else {
+        emptyQueueCount = 0;
+    }
+
+    if (xQueueSend(storageQueue, &job, 0) == pdTRUE) {
+        countStorage(&storageStats.queued);
+
+        return;
+    }
+
+    //the writer is behind, apply the backpressure policy
+    switch (storagePolicy) {
+    case CAM_STORE_DROP_OLDEST: {
+        CStorageJob oldest;
+        if (xQueuePeek(storageQueue, &oldest, 0) == pdTRUE && oldest.type == CAM_JOB_FRAME && xQueueReceive(storageQueue, &oldest, 0) == pdTRUE) {
+            oldest.frame->release();
+            countStorage(&storageStats.dropped);
+
+            if (xQueueSend(storageQueue, &job, 0) == pdTRUE) {
+                countStorage(&storageStats.queued);
+
+                return;
+            }
+        }
+        break;
+    }
+
+    case CAM_STORE_REDUCE_FPS:
+        if (storageStats.reduceLevel < CAM_STORE_MAX_REDUCE) {
+            setReduceLevel(storageStats.reduceLevel + 1);
+            countStorage(&storageStats.fpsReductions);
+        }
+        break;
+
+    case CAM_STORE_DROP_NEWEST:
+        break;
+    }
+
+    job.frame->release();
+    countStorage(&storageStats.dropped);
+}
+
+void CCamera::countStorage(uint32_t* counter)
+{
+    portENTER_CRITICAL(&storageLock);
+    (*counter)++;
+    portEXIT_CRITICAL(&storageLock);
+}
+
+void CCamera::setReduceLevel(uint8_t level)
+{
+    if (level == storageStats.reduceLevel) {
+        return;
+    }
+
+    //halve the frame rate for every level while the writer catches up
+    if (!storageStats.reduceLevel) {
+        baseInterval = scheduler.getInterval();
+    }
+    portENTER_CRITICAL(&storageLock);
+    storageStats.reduceLevel    = level;
+    portEXIT_CRITICAL(&storageLock);
+    emptyQueueCount             = 0;
+    if (allowTasks && baseInterval) {
+        scheduler.setInterval(baseInterval << level);
+    }
+
+    ESP_LOGI(CCAMERA_TAG, "setReduceLevel: Storage fps level [%u]", level);
+}
+
 void CCamera::setupLedFlash(int pin) 
 {
 #if CONFIG_LED_ILLUMINATOR_ENABLED
@@ -4,23 +4,116 @@
 #include "globals.h"
 #include "avi.h"
 #include "motion.h"
+#include "scheduler.h"
+#include "prebuffer.h"
+#include "frame.h"
+#include "framesource.h"
+#include "burst.h"
+#include "journal.h"
 
 //Task configuration
-#define TRIG_TASK_PRIO          10
-#define CAPT_TSK_PRIO           2
-#define MOTI_TSK_PRIO           1
-#define TASK_STACK_SIZE         4096
 #define TIMEOUT_TASK            250
+#define CAM_TRIGGER_QUEUE_SIZE  3
+
+//Storage queue configuration
+#define CAM_FB_COUNT_MIN        3 // capture, writer and one queued frame
+#define CAM_FB_COUNT_MAX        6 // capture, storage queue, writer, motion and stream can each hold a frame
+#define CAM_FB_PSRAM_SHARE      3 // frame buffers take at most 1 / this of the PSRAM, 3 on a 4 MB board
+#define CAM_STORE_RESTORE_FRAMES 30 // frames with an empty queue before a reduced fps is stepped back up
+#define CAM_STORE_MAX_REDUCE    3 // fps can be halved this many times
+
+//Sensor configuration, frame buffers are sized for CAM_MAX_FRAMESIZE so any smaller size can be switched to at runtime
+#define CAM_MAX_FRAMESIZE       FRAMESIZE_UXGA
+#define CAM_DEFAULT_QUALITY     10
+#define CAM_RECONFIG_DISCARD    2 // frames already in flight at the old size
+#define CAM_WATCH_FRAMESIZE     FRAMESIZE_QVGA // sensor size while waiting for motion in watch mode
+
+//Burst configuration
+#define CAM_BURST_MAX_FAILS     5 // empty frames from the source before a burst gives up
+#define CAM_BURST_JPEG_RATIO    5 // expected frame bytes are width * height / this, the driver sizes JPEG buffers the same way
+#define CAM_PAUSE_TIMEOUT       (TIMEOUT_TASK * 2) // ms to wait for capture to let go of the sensor
 
 //Return values
 #define CAM_RET_OK              0
 #define CAM_RET_INIT_FAIL       1
 #define CAM_RET_FB_INVALID      2
 #define CAM_RET_FILE_NOT_OPEN   3
+#define CAM_RET_INVALID         4
+#define CAM_RET_BUSY            5
+
+//Motion cell sidecar, [magic][cols][rows][mask u64] then [time ms u64][cells u64][CMotionBox] for every stored frame
+#define CAM_CELL_MAGIC          "CELL"
+#define CAM_CELL_EXT            ".cel"
 
 #define CAM_MAX_FRAMES          1000
 #define CAM_COUNT_DOWN          50
 
+//what to do with a frame when the storage queue is full
+typedef enum {
+    CAM_STORE_DROP_OLDEST,
+    CAM_STORE_DROP_NEWEST,
+    CAM_STORE_REDUCE_FPS
+} CStoragePolicy;
+
+typedef enum {
+    CAM_JOB_START,
+    CAM_JOB_FRAME,
+    CAM_JOB_CLOSE
+} CStorageJobType;
+
+typedef struct {
+    uint8_t     type;
+    uint8_t     frameSize;
+    uint64_t    time;           // ms since boot, recordings are named after it
+    CFrame*     frame;
+} CStorageJob;
+
+typedef struct {
+    uint8_t     policy;
+    uint8_t     reduceLevel;
+    uint32_t    queueDepth;
+    uint32_t    queueMax;
+    uint32_t    queued;
+    uint32_t    written;
+    uint32_t    dropped;
+    uint32_t    writeErrors;
+    uint32_t    fpsReductions;
+} CStorageStats;
+
+typedef struct {
+    uint8_t     enabled;
+    uint8_t     watchSize;
+    uint8_t     recordSize;
+    uint32_t    switches;
+    uint32_t    lastSwitchUs;   // time from the switch request to the first frame at the new size
+    uint32_t    maxSwitchUs;
+    uint32_t    watchChecks;
+    uint32_t    watchCheckUs;   // average motion check time at the watch size
+    uint32_t    recordChecks;
+    uint32_t    recordCheckUs;  // average motion check time at the record size
+    uint32_t    savedMs;        // estimated motion time saved by checking at the watch size
+} CWatchStats;
+
+typedef enum {
+    CAM_BURST_IDLE,
+    CAM_BURST_CAPTURE,
+    CAM_BURST_DRAIN
+} CBurstState;
+
+typedef struct {
+    uint8_t     state;
+    uint8_t     frameSize;
+    uint8_t     toAvi;
+    uint32_t    requested;
+    uint32_t    captured;
+    uint32_t    bytes;
+    uint32_t    budget;         // PSRAM arena taken for the burst
+    uint32_t    captureMs;
+    float       fps;            // achieved capture rate
+    uint32_t    drainMs;
+    uint32_t    drainErrors;
+} CBurstStats;
+
 class CCamera {
   public:
     CCamera();
@@ -28,33 +121,120 @@ class CCamera {
     
     int                 start();
     int                 stop();
-    int                 startFile(const char* fileName, uint32_t maxFrameCount);
+    int                 restart();
+    int                 startFile(const char* fileName, uint32_t maxFrameCount, framesize_t size = FRAMESIZE_INVALID);
     int                 closeFile();
     bool                isRecording();
     bool                isRunning();
     bool                getAllowMotion();
     void                setAllowMotion(bool allow);
-    void                setOnFrameCallback(bool (*cb)(camera_fb_t*));
+    void                setOnFrameCallback(bool (*cb)(CFrame*));
+    int                 setFPS(float fps);
+    int                 setTimeLapse(uint32_t intervalMs);
+    void                getSchedulerStats(CSchedulerStats* stats);
+    int                 setPreBuffer(uint32_t seconds, uint32_t byteBudget);
+    void                setStoragePolicy(CStoragePolicy policy);
+    void                getStorageStats(CStorageStats* stats);
+    int                 reconfigure(framesize_t size, int quality);
+    framesize_t         getFrameSize();
+    int                 getQuality();
+    uint32_t            getSwitchTime();
+    int                 setFrameSource(CFrameSource* source);
+    bool                isReplay();
+    int                 startBurst(uint32_t count, framesize_t size, bool toAvi);
+    bool                isBursting();
+    void                getBurstStats(CBurstStats* stats);
+    void                setMotionDecoder(CMotionDecoder decoder);
+    void                setMotionPrefilter(bool enable);
+    void                setMotionModel(CMotionModel model, uint8_t rateShift);
+    int                 setMotionGrid(const CMotionGrid* grid);
+    void                getMotionGrid(CMotionGrid* grid);
+    uint64_t            getMotionCells();
+    void                getMotionBox(CMotionBox* box);
+    void                setMotionAutoThreshold(bool enable);
+    void                setMotionIllumination(bool enable);
+    void                setMotionCascade(bool enable);
+    void                setMotionBands(uint8_t count);
+    void                setMotionDebug(bool enable);
+    void                getMotionStats(CMotionStats* stats);
+    int                 setWatchMode(bool enable, framesize_t watch, framesize_t record);
+    void                getWatchStats(CWatchStats* stats);
+    void                resetWatchStats();
+    void                getJournalInfo(CJournalInfo* info);
+    int                 findEvents(uint16_t fromBoot, uint64_t from, uint16_t toBoot, uint64_t to, uint32_t* first, uint32_t* count);
+    uint32_t            readEvents(uint32_t index, uint32_t count, CJournalRecord* out);
     
   private:
-    static void         cameraTriggerTask(void* vPtr);
     static void         cameraCaptureTask(void* vPtr);
+    static void         cameraStorageTask(void* vPtr);
     static void         cameraMotionTask(void* vPtr);
+    static void         cameraBurstTask(void* vPtr);
     
+    int                 startCamera();
+    int                 stopCamera();
+    int                 startSensor();
+    static uint8_t      frameBufferCount();
     void                setupLedFlash(int pin);
+    bool                postStorageJob(uint8_t type, uint64_t time);
+    void                queueStorageFrame(CFrame* frame);
+    void                setReduceLevel(uint8_t level);
+    void                countStorage(uint32_t* counter);
+    void                captureBurst();
+    bool                holdCapture();
+    void                drainBurst();
+    int                 applyConfig(framesize_t size, int quality);
+    void                openCellFile(const char* aviName);
+    void                writeCellRecord(CFrame* frame, uint64_t time);
+    int                 stopFile();
 
     CAVI                aviFile;
     CMotion             motion;
+    CFrameScheduler     scheduler;
+    CPreBuffer          preBuffer;
+    CMotionJournal      journal;
     bool                allowTasks;
     bool                allowMotion;
-    SemaphoreHandle_t   triggerTaskMutex;
+    float               frameRate;
+    uint32_t            timeLapse;
+    framesize_t         frameSize;
+    int                 jpegQuality;
+    uint32_t            discardFrames;
+    uint32_t            configGen;      // bumped with every frame size change, frames carry the one they were captured at
+    uint32_t            switchStart;
+    uint32_t            switchTime;
+    bool                watchMode;
+    framesize_t         watchSize;
+    framesize_t         recordSize;
+    CWatchStats         watchStats;
+    uint64_t            watchCheckTotal;
+    uint64_t            recordCheckTotal;
     SemaphoreHandle_t   captureTaskMutex;
+    SemaphoreHandle_t   storageTaskMutex;
     SemaphoreHandle_t   motionTaskMutex;
     SemaphoreHandle_t   syncTaskSemaphore;
-    SemaphoreHandle_t   triggerSemaphore;
+    SemaphoreHandle_t   configMutex;    // sensor settings, frame size and the config generation
+    SemaphoreHandle_t   motionMutex;    // motion parameters, held by the motion task for each check
+    SemaphoreHandle_t   runMutex;       // recursive, start and stop can come from main and comms at once
+    QueueHandle_t       triggerQueue;
     QueueHandle_t       motionQueue;
+    QueueHandle_t       storageQueue;   // holds every frame the pool has left once capture and the writer hold one
+    uint8_t             fbCount;
+    volatile bool       recording;
+    volatile bool       pauseCapture;   // set by a burst, capture stops touching the sensor
+    volatile bool       capturePaused;  // capture's answer, it is between frames and will stay there
     uint32_t            recordCountDown;
-    bool                (*onFrame)(camera_fb_t*);
+    CStoragePolicy      storagePolicy;
+    CStorageStats       storageStats;   // written by capture and storage, guarded by storageLock
+    portMUX_TYPE        storageLock;
+    uint64_t            baseInterval;
+    uint32_t            emptyQueueCount;
+    CFrameSource*       frameSource;
+    CBurstBuffer        burstBuffer;
+    CBurstStats         burstStats;
+    FILE*               cellFile;
+    CMotionGrid         cellGrid;       // copy of the motion grid for the storage task
+    portMUX_TYPE        cellLock;
+    bool                (*onFrame)(CFrame*);
 };
 
 extern CCamera Camera;
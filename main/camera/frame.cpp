@@ -0,0 +1,130 @@
+#include "frame.h"
+#include "currenttime.h"
+
+#define CFRAME_TAG "CFrame"
+
+static CFrame framePool[FRAME_POOL_SIZE];
+
+CFrame::CFrame()
+{
+    frameBuffer = NULL;
+    frameSource = NULL;
+    refCount    = 0;
+    motionCells = 0;
+    hasMotion   = false;
+    configGen   = 0;
+}
+
+CFrame* CFrame::acquire(camera_fb_t* fb, CFrameSource* source)
+{
+    if (!fb) {
+        return NULL;
+    }
+
+    // claim a free handle, the caller owns the first reference
+    for (uint32_t i = 0; i < FRAME_POOL_SIZE; i++) {
+        uint32_t expected = 0;
+        if (framePool[i].refCount.compare_exchange_strong(expected, 1)) {
+            framePool[i].frameBuffer = fb;
+            framePool[i].frameSource = source;
+            memset(framePool[i].stamps, 0, sizeof(framePool[i].stamps));
+            framePool[i].motionCells = 0;
+            framePool[i].hasMotion = false;
+            framePool[i].configGen = 0;
+
+            return &framePool[i];
+        }
+    }
+
+    ESP_LOGW(CFRAME_TAG, "acquire: No free frame handles");
+
+    return NULL;
+}
+
+CFrame* CFrame::addRef()
+{
+    refCount.fetch_add(1);
+
+    return this;
+}
+
+void CFrame::release()
+{
+    uint32_t refs = refCount.load();
+    while (true) {
+        // the last holder is the only one that can touch the count,
+        // so the handle is finished with before it is marked free
+        if (refs == 1) {
+            stamp(TRACE_RETURNED);
+            frameSource->release(frameBuffer);
+            LatencyTrace.record(stamps);
+            frameBuffer = NULL;
+            refCount.store(0);
+
+            return;
+        }
+
+        if (refCount.compare_exchange_weak(refs, refs - 1)) {
+            return;
+        }
+    }
+}
+
+void CFrame::stamp(uint8_t stage)
+{
+    stamps[stage] = CurrentTime.us();
+}
+
+void CFrame::stamp(uint8_t stage, uint32_t us)
+{
+    stamps[stage] = us;
+}
+
+// box and cells are written before hasMotion is set, so a reader that sees it set gets both from this frame
+void CFrame::setMotion(const CMotionBox* box, uint64_t cells)
+{
+    motionBox   = *box;
+    motionCells = cells;
+    hasMotion.store(true);
+}
+
+bool CFrame::getMotion(CMotionBox* box, uint64_t* cells)
+{
+    if (!hasMotion.load()) {
+        return false;
+    }
+    *box   = motionBox;
+    *cells = motionCells;
+
+    return true;
+}
+
+void CFrame::setGeneration(uint32_t gen)
+{
+    configGen = gen;
+}
+
+uint32_t CFrame::generation()
+{
+    return configGen;
+}
+
+camera_fb_t* CFrame::fb()
+{
+    return frameBuffer;
+}
+
+uint8_t* CFrame::buf()
+{
+    return frameBuffer->buf;
+}
+
+size_t CFrame::len()
+{
+    return frameBuffer->len;
+}
+
+uint32_t CFrame::refs()
+{
+    return refCount.load();
+}
@@ -0,0 +1,46 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <atomic>
+#include "globals.h"
+#include "trace.h"
+#include "framesource.h"
+#include "motion.h"
+
+#define FRAME_POOL_SIZE     8 // more than fb_count so every camera buffer can be wrapped
+
+// reference counted handle around a camera frame buffer, the buffer
+// is handed back to its source when the last reference is released
+class CFrame {
+public:
+    CFrame();
+
+    static CFrame*      acquire(camera_fb_t* fb, CFrameSource* source);
+    CFrame*             addRef();
+    void                release();
+
+    void                stamp(uint8_t stage);
+    void                stamp(uint8_t stage, uint32_t us);
+
+    void                setMotion(const CMotionBox* box, uint64_t cells);
+    bool                getMotion(CMotionBox* box, uint64_t* cells);
+    void                setGeneration(uint32_t gen);
+    uint32_t            generation();
+
+    camera_fb_t*        fb();
+    uint8_t*            buf();
+    size_t              len();
+    uint32_t            refs();
+
+private:
+    camera_fb_t*            frameBuffer;
+    CFrameSource*           frameSource;
+    std::atomic<uint32_t>   refCount;
+    uint32_t                stamps[TRACE_STAGE_COUNT];
+    CMotionBox              motionBox;
+    uint64_t                motionCells;
+    std::atomic<bool>       hasMotion;      // set once the motion task has compared this frame
+    uint32_t                configGen;      // camera config the frame was captured with
+};
+
+#endif
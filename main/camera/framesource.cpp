@@ -0,0 +1,397 @@
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include "esp_heap_caps.h"
+#include "framesource.h"
+
+#define CSRC_TAG "CFrameSource"
+
+const uint8_t   riffId[4]   = {0x52, 0x49, 0x46, 0x46}; // RIFF
+const uint8_t   listId[4]   = {0x4C, 0x49, 0x53, 0x54}; // LIST
+const uint8_t   moviId[4]   = {0x6D, 0x6F, 0x76, 0x69}; // movi
+const uint8_t   frameId[4]  = {0x30, 0x30, 0x64, 0x63}; // 00dc
+
+CSensorSource SensorSource;
+CReplaySource ReplaySource;
+
+int CSensorSource::start()
+{
+    return SRC_RET_OK;
+}
+
+void CSensorSource::stop()
+{
+}
+
+camera_fb_t* CSensorSource::get()
+{
+    return esp_camera_fb_get();
+}
+
+void CSensorSource::release(camera_fb_t* fb)
+{
+    esp_camera_fb_return(fb);
+}
+
+bool CSensorSource::isSensor()
+{
+    return true;
+}
+
+bool CSensorSource::getSize(uint16_t* width, uint16_t* height)
+{
+    return false;
+}
+
+CReplaySource::CReplaySource()
+{
+    sourcePath[0]   = 0;
+    isAvi           = false;
+    loop            = true;
+    running         = false;
+    dir             = NULL;
+    aviFile         = NULL;
+    moviStart       = 0;
+    moviEnd         = 0;
+    frameWidth      = 0;
+    frameHeight     = 0;
+    frameCount      = 0;
+    arena           = NULL;
+    slotLock        = portMUX_INITIALIZER_UNLOCKED;
+
+    memset(slots, 0, sizeof(slots));
+    memset(slotUsed, 0, sizeof(slotUsed));
+}
+
+CReplaySource::~CReplaySource()
+{
+    close();
+}
+
+int CReplaySource::open(const char* path, bool loopReplay)
+{
+    close();
+
+    if (!path || strlen(path) >= SRC_MAX_PATH) {
+        ESP_LOGE(CSRC_TAG, "open: Invalid path");
+
+        return SRC_RET_INVALID;
+    }
+
+    strcpy(sourcePath, path);
+    loop = loopReplay;
+
+    // a path ending in .avi is a recording, anything else is a directory of jpegs
+    size_t pathLen = strlen(path);
+    isAvi = pathLen > 4 && !strcasecmp(path + pathLen - 4, ".avi");
+    if (isAvi) {
+        aviFile = fopen(path, "r");
+        if (!aviFile || findMovi() != SRC_RET_OK) {
+            ESP_LOGE(CSRC_TAG, "open: Unable to read AVI [%s]", path);
+            close();
+
+            return SRC_RET_NOT_FOUND;
+        }
+    }
+    else {
+        dir = opendir(path);
+        if (!dir) {
+            ESP_LOGE(CSRC_TAG, "open: Unable to open directory [%s]", path);
+            close();
+
+            return SRC_RET_NOT_FOUND;
+        }
+    }
+
+    // every slot gets its own buffer so frames can be held while the next is read
+    arena = (uint8_t*)heap_caps_malloc(SRC_REPLAY_FRAME_SIZE * SRC_REPLAY_BUFFERS, MALLOC_CAP_SPIRAM);
+    if (!arena) {
+        ESP_LOGE(CSRC_TAG, "open: Unable to allocate replay buffers");
+        close();
+
+        return SRC_RET_ALLOC_ERROR;
+    }
+
+    for (uint32_t i = 0; i < SRC_REPLAY_BUFFERS; i++) {
+        slots[i].buf    = arena + SRC_REPLAY_FRAME_SIZE * i;
+        slots[i].format = PIXFORMAT_JPEG;
+        slotUsed[i]     = false;
+    }
+
+    // the first frame gives the replay size
+    size_t len = 0;
+    if (!readNext(arena, &len) || !jpegSize(arena, len, &frameWidth, &frameHeight) || !rewind()) {
+        ESP_LOGE(CSRC_TAG, "open: No readable frames in [%s]", path);
+        close();
+
+        return SRC_RET_NOT_FOUND;
+    }
+    frameCount = 0;
+
+    ESP_LOGI(CSRC_TAG, "open: Replaying %s [%s] %ux%u", isAvi ? "AVI" : "directory", path, frameWidth, frameHeight);
+
+    return SRC_RET_OK;
+}
+
+void CReplaySource::close()
+{
+    running = false;
+
+    if (dir) {
+        closedir(dir);
+        dir = NULL;
+    }
+
+    if (aviFile) {
+        fclose(aviFile);
+        aviFile = NULL;
+    }
+
+    if (arena) {
+        heap_caps_free(arena);
+        arena = NULL;
+    }
+
+    sourcePath[0]   = 0;
+    frameWidth      = 0;
+    frameHeight     = 0;
+}
+
+bool CReplaySource::isOpen()
+{
+    return arena != NULL;
+}
+
+uint32_t CReplaySource::replayed()
+{
+    return frameCount;
+}
+
+int CReplaySource::start()
+{
+    if (!isOpen()) {
+        return SRC_RET_NOT_OPEN;
+    }
+
+    portENTER_CRITICAL(&slotLock);
+    memset(slotUsed, 0, sizeof(slotUsed));
+    portEXIT_CRITICAL(&slotLock);
+
+    frameCount  = 0;
+    running     = rewind();
+
+    return running ? SRC_RET_OK : SRC_RET_NOT_FOUND;
+}
+
+void CReplaySource::stop()
+{
+    if (running) {
+        running = false;
+        ESP_LOGI(CSRC_TAG, "stop: Replayed %lu frames", frameCount);
+    }
+}
+
+camera_fb_t* CReplaySource::get()
+{
+    if (!running) {
+        return NULL;
+    }
+
+    // claim a free slot, like the driver a full pool means no frame this time
+    camera_fb_t* fb = NULL;
+    portENTER_CRITICAL(&slotLock);
+    for (uint32_t i = 0; i < SRC_REPLAY_BUFFERS; i++) {
+        if (!slotUsed[i]) {
+            slotUsed[i] = true;
+            fb = &slots[i];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&slotLock);
+
+    if (!fb) {
+        return NULL;
+    }
+
+    if (!readNext(fb->buf, &fb->len)) {
+        if (!loop || !rewind() || !readNext(fb->buf, &fb->len)) {
+            release(fb);
+            running = false;
+            ESP_LOGI(CSRC_TAG, "get: End of replay after %lu frames", frameCount);
+
+            return NULL;
+        }
+    }
+
+    fb->width   = frameWidth;
+    fb->height  = frameHeight;
+    gettimeofday(&fb->timestamp, NULL);
+    frameCount++;
+
+    return fb;
+}
+
+void CReplaySource::release(camera_fb_t* fb)
+{
+    portENTER_CRITICAL(&slotLock);
+    for (uint32_t i = 0; i < SRC_REPLAY_BUFFERS; i++) {
+        if (fb == &slots[i]) {
+            slotUsed[i] = false;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&slotLock);
+}
+
+bool CReplaySource::isSensor()
+{
+    return false;
+}
+
+bool CReplaySource::getSize(uint16_t* width, uint16_t* height)
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    *width  = frameWidth;
+    *height = frameHeight;
+
+    return true;
+}
+
+bool CReplaySource::readNext(uint8_t* buf, size_t* len)
+{
+    return isAvi ? readAviFrame(buf, len) : readJpeg(buf, len);
+}
+
+bool CReplaySource::readJpeg(uint8_t* buf, size_t* len)
+{
+    struct dirent* ep;
+    while ((ep = readdir(dir)) != NULL) {
+        size_t nameLen = strlen(ep->d_name);
+        if (ep->d_type == DT_DIR || nameLen < 5 || (strcasecmp(ep->d_name + nameLen - 4, ".jpg") && strcasecmp(ep->d_name + nameLen - 5, ".jpeg"))) {
+            continue;
+        }
+
+        char fileName[SRC_MAX_PATH * 2];
+        snprintf(fileName, sizeof(fileName), "%s/%s", sourcePath, ep->d_name);
+        FILE* f = fopen(fileName, "r");
+        if (!f) {
+            continue;
+        }
+
+        *len = fread(buf, 1, SRC_REPLAY_FRAME_SIZE, f);
+        bool tooLarge = !feof(f) && fgetc(f) != EOF;
+        fclose(f);
+
+        if (tooLarge) {
+            ESP_LOGW(CSRC_TAG, "readJpeg: Skipping [%s], larger than %u bytes", ep->d_name, SRC_REPLAY_FRAME_SIZE);
+            continue;
+        }
+
+        if (*len) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CReplaySource::readAviFrame(uint8_t* buf, size_t* len)
+{
+    uint8_t header[8];
+    while (ftell(aviFile) + 8 <= moviEnd && fread(header, 8, 1, aviFile) == 1) {
+        uint32_t chunkSize;
+        memcpy(&chunkSize, header + 4, 4);
+
+        // skip audio and anything else that is not a video frame
+        if (memcmp(header, frameId, 4) || chunkSize > SRC_REPLAY_FRAME_SIZE) {
+            fseek(aviFile, (chunkSize + 1) & ~1, SEEK_CUR);
+            continue;
+        }
+
+        if (fread(buf, chunkSize, 1, aviFile) != 1) {
+            return false;
+        }
+        *len = chunkSize;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool CReplaySource::rewind()
+{
+    if (isAvi) {
+        return aviFile && fseek(aviFile, moviStart, SEEK_SET) == 0;
+    }
+
+    if (!dir) {
+        return false;
+    }
+    rewinddir(dir);
+
+    return true;
+}
+
+int CReplaySource::findMovi()
+{
+    // RIFF header then walk the top level chunks to the movi list
+    uint8_t header[12];
+    if (fread(header, 12, 1, aviFile) != 1 || memcmp(header, riffId, 4)) {
+        return SRC_RET_INVALID;
+    }
+
+    while (fread(header, 8, 1, aviFile) == 1) {
+        uint32_t chunkSize;
+        memcpy(&chunkSize, header + 4, 4);
+
+        if (!memcmp(header, listId, 4)) {
+            if (fread(header + 8, 4, 1, aviFile) != 1) {
+                break;
+            }
+
+            if (!memcmp(header + 8, moviId, 4)) {
+                moviStart   = ftell(aviFile);
+                moviEnd     = moviStart + chunkSize - 4;
+
+                return SRC_RET_OK;
+            }
+            chunkSize -= 4;
+        }
+
+        fseek(aviFile, (chunkSize + 1) & ~1, SEEK_CUR);
+    }
+
+    return SRC_RET_NOT_FOUND;
+}
+
+bool CReplaySource::jpegSize(const uint8_t* buf, size_t len, uint16_t* width, uint16_t* height)
+{
+    // walk the marker segments to the start of frame
+    if (len < 4 || buf[0] != 0xFF || buf[1] != 0xD8) {
+        return false;
+    }
+
+    size_t pos = 2;
+    while (pos + 9 < len) {
+        if (buf[pos] != 0xFF) {
+            return false;
+        }
+
+        uint8_t marker = buf[pos + 1];
+        uint16_t segLen = (buf[pos + 2] << 8) | buf[pos + 3];
+        if (marker >= 0xC0 && marker <= 0xC2) {
+            *height = (buf[pos + 5] << 8) | buf[pos + 6];
+            *width  = (buf[pos + 7] << 8) | buf[pos + 8];
+
+            return true;
+        }
+
+        pos += 2 + segLen;
+    }
+
+    return false;
+}
@@ -0,0 +1,90 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <dirent.h>
+#include "globals.h"
+
+//Return values
+#define SRC_RET_OK              0
+#define SRC_RET_INVALID         1
+#define SRC_RET_NOT_FOUND       2
+#define SRC_RET_ALLOC_ERROR     3
+#define SRC_RET_NOT_OPEN        4
+
+#define SRC_REPLAY_BUFFERS      4 // replayed frames that can be held by the pipeline at once
+#define SRC_REPLAY_FRAME_SIZE   (256 * 1024) // largest jpeg that can be replayed
+#define SRC_MAX_PATH            256
+
+// where the capture task gets its frames from, every buffer handed out
+// by get() is given back to the same source through release()
+class CFrameSource {
+public:
+    virtual ~CFrameSource() {}
+
+    virtual int             start() = 0;
+    virtual void            stop() = 0;
+    virtual camera_fb_t*    get() = 0;
+    virtual void            release(camera_fb_t* fb) = 0;
+    virtual bool            isSensor() = 0;
+    virtual bool            getSize(uint16_t* width, uint16_t* height) = 0;
+};
+
+// the camera driver, the sensor itself is configured by CCamera
+class CSensorSource : public CFrameSource {
+public:
+    int             start();
+    void            stop();
+    camera_fb_t*    get();
+    void            release(camera_fb_t* fb);
+    bool            isSensor();
+    bool            getSize(uint16_t* width, uint16_t* height);
+};
+
+// replays a directory of jpegs or a recorded AVI from the SD card,
+// the rate is set by the frame scheduler like it is for the sensor
+class CReplaySource : public CFrameSource {
+public:
+    CReplaySource();
+    ~CReplaySource();
+
+    int             open(const char* path, bool loop);
+    void            close();
+    bool            isOpen();
+    uint32_t        replayed();
+
+    int             start();
+    void            stop();
+    camera_fb_t*    get();
+    void            release(camera_fb_t* fb);
+    bool            isSensor();
+    bool            getSize(uint16_t* width, uint16_t* height);
+
+private:
+    bool            readNext(uint8_t* buf, size_t* len);
+    bool            readJpeg(uint8_t* buf, size_t* len);
+    bool            readAviFrame(uint8_t* buf, size_t* len);
+    bool            rewind();
+    int             findMovi();
+    static bool     jpegSize(const uint8_t* buf, size_t len, uint16_t* width, uint16_t* height);
+
+    char            sourcePath[SRC_MAX_PATH];
+    bool            isAvi;
+    bool            loop;
+    bool            running;
+    DIR*            dir;
+    FILE*           aviFile;
+    long            moviStart;
+    long            moviEnd;
+    uint16_t        frameWidth;
+    uint16_t        frameHeight;
+    uint32_t        frameCount;
+    uint8_t*        arena;
+    camera_fb_t     slots[SRC_REPLAY_BUFFERS];
+    bool            slotUsed[SRC_REPLAY_BUFFERS];
+    portMUX_TYPE    slotLock;
+};
+
+extern CSensorSource SensorSource;
+extern CReplaySource ReplaySource;
+
+#endif
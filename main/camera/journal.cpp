@@ -0,0 +1,473 @@
+#include <string.h>
+#include <unistd.h>
+#include "journal.h"
+#include "currenttime.h"
+
+#define CJNL_TAG "CMotionJournal"
+
+static_assert(sizeof(CJournalRecord) == JNL_RECORD_SIZE, "journal record must be a fixed size");
+static_assert(sizeof(CJournalHeader) == JNL_RECORD_SIZE, "journal header takes the first record slot");
+
+CMotionJournal::CMotionJournal()
+{
+    file            = NULL;
+    sectorOffset    = 0;
+    sectorCount     = 0;
+    sectorWritten   = 0;
+    dirtyTime       = 0;
+    failTime        = 0;
+    writeFailed     = false;
+    boot            = 0;
+    eventOpen       = false;
+    recordName[0]   = 0;
+    memset(sector, 0, sizeof(sector));
+    memset(&event, 0, sizeof(CJournalRecord));
+    lock            = xSemaphoreCreateMutex();
+}
+
+CMotionJournal::~CMotionJournal()
+{
+    close();
+
+    if (lock) {
+        vSemaphoreDelete(lock);
+    }
+}
+
+int CMotionJournal::open(const char* fileName)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    if (file) {
+        xSemaphoreGive(lock);
+
+        return JNL_RET_OK;
+    }
+
+    file = fopen(fileName, "r+b");
+    if (!file) {
+        file = fopen(fileName, "w+b");
+    }
+    if (!file) {
+        ESP_LOGE(CJNL_TAG, "open: Unable to open [%s]", fileName);
+        xSemaphoreGive(lock);
+
+        return JNL_RET_OPEN_FAIL;
+    }
+
+    // a sector torn by a power cut is dropped, the next write starts over it
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    size -= size % JNL_SECTOR_SIZE;
+
+    // the records of another version can not be searched with these, that journal is started over
+    CJournalHeader header;
+    if (size > 0) {
+        fseek(file, 0, SEEK_SET);
+        if (fread(&header, sizeof(CJournalHeader), 1, file) == 1 && !memcmp(header.magic, JNL_MAGIC, 4) && header.version != JNL_VERSION) {
+            ESP_LOGW(CJNL_TAG, "open: [%s] is version %u, starting a new journal", fileName, header.version);
+            fclose(file);
+            file = fopen(fileName, "w+b");
+            size = 0;
+            if (!file) {
+                ESP_LOGE(CJNL_TAG, "open: Unable to open [%s]", fileName);
+                xSemaphoreGive(lock);
+
+                return JNL_RET_OPEN_FAIL;
+            }
+        }
+    }
+
+    memset(sector, 0, sizeof(sector));
+    if (size <= 0) {
+        memset(&header, 0, sizeof(CJournalHeader));
+        memcpy(header.magic, JNL_MAGIC, 4);
+        header.version      = JNL_VERSION;
+        header.recordSize   = JNL_RECORD_SIZE;
+        memcpy(sector, &header, sizeof(CJournalHeader));
+
+        sectorOffset    = 0;
+        sectorCount     = 1;
+        sectorWritten   = 0;
+        boot            = 1;
+    }
+    else {
+        fseek(file, 0, SEEK_SET);
+        if (fread(&header, sizeof(CJournalHeader), 1, file) != 1 || memcmp(header.magic, JNL_MAGIC, 4) || header.recordSize != JNL_RECORD_SIZE) {
+            ESP_LOGE(CJNL_TAG, "open: [%s] is not a journal", fileName);
+            fclose(file);
+            file = NULL;
+            xSemaphoreGive(lock);
+
+            return JNL_RET_INVALID;
+        }
+
+        // the last sector is the only one that can have free slots
+        sectorOffset = size - JNL_SECTOR_SIZE;
+        fseek(file, sectorOffset, SEEK_SET);
+        if (fread(sector, JNL_SECTOR_SIZE, 1, file) != 1) {
+            ESP_LOGE(CJNL_TAG, "open: Unable to read [%s]", fileName);
+            fclose(file);
+            file = NULL;
+            xSemaphoreGive(lock);
+
+            return JNL_RET_OPEN_FAIL;
+        }
+
+        sectorCount = 0;
+        while (sectorCount < JNL_SECTOR_RECORDS && sector[sectorCount * JNL_RECORD_SIZE] != JNL_EVENT_NONE) {
+            sectorCount++;
+        }
+        sectorWritten = sectorCount;
+
+        // the last slot in use is the header in a journal without records
+        boot = 1;
+        if (sectorCount && sectorOffset / JNL_RECORD_SIZE + sectorCount > 1) {
+            CJournalRecord last;
+            memcpy(&last, sector + (sectorCount - 1) * JNL_RECORD_SIZE, sizeof(CJournalRecord));
+            boot = last.boot + 1;
+        }
+    }
+
+    eventOpen   = false;
+    writeFailed = false;
+    if (sectorWritten != sectorCount) {
+        dirtyTime = CurrentTime.ms();
+        writeSectors(true);
+    }
+    nextSector();
+
+    uint32_t records = recordCount();
+    xSemaphoreGive(lock);
+
+    ESP_LOGI(CJNL_TAG, "open: [%s] boot %u, %lu records", fileName, boot, records);
+
+    return JNL_RET_OK;
+}
+
+void CMotionJournal::close()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    if (file) {
+        if (sectorWritten != sectorCount) {
+            writeSectors(true);
+        }
+        fclose(file);
+        file = NULL;
+
+        ESP_LOGI(CJNL_TAG, "close: Journal closed");
+    }
+    eventOpen = false;
+
+    xSemaphoreGive(lock);
+}
+
+bool CMotionJournal::isOpen()
+{
+    return file != NULL;
+}
+
+void CMotionJournal::startEvent(uint64_t time)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    memset(&event, 0, sizeof(CJournalRecord));
+    event.type  = JNL_EVENT_START;
+    event.boot  = boot;
+    event.start = time;
+    strcpy(event.file, recordName);
+    eventOpen   = true;
+
+    append(&event);
+
+    xSemaphoreGive(lock);
+}
+
+void CMotionJournal::updateEvent(uint32_t changed, uint64_t cells, uint8_t light)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    if (eventOpen) {
+        event.frames++;
+        event.cells |= cells;
+        if (changed >= event.peak) {
+            event.peak  = changed;
+            event.light = light;
+        }
+    }
+
+    xSemaphoreGive(lock);
+}
+
+void CMotionJournal::stopEvent(uint64_t time)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    if (eventOpen) {
+        event.type  = JNL_EVENT_STOP;
+        event.stop  = time;
+        eventOpen   = false;
+
+        append(&event);
+
+        ESP_LOGI(CJNL_TAG, "stopEvent: %lu ms, peak %lu, cells %08lx%08lx [%s]", (uint32_t)(event.stop - event.start), event.peak, (uint32_t)(event.cells >> 32), (uint32_t)event.cells, event.file);
+    }
+
+    xSemaphoreGive(lock);
+}
+
+bool CMotionJournal::inEvent()
+{
+    return eventOpen;
+}
+
+void CMotionJournal::setFile(const char* fileName)
+{
+    // only the name is kept, every recording is in the root of the card
+    const char* name = fileName ? strrchr(fileName, '/') : NULL;
+    name = name ? name + 1 : (fileName ? fileName : "");
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    strncpy(recordName, name, JNL_FILE_LEN - 1);
+    recordName[JNL_FILE_LEN - 1] = 0;
+
+    // a recording opened after the start belongs to the event
+    if (eventOpen && !event.file[0]) {
+        strcpy(event.file, recordName);
+    }
+
+    xSemaphoreGive(lock);
+}
+
+int CMotionJournal::flush()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    int ret = JNL_RET_OK;
+    if (!file) {
+        ret = JNL_RET_NOT_OPEN;
+    }
+    else if (sectorWritten != sectorCount) {
+        ret = writeSectors(true);
+    }
+
+    xSemaphoreGive(lock);
+
+    return ret;
+}
+
+void CMotionJournal::poll(uint32_t time)
+{
+    // every card write happens here on the storage task, the motion task only fills the RAM sectors.
+    // A full sector goes out on the next poll, a part filled one once it has waited JNL_FLUSH_MS,
+    // which puts a bound on how many records a power cut can lose
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    if (file && sectorWritten != sectorCount && (!writeFailed || time - failTime >= JNL_RETRY_MS)) {
+        bool aged = time - dirtyTime >= JNL_FLUSH_MS;
+        if (aged || sectorCount >= JNL_SECTOR_RECORDS) {
+            writeFailed = writeSectors(aged) != JNL_RET_OK;
+            failTime    = time;
+        }
+    }
+
+    xSemaphoreGive(lock);
+}
+
+void CMotionJournal::getInfo(CJournalInfo* info)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    info->boot      = boot;
+    info->now       = CurrentTime.ms64();
+    info->records   = file ? recordCount() : 0;
+    info->unflushed = sectorCount - sectorWritten;
+
+    xSemaphoreGive(lock);
+}
+
+int CMotionJournal::search(uint16_t fromBoot, uint64_t from, uint16_t toBoot, uint64_t to, uint32_t* first, uint32_t* count)
+{
+    // records are in time order, so both ends of the range are a binary search over the file
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    if (!file) {
+        xSemaphoreGive(lock);
+
+        return JNL_RET_NOT_OPEN;
+    }
+
+    if (toBoot < fromBoot || (toBoot == fromBoot && to < from)) {
+        xSemaphoreGive(lock);
+
+        return JNL_RET_INVALID;
+    }
+
+    uint32_t start  = lowerBound(fromBoot, from, false);
+    uint32_t end    = lowerBound(toBoot, to, true);
+    *first = start;
+    *count = end - start;
+
+    xSemaphoreGive(lock);
+
+    ESP_LOGI(CJNL_TAG, "search: %u:%llu to %u:%llu, first %lu count %lu", fromBoot, from, toBoot, to, *first, *count);
+
+    return JNL_RET_OK;
+}
+
+uint32_t CMotionJournal::read(uint32_t index, uint32_t count, CJournalRecord* out)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    uint32_t records = file ? recordCount() : 0;
+    if (index >= records) {
+        xSemaphoreGive(lock);
+
+        return 0;
+    }
+    if (count > records - index) {
+        count = records - index;
+    }
+
+    // everything before the RAM sector is one contiguous read, slot 0 is the header
+    uint32_t slot       = index + 1;
+    uint32_t firstRam   = sectorOffset / JNL_RECORD_SIZE;
+    uint32_t done       = 0;
+    if (slot < firstRam) {
+        uint32_t onCard = firstRam - slot < count ? firstRam - slot : count;
+        fseek(file, slot * JNL_RECORD_SIZE, SEEK_SET);
+        done = fread(out, JNL_RECORD_SIZE, onCard, file);
+        if (done != onCard) {
+            ESP_LOGW(CJNL_TAG, "read: Short read at [%lu]", index + done);
+            xSemaphoreGive(lock);
+
+            return done;
+        }
+    }
+    if (done < count) {
+        memcpy(out + done, sector + (slot + done - firstRam) * JNL_RECORD_SIZE, (count - done) * JNL_RECORD_SIZE);
+        done = count;
+    }
+
+    xSemaphoreGive(lock);
+
+    return done;
+}
+
+int CMotionJournal::append(const CJournalRecord* record)
+{
+    if (!file) {
+        return JNL_RET_NOT_OPEN;
+    }
+
+    // nothing is written here, the record is dropped only when the storage task has fallen a whole sector behind
+    if (sectorCount == JNL_RAM_RECORDS) {
+        ESP_LOGW(CJNL_TAG, "append: RAM sectors full, record dropped");
+
+        return JNL_RET_WRITE_FAIL;
+    }
+
+    if (sectorWritten == sectorCount) {
+        dirtyTime = CurrentTime.ms();
+    }
+    memcpy(sector + sectorCount * JNL_RECORD_SIZE, record, JNL_RECORD_SIZE);
+    sectorCount++;
+
+    return JNL_RET_OK;
+}
+
+int CMotionJournal::writeSectors(bool partial)
+{
+    // always whole sectors, free slots are zero so they read back as JNL_EVENT_NONE
+    uint8_t last = partial ? sectorCount : sectorCount - sectorCount % JNL_SECTOR_RECORDS;
+    if (last <= sectorWritten) {
+        return JNL_RET_OK;
+    }
+
+    uint8_t first   = sectorWritten / JNL_SECTOR_RECORDS;
+    uint8_t sectors = (last + JNL_SECTOR_RECORDS - 1) / JNL_SECTOR_RECORDS - first;
+    uint32_t offset = sectorOffset + first * JNL_SECTOR_SIZE;
+    if (fseek(file, offset, SEEK_SET) || fwrite(sector + first * JNL_SECTOR_SIZE, JNL_SECTOR_SIZE, sectors, file) != sectors) {
+        ESP_LOGW(CJNL_TAG, "writeSectors: Write failed at [%lu]", offset);
+
+        return JNL_RET_WRITE_FAIL;
+    }
+    fflush(file);
+    fsync(fileno(file));
+    sectorWritten = last;
+
+    ESP_LOGD(CJNL_TAG, "writeSectors: [%lu] %u sectors, %u records", offset, sectors, last);
+
+    nextSector();
+
+    return JNL_RET_OK;
+}
+
+void CMotionJournal::nextSector()
+{
+    // a full sector that is on the card leaves RAM, the one behind it moves up
+    while (sectorCount >= JNL_SECTOR_RECORDS && sectorWritten >= JNL_SECTOR_RECORDS) {
+        memmove(sector, sector + JNL_SECTOR_SIZE, sizeof(sector) - JNL_SECTOR_SIZE);
+        memset(sector + sizeof(sector) - JNL_SECTOR_SIZE, 0, JNL_SECTOR_SIZE);
+        sectorOffset    += JNL_SECTOR_SIZE;
+        sectorCount     -= JNL_SECTOR_RECORDS;
+        sectorWritten   -= JNL_SECTOR_RECORDS;
+    }
+}
+
+uint32_t CMotionJournal::recordCount()
+{
+    return sectorOffset / JNL_RECORD_SIZE + sectorCount - 1;
+}
+
+bool CMotionJournal::readRecord(uint32_t slot, CJournalRecord* out)
+{
+    if (slot >= sectorOffset / JNL_RECORD_SIZE) {
+        memcpy(out, sector + (slot - sectorOffset / JNL_RECORD_SIZE) * JNL_RECORD_SIZE, JNL_RECORD_SIZE);
+
+        return true;
+    }
+
+    fseek(file, slot * JNL_RECORD_SIZE, SEEK_SET);
+
+    return fread(out, JNL_RECORD_SIZE, 1, file) == 1;
+}
+
+uint32_t CMotionJournal::lowerBound(uint16_t boot, uint64_t time, bool after)
+{
+    // first record at or after boot:time, or strictly after it
+    uint32_t low    = 0;
+    uint32_t high   = recordCount();
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        CJournalRecord record;
+        if (!readRecord(mid + 1, &record)) {
+            ESP_LOGW(CJNL_TAG, "lowerBound: Unable to read [%lu]", mid);
+
+            return low;
+        }
+
+        int order = compare(&record, boot, time);
+        if (order < 0 || (after && !order)) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+int CMotionJournal::compare(const CJournalRecord* record, uint16_t boot, uint64_t time)
+{
+    // a record sits in the file at the time it was written
+    uint64_t recordTime = record->type == JNL_EVENT_STOP ? record->stop : record->start;
+    if (record->boot != boot) {
+        return record->boot < boot ? -1 : 1;
+    }
+
+    return recordTime < time ? -1 : (recordTime > time ? 1 : 0);
+}
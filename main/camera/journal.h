@@ -0,0 +1,100 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "globals.h"
+
+//Return values
+#define JNL_RET_OK              0
+#define JNL_RET_OPEN_FAIL       1
+#define JNL_RET_NOT_OPEN        2
+#define JNL_RET_WRITE_FAIL      3
+#define JNL_RET_INVALID         4
+
+//Journal file, [header record] then one record per motion start and stop, in the order they happened
+#define JNL_FILE_NAME           "/sdcard/motion.jnl"
+#define JNL_MAGIC               "MJNL"
+#define JNL_VERSION             2     // a journal of another version is started over
+#define JNL_SECTOR_SIZE         512
+#define JNL_RECORD_SIZE         64
+#define JNL_SECTOR_RECORDS      (JNL_SECTOR_SIZE / JNL_RECORD_SIZE)
+#define JNL_RAM_SECTORS         2     // a full sector waits here for the storage task while the next one fills
+#define JNL_RAM_RECORDS         (JNL_SECTOR_RECORDS * JNL_RAM_SECTORS)
+#define JNL_FILE_LEN            28
+#define JNL_FLUSH_MS            60000 // a part filled sector is written out after this long
+#define JNL_RETRY_MS            1000  // a full sector the card would not take is tried again after this long
+
+//Record types, a part filled sector is padded with JNL_EVENT_NONE
+#define JNL_EVENT_NONE          0
+#define JNL_EVENT_START         1
+#define JNL_EVENT_STOP          2
+
+typedef struct {
+    uint8_t     type;
+    uint8_t     light;          // light level % of the frame with the most change
+    uint16_t    boot;           // counts up every time the journal is opened, times are ms since that boot
+    uint32_t    frames;         // frames checked during the event
+    uint64_t    start;          // ms the motion started, 64 bit so the order holds past 49 days of uptime
+    uint64_t    stop;           // ms the motion stopped, 0 in a start record
+    uint64_t    cells;          // every grid cell that changed during the event
+    uint32_t    peak;           // most changed pixels in one frame, scaled to the frame
+    char        file[JNL_FILE_LEN]; // recording the event went into, empty if nothing was recorded
+} CJournalRecord;
+
+typedef struct {
+    char        magic[4];
+    uint16_t    version;
+    uint16_t    recordSize;
+    uint8_t     reserved[JNL_RECORD_SIZE - 8];
+} CJournalHeader;
+
+typedef struct {
+    uint16_t    boot;
+    uint64_t    now;            // ms since boot, lets a client turn record times into wall time
+    uint32_t    records;
+    uint32_t    unflushed;      // records still in the RAM sector
+} CJournalInfo;
+
+class CMotionJournal {
+public:
+    CMotionJournal();
+    ~CMotionJournal();
+
+    int         open(const char* fileName);
+    void        close();
+    bool        isOpen();
+    void        startEvent(uint64_t time);
+    void        updateEvent(uint32_t changed, uint64_t cells, uint8_t light);
+    void        stopEvent(uint64_t time);
+    bool        inEvent();
+    void        setFile(const char* file);
+    int         flush();
+    void        poll(uint32_t time);
+    void        getInfo(CJournalInfo* info);
+    int         search(uint16_t fromBoot, uint64_t from, uint16_t toBoot, uint64_t to, uint32_t* first, uint32_t* count);
+    uint32_t    read(uint32_t index, uint32_t count, CJournalRecord* out);
+
+private:
+    int         append(const CJournalRecord* record);
+    int         writeSectors(bool partial);
+    void        nextSector();
+    uint32_t    recordCount();
+    bool        readRecord(uint32_t slot, CJournalRecord* out);
+    uint32_t    lowerBound(uint16_t boot, uint64_t time, bool after);
+    static int  compare(const CJournalRecord* record, uint16_t boot, uint64_t time);
+
+    FILE*           file;
+    uint8_t         sector[JNL_SECTOR_SIZE * JNL_RAM_SECTORS];
+    uint32_t        sectorOffset;   // file offset of the first sector held in RAM
+    uint8_t         sectorCount;    // slots used in them
+    uint8_t         sectorWritten;  // slots of them already on the card
+    uint32_t        dirtyTime;
+    uint32_t        failTime;
+    bool            writeFailed;
+    uint16_t        boot;
+    CJournalRecord  event;
+    bool            eventOpen;
+    char            recordName[JNL_FILE_LEN];
+    SemaphoreHandle_t lock;
+};
+
+#endif
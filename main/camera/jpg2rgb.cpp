@@ -11,9 +11,21 @@ bool _rgb_write(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8
             // write start
             jpeg->width = w;
             jpeg->height = h;
+            if (jpeg->row_end > h) {
+                jpeg->row_end = h;
+            }
+            if (jpeg->row_start > jpeg->row_end) {
+                jpeg->row_start = jpeg->row_end;
+            }
+            // caller owned output must hold the window
+            if (jpeg->output) {
+                if ((size_t)w * (jpeg->row_end - jpeg->row_start) + jpeg->data_offset > jpeg->output_size) {
+                    return false;
+                }
+            }
             // if output is null, this is BMP
-            if (!jpeg->output) {
-                jpeg->output = (uint8_t*)malloc((w * h) + jpeg->data_offset);
+            else {
+                jpeg->output = (uint8_t*)malloc((w * (jpeg->row_end - jpeg->row_start)) + jpeg->data_offset);
                 if (!jpeg->output) {
                     return false;
                 }
@@ -22,40 +34,40 @@ bool _rgb_write(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8
         return true;
     }
 
-    /*uint32_t jw = jpeg->width*RGB888_BYTES;
-    uint32_t t = y * jw;
-    uint32_t b = t + (h * jw);
-    uint32_t l = x * RGB888_BYTES;
-    uint8_t *out = jpeg->output+jpeg->data_offset;
-    uint8_t *o = out;
-    uint32_t iy, ix;
-    w *= RGB888_BYTES;
-
-    for (iy=t; iy<b; iy+=jw) {
-        o = out+(iy+l)/RGB888_BYTES;
-        for (ix=0; ix<w; ix+=RGB888_BYTES) {
-            uint16_t grayscale = (data[ix+2]+data[ix+1]+data[ix])/RGB888_BYTES;
-            o[ix/RGB888_BYTES] = (uint8_t)grayscale;
-        }
-        data+=w;
-    }*/
+    // blocks arrive in row order, past the window there is nothing left to do
+    if (y >= jpeg->row_end) {
+        jpeg->done = true;
+
+        return false;
+    }
+
+    // block entirely above the window
+    if (y + h <= jpeg->row_start) {
+        return true;
+    }
+
+    // clip the block to the window rows
+    uint16_t top = y < jpeg->row_start ? jpeg->row_start : y;
+    uint16_t bottom = y + h > jpeg->row_end ? jpeg->row_end : y + h;
+    data += (top - y) * w * RGB888_BYTES;
 
-    uint32_t pixelCnt = w * h;
-    uint8_t* outBuf = jpeg->output + jpeg->data_offset + (jpeg->width * y) + x;
-    uint8_t* inBuf = data;
+    for (uint16_t row = top; row < bottom; row++) {
+        uint8_t* outBuf = jpeg->output + jpeg->data_offset + (jpeg->width * (row - jpeg->row_start)) + x;
+        uint32_t pixelCnt = w;
 
-    while (pixelCnt--) {
-        uint32_t pixel = *inBuf;
-        inBuf++;
+        while (pixelCnt--) {
+            uint32_t pixel = *data;
+            data++;
 
-        pixel += *inBuf;
-        inBuf++;
+            pixel += *data;
+            data++;
 
-        pixel += *inBuf;
-        inBuf++;
+            pixel += *data;
+            data++;
 
-        *outBuf = pixel / 3;
-        outBuf++;
+            *outBuf = pixel / 3;
+            outBuf++;
+        }
     }
 
   return true;
@@ -68,16 +80,43 @@ size_t _jpg_read(void* arg, size_t index, uint8_t* buf, size_t len) {
   return len;
 }
 
-bool jpg2rgb(const uint8_t *src, uint32_t src_len, uint8_t **out, jpg_scale_t scale)
+bool jpg2rgb(const uint8_t *src, uint32_t src_len, uint8_t *out, size_t outSize, jpg_scale_t scale, uint16_t rowStart, uint16_t rowEnd, uint16_t* outWidth, uint16_t* outRows)
+{
+  rgb_jpg_decoder jpeg;
+  jpeg.width        = 0;
+  jpeg.height       = 0;
+  jpeg.input        = src;
+  jpeg.output       = out;
+  jpeg.output_size  = outSize;
+  jpeg.data_offset  = 0;
+  jpeg.row_start    = rowStart;
+  jpeg.row_end      = rowEnd;
+  jpeg.done         = false;
+  esp_err_t res     = esp_jpg_decode(src_len, scale, _jpg_read, _rgb_write, (void*)&jpeg);
+  if (outWidth) {
+    *outWidth = jpeg.width;
+  }
+  if (outRows) {
+    *outRows = jpeg.row_end - jpeg.row_start;
+  }
+
+  return (res == ESP_OK || jpeg.done) ? true : false;
+}
+
+bool jpg2rgb(const uint8_t *src, uint32_t src_len, uint8_t **out, jpg_scale_t scale, uint16_t rowStart, uint16_t rowEnd)
 {
   rgb_jpg_decoder jpeg;
   jpeg.width        = 0;
   jpeg.height       = 0;
   jpeg.input        = src;
   jpeg.output       = NULL; 
+  jpeg.output_size  = 0;
   jpeg.data_offset  = 0;
+  jpeg.row_start    = rowStart;
+  jpeg.row_end      = rowEnd;
+  jpeg.done         = false;
   esp_err_t res     = esp_jpg_decode(src_len, scale, _jpg_read, _rgb_write, (void*)&jpeg);
   *out              = jpeg.output;
 
-  return (res == ESP_OK) ? true : false;
+  return (res == ESP_OK || jpeg.done) ? true : false;
 }
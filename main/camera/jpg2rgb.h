@@ -4,15 +4,26 @@
 #include "globals.h"
 
 #define RGB888_BYTES 3 // number of bytes per pixel
+#define JPG_ROW_ALL  0xFFFF
 
 typedef struct {
   uint16_t        width;
   uint16_t        height;
   uint16_t        data_offset;
+  uint16_t        row_start;  // first output row kept
+  uint16_t        row_end;    // output rows from here on are not needed
+  bool            done;       // decode stopped early once row_end was reached
+  size_t          output_size;
   const uint8_t*  input;
   uint8_t*        output;
 } rgb_jpg_decoder;
 
-bool jpg2rgb(const uint8_t* src, uint32_t src_len, uint8_t** out, jpg_scale_t scale);
+// decodes to 8 bit grayscale, only rows [rowStart, rowEnd) of the scaled image are
+// converted and stored and decoding stops at rowEnd, out holds (rowEnd - rowStart) rows
+bool jpg2rgb(const uint8_t* src, uint32_t src_len, uint8_t** out, jpg_scale_t scale, uint16_t rowStart = 0, uint16_t rowEnd = JPG_ROW_ALL);
+
+// as above into a caller owned buffer, fails if the window does not fit in outSize. The window is
+// clamped to the image, outWidth and outRows give what was actually written
+bool jpg2rgb(const uint8_t* src, uint32_t src_len, uint8_t* out, size_t outSize, jpg_scale_t scale, uint16_t rowStart = 0, uint16_t rowEnd = JPG_ROW_ALL, uint16_t* outWidth = NULL, uint16_t* outRows = NULL);
 
 #endif
@@ -0,0 +1,699 @@
+#include <math.h>
+#include <string.h>
+#include "jpgluma.h"
+
+#define CJPL_TAG "CJpegLuma"
+
+#define IDCT_BITS       12
+
+// position in the 8x8 block of each coefficient in zigzag order
+static const uint8_t zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// c(u) * cos((2x + 1) * u * pi / 16) scaled by 1 << IDCT_BITS
+static int32_t idctTable[8][8];
+static bool idctReady = false;
+
+CJpegLuma::CJpegLuma()
+{
+    memset(huff, 0, sizeof(huff));
+    memset(comps, 0, sizeof(comps));
+    compCnt     = 0;
+    scanCnt     = 0;
+    imgWidth    = 0;
+    imgHeight   = 0;
+    outWidth    = 0;
+    outHeight   = 0;
+    outBuf      = NULL;
+    coefOut     = NULL;
+
+    if (!idctReady) {
+        for (uint32_t x = 0; x < 8; x++) {
+            for (uint32_t u = 0; u < 8; u++) {
+                double c = u ? 1.0 : M_SQRT1_2;
+                idctTable[x][u] = (int32_t)lround(c * cos((2 * x + 1) * u * M_PI / 16) * (1 << IDCT_BITS));
+            }
+        }
+        idctReady = true;
+    }
+}
+
+int CJpegLuma::decode(const uint8_t* src, uint32_t len, uint8_t* out, uint32_t outSize, jpg_scale_t scale, uint16_t rowStart, uint16_t rowEnd)
+{
+    coefOut = NULL;
+    int ret = begin(src, len, scale, rowStart, rowEnd);
+    if (ret != JPL_RET_OK) {
+        return ret;
+    }
+
+    if ((uint32_t)outWidth * (rowLast - rowFirst) > outSize) {
+        ESP_LOGW(CJPL_TAG, "decode: Output needs %u bytes", outWidth * (rowLast - rowFirst));
+
+        return JPL_RET_BUFFER_SIZE;
+    }
+    outBuf = out;
+
+    return decodeScan();
+}
+
+int CJpegLuma::decodeCoefs(const uint8_t* src, uint32_t len, CJpegCoefs* coefs, jpg_scale_t scale, uint16_t rowStart, uint16_t rowEnd)
+{
+    coefOut = NULL;
+    int ret = begin(src, len, scale, rowStart, rowEnd);
+    if (ret != JPL_RET_OK) {
+        return ret;
+    }
+
+    coefs->entryCnt = 0;
+    coefs->blockCnt = 0;
+    coefs->width    = outWidth;
+    coefs->rowFirst = rowFirst;
+    coefs->rowLast  = rowLast;
+    coefs->scale    = scaleShift;
+    coefOut         = coefs;
+    ret             = decodeScan();
+    coefOut         = NULL;
+
+    return ret;
+}
+
+int CJpegLuma::outputCoefs(const CJpegCoefs* coefs, uint8_t* out, uint32_t outSize, uint16_t rowStart, uint16_t rowEnd)
+{
+    // only the IDCT and scaling, the blocks were entropy decoded by decodeCoefs()
+    scaleShift  = coefs->scale;
+    outWidth    = coefs->width;
+    rowFirst    = rowStart > coefs->rowFirst ? rowStart : coefs->rowFirst;
+    rowLast     = rowEnd < coefs->rowLast ? rowEnd : coefs->rowLast;
+    if (rowFirst > rowLast) {
+        rowFirst = rowLast;
+    }
+
+    if ((uint32_t)outWidth * (rowLast - rowFirst) > outSize) {
+        ESP_LOGW(CJPL_TAG, "outputCoefs: Output needs %u bytes", outWidth * (rowLast - rowFirst));
+
+        return JPL_RET_BUFFER_SIZE;
+    }
+    outBuf = out;
+
+    uint32_t blockRows = 8 >> scaleShift;
+    bool dcOnly = JPL_DC_ONLY && scaleShift == JPG_SCALE_8X;
+    int32_t coef[64];
+    uint32_t entry = 0;
+    for (uint32_t i = 0; i < coefs->blockCnt; i++) {
+        uint32_t blockX = coefs->blocks[i] & 0xFFFF;
+        uint32_t blockY = coefs->blocks[i] >> 16;
+        uint32_t top    = blockY * blockRows;
+        if (top + blockRows > rowFirst && top < rowLast) {
+            if (dcOnly) {
+                outputDC((int32_t)(coefs->entries[entry] << 8) >> 8, blockX, blockY);
+            }
+            else {
+                memset(coef, 0, sizeof(coef));
+                for (uint32_t e = entry; e < coefs->blockEnd[i]; e++) {
+                    coef[coefs->entries[e] >> 24] = (int32_t)(coefs->entries[e] << 8) >> 8;
+                }
+                outputBlock(coef, blockX, blockY);
+            }
+        }
+        entry = coefs->blockEnd[i];
+    }
+
+    return JPL_RET_OK;
+}
+
+int CJpegLuma::begin(const uint8_t* src, uint32_t len, jpg_scale_t scale, uint16_t rowStart, uint16_t rowEnd)
+{
+    data        = src;
+    dataLen     = len;
+    pos         = 0;
+    bitBuf      = 0;
+    bitCnt      = 0;
+    hitMarker   = false;
+    scaleShift  = scale;
+
+    if (scale > JPG_SCALE_8X) {
+        return JPL_RET_UNSUPPORTED;
+    }
+
+    int ret = parseHeaders();
+    if (ret != JPL_RET_OK) {
+        return ret;
+    }
+
+    outWidth    = imgWidth >> scaleShift;
+    outHeight   = imgHeight >> scaleShift;
+    rowFirst    = rowStart < outHeight ? rowStart : outHeight;
+    rowLast     = rowEnd < outHeight ? rowEnd : outHeight;
+    if (rowFirst > rowLast) {
+        rowFirst = rowLast;
+    }
+
+    return JPL_RET_OK;
+}
+
+uint16_t CJpegLuma::width()
+{
+    return outWidth;
+}
+
+uint16_t CJpegLuma::height()
+{
+    return rowLast - rowFirst;
+}
+
+int CJpegLuma::parseHeaders()
+{
+    if (dataLen < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return JPL_RET_CORRUPT;
+    }
+
+    compCnt         = 0;
+    restartInterval = 0;
+    for (uint32_t i = 0; i < JPL_MAX_HUFF; i++) {
+        huff[i].valid = false;
+    }
+
+    // walk the marker segments up to the start of scan
+    pos = 2;
+    while (pos + 4 <= dataLen) {
+        if (data[pos] != 0xFF) {
+            return JPL_RET_CORRUPT;
+        }
+
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+
+        uint16_t segLen = (data[pos + 2] << 8) | data[pos + 3];
+        if (segLen < 2 || pos + 2 + segLen > dataLen) {
+            return JPL_RET_CORRUPT;
+        }
+
+        const uint8_t* seg = data + pos + 4;
+        uint16_t payload = segLen - 2;
+        pos += 2 + segLen;
+
+        int ret = JPL_RET_OK;
+        switch (marker) {
+        case 0xC0:  // baseline
+        case 0xC1:  // extended sequential, huffman
+            ret = parseFrame(seg, payload);
+            break;
+
+        case 0xC2:  // progressive
+        case 0xC3:
+        case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB:
+        case 0xCD: case 0xCE: case 0xCF:
+            return JPL_RET_UNSUPPORTED;
+
+        case 0xC4:
+            ret = parseHuff(seg, payload);
+            break;
+
+        case 0xDB:
+            ret = parseQuant(seg, payload);
+            break;
+
+        case 0xDD:
+            if (payload < 2) {
+                return JPL_RET_CORRUPT;
+            }
+            restartInterval = (seg[0] << 8) | seg[1];
+            break;
+
+        case 0xDA:
+            return compCnt ? parseScan(seg, payload) : JPL_RET_CORRUPT;
+
+        default:
+            break;
+        }
+
+        if (ret != JPL_RET_OK) {
+            return ret;
+        }
+    }
+
+    return JPL_RET_CORRUPT;
+}
+
+int CJpegLuma::parseQuant(const uint8_t* seg, uint16_t len)
+{
+    while (len) {
+        uint8_t precision   = seg[0] >> 4;
+        uint8_t id          = seg[0] & 0x0F;
+        uint16_t tableLen   = precision ? 129 : 65;
+        if (id > 3 || len < tableLen) {
+            return JPL_RET_CORRUPT;
+        }
+
+        for (uint32_t i = 0; i < 64; i++) {
+            quant[id][i] = precision ? (seg[1 + i * 2] << 8) | seg[2 + i * 2] : seg[1 + i];
+        }
+
+        seg += tableLen;
+        len -= tableLen;
+    }
+
+    return JPL_RET_OK;
+}
+
+int CJpegLuma::parseHuff(const uint8_t* seg, uint16_t len)
+{
+    while (len >= 17) {
+        uint8_t tableClass  = seg[0] >> 4;
+        uint8_t id          = seg[0] & 0x0F;
+        if (tableClass > 1 || id > 1) {
+            return JPL_RET_UNSUPPORTED;
+        }
+
+        CJpegHuff* table = &huff[tableClass * 2 + id];
+        uint32_t total = 0;
+        table->bits[0] = 0;
+        for (uint32_t i = 1; i <= 16; i++) {
+            table->bits[i] = seg[i];
+            total += seg[i];
+        }
+        if (total > 256 || len < 17 + total) {
+            return JPL_RET_CORRUPT;
+        }
+        memcpy(table->values, seg + 17, total);
+
+        // canonical codes, plus a lookup table for everything up to 8 bits
+        memset(table->lookup, 0, sizeof(table->lookup));
+        uint32_t code = 0;
+        uint32_t index = 0;
+        for (uint32_t l = 1; l <= 16; l++) {
+            table->valPtr[l]    = index;
+            table->minCode[l]   = code;
+            for (uint32_t i = 0; i < table->bits[l]; i++, code++, index++) {
+                if (l <= 8) {
+                    uint32_t shift = 8 - l;
+                    for (uint32_t fill = 0; fill < (1U << shift); fill++) {
+                        table->lookup[(code << shift) | fill] = (l << 8) | table->values[index];
+                    }
+                }
+            }
+            table->maxCode[l] = table->bits[l] ? (int32_t)code - 1 : -1;
+            code <<= 1;
+        }
+        table->maxCode[17]  = 0x7FFFFFFF;
+        table->valid        = true;
+
+        seg += 17 + total;
+        len -= 17 + total;
+    }
+
+    return JPL_RET_OK;
+}
+
+int CJpegLuma::parseFrame(const uint8_t* seg, uint16_t len)
+{
+    if (len < 6 || seg[0] != 8) {
+        return JPL_RET_UNSUPPORTED;
+    }
+
+    imgHeight   = (seg[1] << 8) | seg[2];
+    imgWidth    = (seg[3] << 8) | seg[4];
+    compCnt     = seg[5];
+    if (!imgWidth || !imgHeight || !compCnt || compCnt > JPL_MAX_COMPONENTS || len < 6 + compCnt * 3) {
+        return JPL_RET_UNSUPPORTED;
+    }
+
+    hMax = 1;
+    vMax = 1;
+    for (uint32_t i = 0; i < compCnt; i++) {
+        comps[i].id     = seg[6 + i * 3];
+        comps[i].h      = seg[7 + i * 3] >> 4;
+        comps[i].v      = seg[7 + i * 3] & 0x0F;
+        comps[i].quant  = seg[8 + i * 3] & 0x03;
+        if (!comps[i].h || !comps[i].v || comps[i].h > 2 || comps[i].v > 2) {
+            return JPL_RET_UNSUPPORTED;
+        }
+        if (comps[i].h > hMax) hMax = comps[i].h;
+        if (comps[i].v > vMax) vMax = comps[i].v;
+    }
+
+    return JPL_RET_OK;
+}
+
+int CJpegLuma::parseScan(const uint8_t* seg, uint16_t len)
+{
+    scanCnt = seg[0];
+    if (!scanCnt || scanCnt > compCnt || len < 4 + scanCnt * 2) {
+        return JPL_RET_CORRUPT;
+    }
+
+    for (uint32_t i = 0; i < scanCnt; i++) {
+        uint8_t id = seg[1 + i * 2];
+        uint32_t c = 0;
+        while (c < compCnt && comps[c].id != id) c++;
+        if (c == compCnt) {
+            return JPL_RET_CORRUPT;
+        }
+
+        comps[c].dcTable    = seg[2 + i * 2] >> 4;
+        comps[c].acTable    = seg[2 + i * 2] & 0x0F;
+        comps[c].pred       = 0;
+        if (comps[c].dcTable > 1 || comps[c].acTable > 1 || !huff[comps[c].dcTable].valid || !huff[2 + comps[c].acTable].valid) {
+            return JPL_RET_CORRUPT;
+        }
+        scanComps[i] = c;
+    }
+
+    // only a scan carrying Y is decoded, a Y only scan must cover the full luma resolution
+    if (scanComps[0] != 0 || (scanCnt != compCnt && (scanCnt != 1 || comps[0].h != hMax || comps[0].v != vMax))) {
+        return JPL_RET_UNSUPPORTED;
+    }
+
+    return JPL_RET_OK;
+}
+
+int CJpegLuma::decodeScan()
+{
+    // a single component scan is one block per MCU
+    bool interleaved = scanCnt > 1;
+    uint32_t mcuW   = interleaved ? 8 * hMax : 8;
+    uint32_t mcuH   = interleaved ? 8 * vMax : 8;
+    uint32_t mcusX  = (imgWidth + mcuW - 1) / mcuW;
+    uint32_t mcusY  = (imgHeight + mcuH - 1) / mcuH;
+    uint8_t lumaH   = interleaved ? comps[0].h : 1;
+    uint8_t lumaV   = interleaved ? comps[0].v : 1;
+    uint32_t blockRows = 8 >> scaleShift;
+    bool dcOnly = JPL_DC_ONLY && scaleShift == JPG_SCALE_8X;
+
+    int32_t coef[64];
+    uint32_t restartsLeft = restartInterval;
+
+    for (uint32_t my = 0; my < mcusY; my++) {
+        // everything from here down is below the window
+        if (((my * mcuH) >> scaleShift) >= rowLast) {
+            break;
+        }
+
+        for (uint32_t mx = 0; mx < mcusX; mx++) {
+            if (restartInterval) {
+                if (!restartsLeft) {
+                    if (!restart()) {
+                        return JPL_RET_CORRUPT;
+                    }
+                    restartsLeft = restartInterval;
+                }
+                restartsLeft--;
+            }
+
+            for (uint32_t s = 0; s < scanCnt; s++) {
+                CJpegComponent* comp = &comps[scanComps[s]];
+                uint32_t blocksH = interleaved ? comp->h : 1;
+                uint32_t blocksV = interleaved ? comp->v : 1;
+
+                for (uint32_t v = 0; v < blocksV; v++) {
+                    for (uint32_t h = 0; h < blocksH; h++) {
+                        // chroma and luma outside the window are decoded only to keep the bitstream in step
+                        uint32_t blockY = my * lumaV + v;
+                        uint32_t top = blockY * blockRows;
+                        bool keep = scanComps[s] == 0 && top + blockRows > rowFirst && top < rowLast;
+
+                        if (decodeBlock(comp, keep && !dcOnly ? coef : NULL) != JPL_RET_OK) {
+                            return JPL_RET_CORRUPT;
+                        }
+
+                        if (keep && coefOut) {
+                            if (!storeBlock(dcOnly ? NULL : coef, comp->pred * quant[comp->quant][0], mx * lumaH + h, blockY)) {
+                                return JPL_RET_BUFFER_SIZE;
+                            }
+                        }
+                        else if (keep && dcOnly) {
+                            outputDC(comp->pred * quant[comp->quant][0], mx * lumaH + h, blockY);
+                        }
+                        else if (keep) {
+                            outputBlock(coef, mx * lumaH + h, blockY);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return JPL_RET_OK;
+}
+
+int CJpegLuma::decodeBlock(CJpegComponent* comp, int32_t* coef)
+{
+    const CJpegHuff* dc = &huff[comp->dcTable];
+    const CJpegHuff* ac = &huff[2 + comp->acTable];
+    const uint16_t* q   = quant[comp->quant];
+
+    int s = decodeHuff(dc);
+    if (s < 0 || s > 11) {
+        return JPL_RET_CORRUPT;
+    }
+    comp->pred += s ? getBits(s) : 0;
+
+    if (coef) {
+        memset(coef, 0, 64 * sizeof(int32_t));
+        coef[0] = comp->pred * q[0];
+    }
+
+    for (uint32_t k = 1; k < 64; k++) {
+        int rs = decodeHuff(ac);
+        if (rs < 0) {
+            return JPL_RET_CORRUPT;
+        }
+
+        uint8_t r = rs >> 4;
+        s = rs & 0x0F;
+        if (!s) {
+            if (r != 15) {
+                break; // end of block
+            }
+            k += 15;
+            continue;
+        }
+
+        k += r;
+        if (k > 63) {
+            return JPL_RET_CORRUPT;
+        }
+
+        // blocks that are not output only need their bits stepped over
+        if (coef) {
+            coef[zigzag[k]] = getBits(s) * q[k];
+        }
+        else {
+            skipBits(s);
+        }
+    }
+
+    return JPL_RET_OK;
+}
+
+int CJpegLuma::decodeHuff(const CJpegHuff* table)
+{
+    fillBits(16);
+
+    uint16_t entry = table->lookup[bitBuf >> 24];
+    if (entry) {
+        uint8_t l = entry >> 8;
+        bitBuf <<= l;
+        bitCnt -= l;
+
+        return entry & 0xFF;
+    }
+
+    for (uint32_t l = 9; l <= 16; l++) {
+        int32_t code = bitBuf >> (32 - l);
+        if (code <= table->maxCode[l]) {
+            bitBuf <<= l;
+            bitCnt -= l;
+
+            return table->values[table->valPtr[l] + code - table->minCode[l]];
+        }
+    }
+
+    return -1;
+}
+
+int32_t CJpegLuma::getBits(uint8_t count)
+{
+    fillBits(count);
+
+    uint32_t value = bitBuf >> (32 - count);
+    bitBuf <<= count;
+    bitCnt -= count;
+
+    // values with a leading zero are negative
+    if (value < (1U << (count - 1))) {
+        return (int32_t)value - (int32_t)((1U << count) - 1);
+    }
+
+    return value;
+}
+
+void CJpegLuma::skipBits(uint8_t count)
+{
+    fillBits(count);
+
+    bitBuf <<= count;
+    bitCnt -= count;
+}
+
+bool CJpegLuma::fillBits(uint8_t count)
+{
+    while (bitCnt < count) {
+        uint8_t b = 0;
+
+        // past a marker or the end of the data the decoder is fed zeros
+        if (!hitMarker && pos < dataLen) {
+            b = data[pos];
+            if (b == 0xFF) {
+                uint8_t next = pos + 1 < dataLen ? data[pos + 1] : 0xD9;
+                if (next == 0x00) {
+                    pos += 2;
+                }
+                else {
+                    hitMarker = true;
+                    b = 0;
+                }
+            }
+            else {
+                pos++;
+            }
+        }
+
+        bitBuf |= (uint32_t)b << (24 - bitCnt);
+        bitCnt += 8;
+    }
+
+    return !hitMarker;
+}
+
+bool CJpegLuma::restart()
+{
+    // drop the padding bits and step over the RSTn marker
+    bitBuf      = 0;
+    bitCnt      = 0;
+    hitMarker   = false;
+
+    if (pos + 1 >= dataLen || data[pos] != 0xFF || data[pos + 1] < 0xD0 || data[pos + 1] > 0xD7) {
+        return false;
+    }
+    pos += 2;
+
+    for (uint32_t i = 0; i < compCnt; i++) {
+        comps[i].pred = 0;
+    }
+
+    return true;
+}
+
+bool CJpegLuma::storeBlock(const int32_t* coef, int32_t dc, uint32_t blockX, uint32_t blockY)
+{
+    // only the non zero coefficients are kept, most blocks have a handful. Without coef only the DC
+    if (blockX * (8 >> scaleShift) >= outWidth) {
+        return true;
+    }
+    if (coefOut->blockCnt >= coefOut->blockCap) {
+        return false;
+    }
+
+    uint32_t n = coefOut->entryCnt;
+    if (!coef) {
+        if (n >= coefOut->entryCap) {
+            return false;
+        }
+        coefOut->entries[n++] = dc & 0xFFFFFF;
+    }
+    else {
+        for (uint32_t i = 0; i < 64; i++) {
+            if (coef[i]) {
+                if (n >= coefOut->entryCap) {
+                    return false;
+                }
+                coefOut->entries[n++] = (i << 24) | (coef[i] & 0xFFFFFF);
+            }
+        }
+    }
+
+    coefOut->blocks[coefOut->blockCnt]      = (blockY << 16) | blockX;
+    coefOut->blockEnd[coefOut->blockCnt]    = n;
+    coefOut->blockCnt++;
+    coefOut->entryCnt                       = n;
+
+    return true;
+}
+
+void CJpegLuma::outputDC(int32_t dc, uint32_t blockX, uint32_t blockY)
+{
+    // the block average is the dequantised DC / 8
+    if (blockY < rowFirst || blockY >= rowLast || blockX >= outWidth) {
+        return;
+    }
+
+    int32_t pixel = ((dc + 4) >> 3) + 128;
+    outBuf[(blockY - rowFirst) * outWidth + blockX] = pixel < 0 ? 0 : (pixel > 255 ? 255 : pixel);
+}
+
+void CJpegLuma::outputBlock(const int32_t* coef, uint32_t blockX, uint32_t blockY)
+{
+    // separable inverse DCT, rows then columns, in fixed point
+    int32_t tmp[64];
+    int32_t pix[64];
+    for (uint32_t v = 0; v < 8; v++) {
+        const int32_t* in = coef + v * 8;
+        for (uint32_t x = 0; x < 8; x++) {
+            int32_t sum = 0;
+            for (uint32_t u = 0; u < 8; u++) {
+                sum += idctTable[x][u] * in[u];
+            }
+            tmp[v * 8 + x] = sum >> (IDCT_BITS - 1);
+        }
+    }
+
+    for (uint32_t x = 0; x < 8; x++) {
+        for (uint32_t y = 0; y < 8; y++) {
+            int32_t sum = 0;
+            for (uint32_t v = 0; v < 8; v++) {
+                sum += idctTable[y][v] * tmp[v * 8 + x];
+            }
+            sum = ((sum + (1 << (IDCT_BITS + 2))) >> (IDCT_BITS + 3)) + 128;
+            pix[y * 8 + x] = sum < 0 ? 0 : (sum > 255 ? 255 : sum);
+        }
+    }
+
+    // average down to the output scale with shifts, then clip to the window
+    uint32_t step = 1 << scaleShift;
+    uint32_t size = 8 >> scaleShift;
+    for (uint32_t oy = 0; oy < size; oy++) {
+        uint32_t row = blockY * size + oy;
+        if (row < rowFirst || row >= rowLast) {
+            continue;
+        }
+
+        uint8_t* out = outBuf + (row - rowFirst) * outWidth;
+        for (uint32_t ox = 0; ox < size; ox++) {
+            uint32_t col = blockX * size + ox;
+            if (col >= outWidth) {
+                break;
+            }
+
+            int32_t sum = 0;
+            for (uint32_t iy = 0; iy < step; iy++) {
+                for (uint32_t ix = 0; ix < step; ix++) {
+                    sum += pix[(oy * step + iy) * 8 + ox * step + ix];
+                }
+            }
+            out[col] = sum >> (2 * scaleShift);
+        }
+    }
+}
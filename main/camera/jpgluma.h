@@ -0,0 +1,119 @@
+#ifndef JPGLUMA_H
+#define JPGLUMA_H
+
+#include "globals.h"
+
+//Return values
+#define JPL_RET_OK              0
+#define JPL_RET_UNSUPPORTED     1 // not a baseline huffman jpeg, fall back to esp_jpg_decode
+#define JPL_RET_CORRUPT         2
+#define JPL_RET_BUFFER_SIZE     3
+
+#define JPL_MAX_COMPONENTS      3
+#define JPL_MAX_HUFF            4 // 2 DC and 2 AC tables for baseline
+#define JPL_ROW_ALL             0xFFFF
+
+//At 1/8 scale each Y block's DC term is the output pixel, skip the AC values and IDCT
+#ifndef JPL_DC_ONLY
+#define JPL_DC_ONLY             1
+#endif
+
+typedef struct {
+    uint8_t     bits[17];       // number of codes of each length
+    uint8_t     values[256];
+    int32_t     maxCode[18];    // largest code of each length, -1 if none
+    int32_t     valPtr[17];     // index into values of the first code of each length
+    uint16_t    minCode[17];
+    uint16_t    lookup[256];    // (length << 8) | value for codes up to 8 bits, 0 if longer
+    bool        valid;
+} CJpegHuff;
+
+//Luma blocks of one window entropy decoded once by decodeCoefs(), any number of outputCoefs()
+//calls then turn their own rows into pixels. Arrays are caller owned
+typedef struct {
+    uint32_t*   entries;        // (position in the block << 24) | dequantised value, 24 bit signed
+    uint32_t    entryCap;
+    uint32_t    entryCnt;
+    uint32_t*   blocks;         // (blockY << 16) | blockX of every kept block, in bitstream order
+    uint32_t*   blockEnd;       // one past the block's last entry
+    uint32_t    blockCap;
+    uint32_t    blockCnt;
+    uint16_t    width;          // of the scaled image
+    uint16_t    rowFirst;       // scaled rows the blocks were kept for, [rowFirst, rowLast)
+    uint16_t    rowLast;
+    uint8_t     scale;
+} CJpegCoefs;
+
+typedef struct {
+    uint8_t     id;
+    uint8_t     h;
+    uint8_t     v;
+    uint8_t     quant;
+    uint8_t     dcTable;
+    uint8_t     acTable;
+    int32_t     pred;
+} CJpegComponent;
+
+// baseline jpeg decoder that only reconstructs the Y channel, chroma blocks are
+// entropy decoded to stay in step but never dequantised or transformed. Output
+// is 8 bit grayscale scaled by 1 << scale into a caller owned buffer, rows
+// [rowStart, rowEnd) of the scaled image are written and decoding stops at rowEnd.
+// The entropy decode can only run in bitstream order, so a split decode runs decodeCoefs()
+// once and gives each task its own instance to run outputCoefs() over its band
+class CJpegLuma {
+public:
+    CJpegLuma();
+
+    int         decode(const uint8_t* src, uint32_t len, uint8_t* out, uint32_t outSize, jpg_scale_t scale, uint16_t rowStart = 0, uint16_t rowEnd = JPL_ROW_ALL);
+    int         decodeCoefs(const uint8_t* src, uint32_t len, CJpegCoefs* coefs, jpg_scale_t scale, uint16_t rowStart = 0, uint16_t rowEnd = JPL_ROW_ALL);
+    int         outputCoefs(const CJpegCoefs* coefs, uint8_t* out, uint32_t outSize, uint16_t rowStart, uint16_t rowEnd);
+    uint16_t    width();
+    uint16_t    height();
+
+private:
+    int         begin(const uint8_t* src, uint32_t len, jpg_scale_t scale, uint16_t rowStart, uint16_t rowEnd);
+    int         parseHeaders();
+    int         parseQuant(const uint8_t* seg, uint16_t len);
+    int         parseHuff(const uint8_t* seg, uint16_t len);
+    int         parseFrame(const uint8_t* seg, uint16_t len);
+    int         parseScan(const uint8_t* seg, uint16_t len);
+    int         decodeScan();
+    int         decodeBlock(CJpegComponent* comp, int32_t* coef);
+    int         decodeHuff(const CJpegHuff* huff);
+    int32_t     getBits(uint8_t count);
+    void        skipBits(uint8_t count);
+    bool        fillBits(uint8_t count);
+    bool        restart();
+    bool        storeBlock(const int32_t* coef, int32_t dc, uint32_t blockX, uint32_t blockY);
+    void        outputBlock(const int32_t* coef, uint32_t blockX, uint32_t blockY);
+    void        outputDC(int32_t dc, uint32_t blockX, uint32_t blockY);
+
+    const uint8_t*  data;
+    uint32_t        dataLen;
+    uint32_t        pos;
+    uint32_t        bitBuf;
+    uint8_t         bitCnt;
+    bool            hitMarker;
+
+    uint16_t        quant[4][64];   // zigzag order
+    CJpegHuff       huff[JPL_MAX_HUFF];
+    CJpegComponent  comps[JPL_MAX_COMPONENTS];
+    uint8_t         compCnt;
+    uint8_t         scanComps[JPL_MAX_COMPONENTS];
+    uint8_t         scanCnt;
+    uint8_t         hMax;
+    uint8_t         vMax;
+    uint16_t        restartInterval;
+    uint16_t        imgWidth;
+    uint16_t        imgHeight;
+
+    uint8_t*        outBuf;
+    CJpegCoefs*     coefOut;        // decodeCoefs() keeps the blocks here instead of writing pixels
+    uint16_t        outWidth;
+    uint16_t        outHeight;
+    uint16_t        rowFirst;
+    uint16_t        rowLast;
+    uint8_t         scaleShift;
+};
+
+#endif
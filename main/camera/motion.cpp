@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <math.h>
+#include <assert.h>
 #include <string.h>
 #include "motion.h"
 #include "jpg2rgb.h"
@@ -7,6 +8,31 @@
 
 #define CMOT_TAG "CMotion"
 
+#ifdef MOTION_HEAP_AUDIT
+#ifndef CONFIG_HEAP_USE_HOOKS
+#error "MOTION_HEAP_AUDIT needs CONFIG_HEAP_USE_HOOKS"
+#endif
+
+// the heap calls these on every malloc and free, only count the ones
+// made by the task that is inside checkMotion
+static volatile TaskHandle_t    auditTask   = NULL;
+static volatile uint32_t        auditOps    = 0;
+
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps)
+{
+    if (auditTask && xTaskGetCurrentTaskHandle() == auditTask) {
+        auditOps++;
+    }
+}
+
+extern "C" void IRAM_ATTR esp_heap_trace_free_hook(void* ptr)
+{
+    if (auditTask && xTaskGetCurrentTaskHandle() == auditTask) {
+        auditOps++;
+    }
+}
+#endif
+
 CMotion::CMotion()
 {
     detectMotionFrames      = 5; // min sequence of changed frames to confirm motion 
@@ -21,7 +47,6 @@ CMotion::CMotion()
     lightLevel              = 0; // Current ambient light level 
     nightSwitch             = 20; // initial white level % for night/day switching
     motionVal               = 8.0; // initial motion sensitivity setting
-    jpgImgSize              = 0;
 
     scaleFactor             = 1;
     sampleRate              = 1;
@@ -30,31 +55,450 @@ CMotion::CMotion()
 
     dbgMotion               = false;
     motionStatus            = false;
+    prevValid               = false;
 
     motionCnt               = 0;
-    lastImgLen              = 0;
 
     nightTime               = false;
     nightCnt                = 0;
 
-    changeMap               = (uint8_t*)malloc(MAX_IMAGE_SIZE);
-    prevBuf                 = (uint8_t*)malloc(MAX_IMAGE_SIZE);
-    jpgImg                  = (uint8_t*)malloc(MAX_IMAGE_SIZE);
+    prevBuf                 = NULL;
+    lumaBuf                 = NULL;
+    changeBits              = NULL;
+    background              = NULL;
+    deviation               = NULL;
+    bufPixels               = 0;
+    bufWidth                = 0;
+    bufCoarse               = 0;
+
+    changeMap               = NULL;
+    mapCells                = 0;
+    mapWhole                = true;
+    mapSeq                  = 0;
+    mapPixels               = 0;
+    mapWidth                = 0;
+    mapGray                 = NULL;
+    jpgBuf[0]               = NULL;
+    jpgBuf[1]               = NULL;
+    jpgLen[0]               = 0;
+    jpgLen[1]               = 0;
+    jpgFront                = 0;
+    jpgSeq                  = 0;
+    jpgImg                  = NULL;
+    jpgImgCap               = 0;
+    jpgWritten              = 0;
+    jpgOverflow             = false;
+    mapMutex                = xSemaphoreCreateMutex();
+    fetchMutex              = xSemaphoreCreateMutex();
+
+    decoder                 = MOT_DECODE_LUMA;
+    prefilterOn             = false;
+    model                   = MOT_MODEL_FRAME;
+    rateShift               = MOT_BG_RATE_SHIFT;
+
+    // a single cell covering the region of interest behaves as before the grid
+    memset(&grid, 0, sizeof(grid));
+    grid.cols               = 1;
+    grid.rows               = 1;
+    grid.mask               = 1;
+    cells                   = 0;
+
+    colCount                = NULL;
+    rowCount                = NULL;
+    spanBits                = NULL;
+    memset(&box, 0, sizeof(box));
+    boxLock                 = portMUX_INITIALIZER_UNLOCKED;
+
+    autoOn                  = false;
+    manualThreshold         = detectChangeThreshold;
+    movePercent             = 11 - motionVal;
+    autoFrames              = 0;
+    autoBusy                = 0;
+    illumOn                 = true;
+
+    cascadeOn               = false;
+    coarseCur               = NULL;
+    coarseRef               = NULL;
+    coarseBits              = NULL;
+    coarseValid             = false;
+    coarseRun               = 0;
+
+    bandLimit               = BAND_MAX_WORKERS;
+    bandCount               = 0;
+    bandCols                = NULL;
+    memset(&bandCoefs, 0, sizeof(CJpegCoefs));
+    bandStartRow            = 0;
+    bandWidth               = 0;
+    benchRun                = 0;
+    resetStats();
+    sizeBuffers();
 }
 
 CMotion::~CMotion()
 {
-    if(changeMap) {
-        free(changeMap);
+    freeBuffers();
+
+    if (mapMutex) {
+        vSemaphoreDelete(mapMutex);
+    }
+
+    if (fetchMutex) {
+        vSemaphoreDelete(fetchMutex);
+    }
+}
+
+void CMotion::getRegion(uint32_t* sampleWidth, uint16_t* startRow, uint16_t* endRow)
+{
+    // only the horizontal bands of interest are decoded, decoding stops after the last one
+    uint32_t downsize       = (1 << scaleFactor) * sampleRate;
+    uint32_t sampleHeight   = frameHeight / downsize;
+
+    *sampleWidth    = frameWidth / downsize;
+    *startRow       = sampleHeight * (detectStartBand - 1) / detectNumBands;
+    *endRow         = sampleHeight * detectEndBand / detectNumBands;
+}
+
+void CMotion::getCoarseRegion(uint32_t* width, uint16_t* startRow, uint16_t* endRow)
+{
+    // the same bands at 1/8, one pixel per 8x8 block
+    uint32_t height = frameHeight >> JPG_SCALE_8X;
+
+    *width      = frameWidth >> JPG_SCALE_8X;
+    *startRow   = height * (detectStartBand - 1) / detectNumBands;
+    *endRow     = height * detectEndBand / detectNumBands;
+}
+
+bool CMotion::useCascade()
+{
+    // a region of interest already decoded at 1/8 has nothing cheaper to go first
+    return cascadeOn && scaleFactor < JPG_SCALE_8X;
+}
+
+bool CMotion::sizeBuffers()
+{
+    uint32_t sampleWidth;
+    uint16_t startRow, endRow;
+    getRegion(&sampleWidth, &startRow, &endRow);
+
+    uint32_t coarseWidth;
+    uint16_t coarseStart, coarseEnd;
+    getCoarseRegion(&coarseWidth, &coarseStart, &coarseEnd);
+
+    uint32_t pixels = sampleWidth * (endRow - startRow);
+    uint32_t coarse = useCascade() ? coarseWidth * (coarseEnd - coarseStart) : 0;
+    if (pixels == bufPixels && sampleWidth == bufWidth && coarse == bufCoarse) {
+        return true;
+    }
+
+    // every buffer is sized for the region of interest here, checkMotion never allocates
+    freeBuffers();
+    if (!pixels || pixels > MAX_IMAGE_SIZE) {
+        ESP_LOGE(CMOT_TAG, "sizeBuffers: Invalid region of interest [%lu] pixels", pixels);
+
+        return false;
+    }
+
+    lumaBuf     = (uint8_t*)malloc(pixels);
+    // span change bits of every band follow the image change bits, each band starts its bits on a
+    // byte so it needs up to one more. The projections, a column set per band, share one block
+    uint32_t bitBytes   = (pixels + 7) / 8 + BAND_MAX_WORKERS;
+    changeBits  = (uint8_t*)malloc(bitBytes + (sampleWidth + 7) / 8 * BAND_MAX_WORKERS);
+    colCount    = (uint16_t*)malloc((sampleWidth * BAND_MAX_WORKERS + endRow - startRow) * sizeof(uint16_t));
+    bool ok     = lumaBuf && changeBits && colCount;
+    if (ok) {
+        spanBits    = changeBits + bitBytes;
+        rowCount    = colCount + sampleWidth;
+        bandCols    = rowCount + endRow - startRow;
+    }
+
+    // the reference is either the previous frame or the background model
+    if (ok && model == MOT_MODEL_FRAME) {
+        prevBuf     = (uint8_t*)malloc(pixels);
+        ok          = prevBuf;
+    }
+    else if (ok) {
+        background  = (uint16_t*)malloc(pixels * sizeof(uint16_t));
+        deviation   = model == MOT_MODEL_ADAPTIVE ? (uint16_t*)malloc(pixels * sizeof(uint16_t)) : NULL;
+        ok          = background && (deviation || model != MOT_MODEL_ADAPTIVE);
+    }
+
+    // the 1/8 image, its reference and change bits for the cascade
+    if (ok && coarse) {
+        coarseCur   = (uint8_t*)malloc(coarse * 2 + (coarse + 7) / 8);
+        ok          = coarseCur;
+        if (ok) {
+            coarseRef   = coarseCur + coarse;
+            coarseBits  = coarseRef + coarse;
+        }
+    }
+
+    // blocks of the window for a split decode, bands run on one task without them
+    if (ok) {
+        uint32_t blockSize      = 8 >> scaleFactor;
+        uint32_t blocks         = (sampleWidth + blockSize - 1) / blockSize * ((endRow - startRow + blockSize - 1) / blockSize + 1);
+        bandCoefs.entries       = (uint32_t*)malloc((blocks * MOT_BAND_COEFS + blocks * 2) * sizeof(uint32_t));
+        if (bandCoefs.entries) {
+            bandCoefs.entryCap  = blocks * MOT_BAND_COEFS;
+            bandCoefs.blocks    = bandCoefs.entries + bandCoefs.entryCap;
+            bandCoefs.blockEnd  = bandCoefs.blocks + blocks;
+            bandCoefs.blockCap  = blocks;
+        }
+        else {
+            ESP_LOGW(CMOT_TAG, "sizeBuffers: No memory for split decode of [%lu] blocks", blocks);
+        }
+    }
+
+    // the change map and its jpegs are only needed when debugging, a fetch may be using the old ones
+    if (ok && dbgMotion) {
+        xSemaphoreTake(fetchMutex, portMAX_DELAY);
+        jpgImgCap   = pixels + MOT_JPG_HEADER;
+        changeMap   = (uint8_t*)calloc((pixels + 7) / 8, 1);
+        mapGray     = (uint8_t*)malloc(pixels);
+        jpgBuf[0]   = (uint8_t*)malloc(jpgImgCap * 2);
+        ok          = changeMap && mapGray && jpgBuf[0];
+        if (ok) {
+            jpgBuf[1]   = jpgBuf[0] + jpgImgCap;
+            mapPixels   = pixels;
+            mapWidth    = sampleWidth;
+        }
+        xSemaphoreGive(fetchMutex);
+    }
+
+    if (!ok) {
+        ESP_LOGE(CMOT_TAG, "sizeBuffers: Unable to allocate buffers for [%lu] pixels", pixels);
+        freeBuffers();
+
+        return false;
+    }
+    bufPixels   = pixels;
+    bufWidth    = sampleWidth;
+    bufCoarse   = coarse;
+    coarseValid = false;
+    compileGrid();
+
+    ESP_LOGI(CMOT_TAG, "sizeBuffers: Sized for %lux%u", sampleWidth, endRow - startRow);
+
+    return true;
+}
+
+void CMotion::compileGrid()
+{
+    uint32_t sampleWidth;
+    uint16_t startRow, endRow;
+    getRegion(&sampleWidth, &startRow, &endRow);
+    uint16_t height = endRow - startRow;
+
+    // masked cells get no span so the compare loop never sees them
+    gridWhole   = grid.cols == 1 && grid.rows == 1 && (grid.mask & 1);
+    gridPixels  = 0;
+    for (uint8_t row = 0; row < grid.rows; row++) {
+        gridRowStart[row]   = height * row / grid.rows;
+        uint16_t rowCount   = height * (row + 1) / grid.rows - gridRowStart[row];
+
+        spanCount[row] = 0;
+        for (uint8_t col = 0; col < grid.cols; col++) {
+            uint8_t cell    = row * grid.cols + col;
+            uint16_t start  = sampleWidth * col / grid.cols;
+            uint16_t length = sampleWidth * (col + 1) / grid.cols - start;
+            uint8_t sens    = grid.sensitivity[cell];
+
+            cellLimit[cell] = length * rowCount * (sens ? 11 - sens : movePercent) / 100;
+            if (!((grid.mask >> cell) & 1) || !length || !rowCount) {
+                continue;
+            }
+
+            spans[row][spanCount[row]++] = {start, length, cell};
+            gridPixels += length * rowCount;
+        }
+    }
+    gridRowStart[grid.rows] = height;
+}
+
+void CMotion::diffSpan(const uint8_t* cur, uint32_t offset, uint32_t count, uint8_t* bits, CMotionDiff* result)
+{
+    if (model == MOT_MODEL_FRAME) {
+        motionDiff(cur + offset, prevBuf + offset, count, detectChangeThreshold, bits, result);
+    }
+    else {
+        motionBackground(cur + offset, background + offset, deviation ? deviation + offset : NULL, count, detectChangeThreshold, rateShift, MOT_BG_DEV_MULT, bits, result);
+    }
+}
+
+void CMotion::diffBand(const uint8_t* cur, uint32_t sampleWidth, CMotionBand* band)
+{
+    band->diff.changed  = 0;
+    band->diff.lux      = 0;
+    memset(&band->blob, 0, sizeof(band->blob));
+    memset(band->cellChanged, 0, sizeof(band->cellChanged));
+
+    // a single cell is compared in one pass, the change bits are kept for the debug map
+    if (gridWhole) {
+        uint32_t offset = band->rowStart * sampleWidth;
+        uint32_t count  = (band->rowEnd - band->rowStart) * sampleWidth;
+        diffSpan(cur, offset, count, band->bits, &band->diff);
+        motionBlobAdd(band->bits, count, offset, sampleWidth, band->colCount, rowCount, &band->blob);
+        band->cellChanged[0] = band->diff.changed;
+
+        return;
+    }
+
+    // only the rows in [rowStart, rowEnd) belong to the band
+    for (uint8_t row = 0; row < grid.rows; row++) {
+        uint32_t first  = gridRowStart[row] > band->rowStart ? gridRowStart[row] : band->rowStart;
+        uint32_t last   = gridRowStart[row + 1] < band->rowEnd ? gridRowStart[row + 1] : band->rowEnd;
+        for (uint32_t y = first; y < last; y++) {
+            for (uint8_t i = 0; i < spanCount[row]; i++) {
+                const CMotionSpan* span = &spans[row][i];
+                CMotionDiff part;
+                uint32_t offset = y * sampleWidth + span->start;
+                diffSpan(cur, offset, span->length, band->spanBits, &part);
+                motionBlobAdd(band->spanBits, span->length, offset, sampleWidth, band->colCount, rowCount, &band->blob);
+                band->cellChanged[span->cell]   += part.changed;
+                band->diff.changed              += part.changed;
+                band->diff.lux                  += part.lux;
+            }
+        }
+    }
+}
+
+uint8_t CMotion::splitBands(uint32_t sampleWidth, uint16_t startRow, uint16_t winStart, uint16_t winEnd, uint8_t count)
+{
+    // bands start on an MCU row, 16 image rows at most, so no block is shared by two bands
+    int32_t mcuRows = 16 >> scaleFactor;
+    uint32_t rows   = winEnd - winStart;
+    if (count < 2 || rows < count * MOT_BAND_MIN_ROWS) {
+        count = 1;
     }
 
-    if (jpgImg) {
-        free(jpgImg);
+    uint8_t n           = 0;
+    uint16_t start      = winStart;
+    uint32_t bitByte    = 0;
+    for (uint8_t b = 0; b < count; b++) {
+        int32_t end = winEnd;
+        if (b + 1 < count) {
+            end = (startRow + winStart + rows * (b + 1) / count + mcuRows / 2) / mcuRows * mcuRows - startRow;
+            if (end <= start || end >= winEnd) {
+                continue;
+            }
+        }
+
+        CMotionBand* band   = &bands[n];
+        band->rowStart      = start;
+        band->rowEnd        = end;
+        band->bits          = changeBits + bitByte;
+        band->spanBits      = spanBits + n * ((sampleWidth + 7) / 8);
+        band->colCount      = n ? bandCols + (n - 1) * sampleWidth : colCount;
+        band->decoded       = false;
+        bitByte            += ((end - start) * sampleWidth + 7) / 8;
+        start               = end;
+        n++;
+    }
+
+    return n;
+}
+
+void CMotion::decodeBandJob(void* arg, uint8_t index)
+{
+    CMotion* motion     = (CMotion*)arg;
+    CMotionBand* band   = &motion->bands[index];
+    CJpegLuma* luma     = &motion->bandDecoder[index];
+    uint16_t rows       = band->rowEnd - band->rowStart;
+
+    int ret = luma->outputCoefs(&motion->bandCoefs, motion->lumaBuf + band->rowStart * motion->bandWidth, rows * motion->bandWidth,
+        motion->bandStartRow + band->rowStart, motion->bandStartRow + band->rowEnd);
+    band->decoded = ret == JPL_RET_OK && luma->width() == motion->bandWidth && luma->height() == rows;
+}
+
+void CMotion::diffBandJob(void* arg, uint8_t index)
+{
+    CMotion* motion = (CMotion*)arg;
+    motion->diffBand(motion->lumaBuf, motion->bandWidth, &motion->bands[index]);
+}
+
+void CMotion::paintCells(uint8_t* map, uint64_t cellBits, uint32_t sampleWidth)
+{
+    // cells that saw movement in black, quiet ones white and masked ones gray
+    for (uint8_t row = 0; row < grid.rows; row++) {
+        for (uint8_t col = 0; col < grid.cols; col++) {
+            uint8_t cell    = row * grid.cols + col;
+            uint16_t start  = sampleWidth * col / grid.cols;
+            uint16_t length = sampleWidth * (col + 1) / grid.cols - start;
+            uint8_t value   = !((grid.mask >> cell) & 1) ? 128 : (cellBits >> cell) & 1 ? 0 : 255;
+            for (uint32_t y = gridRowStart[row]; y < gridRowStart[row + 1]; y++) {
+                memset(map + y * sampleWidth + start, value, length);
+            }
+        }
+    }
+}
+
+void CMotion::freeBuffers()
+{
+    // a fetch may be encoding from the debug buffers
+    if (changeMap || mapGray || jpgBuf[0]) {
+        xSemaphoreTake(fetchMutex, portMAX_DELAY);
+        free(changeMap);
+        free(mapGray);
+        free(jpgBuf[0]);
+        changeMap   = NULL;
+        mapGray     = NULL;
+        jpgBuf[0]   = NULL;
+        jpgBuf[1]   = NULL;
+        jpgLen[0]   = 0;
+        jpgLen[1]   = 0;
+        jpgImgCap   = 0;
+        mapPixels   = 0;
+        mapWidth    = 0;
+        xSemaphoreGive(fetchMutex);
     }
 
     if (prevBuf) {
         free(prevBuf);
+        prevBuf = NULL;
+    }
+
+    if (lumaBuf) {
+        free(lumaBuf);
+        lumaBuf = NULL;
+    }
+
+    if (bandCoefs.entries) {
+        free(bandCoefs.entries);
+        memset(&bandCoefs, 0, sizeof(CJpegCoefs));
     }
+
+    if (changeBits) {
+        free(changeBits);
+        changeBits = NULL;
+        spanBits = NULL;
+    }
+
+    if (colCount) {
+        free(colCount);
+        colCount = NULL;
+        rowCount = NULL;
+        bandCols = NULL;
+    }
+
+    if (background) {
+        free(background);
+        background = NULL;
+    }
+
+    if (deviation) {
+        free(deviation);
+        deviation = NULL;
+    }
+
+    if (coarseCur) {
+        free(coarseCur);
+        coarseCur   = NULL;
+        coarseRef   = NULL;
+        coarseBits  = NULL;
+    }
+
+    bufPixels   = 0;
+    bufWidth    = 0;
+    bufCoarse   = 0;
 }
 
 void CMotion::setImageParameters(uint32_t newScaleFactor, uint32_t newSampleRate, uint32_t newFrameWidth, uint32_t newFrameHeight)
@@ -63,40 +507,157 @@ void CMotion::setImageParameters(uint32_t newScaleFactor, uint32_t newSampleRate
     sampleRate  = newSampleRate;
     frameWidth  = newFrameWidth;
     frameHeight = newFrameHeight;
+
+    // previous image was sampled at the old size, the next frame becomes the reference
+    prevValid   = false;
+    sizeBuffers();
+    prefilter.setRegion(frameHeight * (detectStartBand - 1) / detectNumBands, frameHeight * detectEndBand / detectNumBands);
 }
 
 void CMotion::setDetectionParameters(uint32_t motionFrames, uint32_t nightFrames, uint32_t threshold)
 {
     detectMotionFrames      = motionFrames;
     detectNightFrames       = nightFrames;
-    detectChangeThreshold   = threshold;
+    manualThreshold         = threshold;
+    if (!autoOn) {
+        detectChangeThreshold = threshold;
+    }
 }
 
 bool CMotion::checkMotion(camera_fb_t* fb)
 {
+#ifdef MOTION_HEAP_AUDIT
+    uint32_t ops    = auditOps;
+    auditTask       = xTaskGetCurrentTaskHandle();
+    bool motion     = compareFrame(fb);
+    auditTask       = NULL;
+    heapOps        += auditOps - ops;
+
+    return motion;
+#else
+    return compareFrame(fb);
+#endif
+}
+
+bool CMotion::compareFrame(camera_fb_t* fb)
+{
+    // a frame from before setImageParameters() would seed the reference at the wrong size
+    if (fb->width != frameWidth || fb->height != frameHeight) {
+        ESP_LOGD(CMOT_TAG, "checkMotion: Frame [%ux%u] does not match [%lux%lu]", fb->width, fb->height, frameWidth, frameHeight);
+
+        return nightTime ? false : motionStatus;
+    }
+
     // check difference between current and previous image (subtract background)
     // convert image from JPEG to downscaled RGB888 bitmap to 8 bit grayscale
     uint32_t dTime  = CurrentTime.ms();
     uint32_t lux    = 0;
     uint8_t* rgbBuf = NULL;
-    uint8_t* jpgBuf = NULL;
-    size_t jpg_len  = 0;
 
     // calculate parameters for sample size
-    uint8_t scaling = scaleFactor; 
-    uint16_t reducer = sampleRate;
-    uint8_t downsize = pow(2, scaling) * reducer;
-    uint32_t sampleWidth = frameWidth / downsize;
-    uint32_t sampleHeight = frameHeight / downsize;
-    uint32_t num_pixels = sampleWidth * sampleHeight;
-    if (!jpg2rgb((uint8_t*)fb->buf, fb->len, &rgbBuf, (jpg_scale_t)scaling)) {
-        ESP_LOGE(CMOT_TAG, "checkMotion: motionDetect: jpg2rgb() failed");
-        free(rgbBuf);
-        rgbBuf = NULL;
+    uint32_t sampleWidth;
+    uint16_t startRow, endRow;
+    getRegion(&sampleWidth, &startRow, &endRow);
+    uint32_t num_pixels = sampleWidth * (endRow - startRow);
+    if (!num_pixels || num_pixels != bufPixels) {
+        ESP_LOGE(CMOT_TAG, "checkMotion: Invalid region of interest [%lu] pixels", num_pixels);
 
         return motionStatus;
     }
 
+    // while nothing is moving a frame whose compressed profile matches the baseline is not
+    // decoded, every PRF_AUDIT_EVERY of them is decoded anyway to count what that missed
+    bool audit = false;
+    if (prefilterOn) {
+        prefilterChecked++;
+        if (prefilter.unchanged(fb->buf, fb->len) && prevValid && !motionStatus) {
+            if (++prefilterRun < PRF_AUDIT_EVERY) {
+                prefilterSkipped++;
+                cells = 0;
+                portENTER_CRITICAL(&boxLock);
+                box.area = 0;
+                portEXIT_CRITICAL(&boxLock);
+
+                return nightTime ? false : motionStatus;
+            }
+            prefilterAudits++;
+            audit = true;
+        }
+        prefilterRun = 0;
+    }
+
+    // with the cascade a 1/8 pass goes first, the fine decode only covers the rows it saw change.
+    // Once motion has started every frame needs the fine decode, the 1/8 pass waits until it stops
+    uint16_t height     = endRow - startRow;
+    uint16_t winStart   = 0;
+    uint16_t winEnd     = height;
+    uint32_t decodeUs   = 0;
+    int coarse          = MOT_COARSE_NONE;
+    if (useCascade() && prevValid && motionStatus) {
+        coarseValid = false;
+    }
+    else if (useCascade() && prevValid) {
+        coarse = coarsePass(fb, startRow, height, &decodeUs, &winStart, &winEnd);
+        if (coarse == MOT_COARSE_QUIET) {
+            countDecode(decodeUs);
+            cells = 0;
+            portENTER_CRITICAL(&boxLock);
+            box.area = 0;
+            portEXIT_CRITICAL(&boxLock);
+            nightTime = isNight(nightSwitch);
+            updateStatus(0);
+            if (dbgMotion && changeMap) {
+                bandCount = 0;
+                storeMap(0, sampleWidth);
+            }
+
+            return nightTime ? false : motionStatus;
+        }
+    }
+    bool whole          = winStart == 0 && winEnd == height;
+    uint32_t offset     = winStart * sampleWidth;
+    uint32_t count      = (winEnd - winStart) * sampleWidth;
+
+    // the window is split into bands for the workers, now and then it runs on this task alone
+    // so the stats can show what the split gains
+    uint8_t split = bandLimit < bandPool.size() ? bandLimit : bandPool.size();
+    bool bench = split > 1 && ++benchRun >= MOT_BAND_BENCH;
+    if (bench) {
+        benchRun = 0;
+    }
+    bandCount       = splitBands(sampleWidth, startRow, winStart, winEnd, bench ? 1 : split);
+    bandStartRow    = startRow;
+    bandWidth       = sampleWidth;
+
+    // the entropy decode has to run in bitstream order, so it runs once here and the bands only
+    // split the IDCT and the compare
+    int64_t workStart = esp_timer_get_time();
+    bool decoded = false;
+    if (bandCount > 1 && decoder == MOT_DECODE_LUMA && bandCoefs.entries) {
+        int ret = lumaDecoder.decodeCoefs(fb->buf, fb->len, &bandCoefs, (jpg_scale_t)scaleFactor, startRow + winStart, startRow + winEnd);
+        if (ret == JPL_RET_OK && bandCoefs.width == sampleWidth && bandCoefs.rowLast - bandCoefs.rowFirst == winEnd - winStart) {
+            bandPool.run(decodeBandJob, this, bandCount);
+            decoded = true;
+            for (uint8_t i = 0; i < bandCount; i++) {
+                decoded = decoded && bands[i].decoded;
+            }
+        }
+        decodeUs += (uint32_t)(esp_timer_get_time() - workStart);
+    }
+
+    // a window with more coefficients than the store or a band that failed goes through the usual path
+    if (!decoded && !decodeFrame(fb, (jpg_scale_t)scaleFactor, startRow + winStart, startRow + winEnd, sampleWidth, lumaBuf + offset, count, &decodeUs)) {
+        return motionStatus;
+    }
+    countDecode(decodeUs);
+    uint32_t workUs = (uint32_t)(esp_timer_get_time() - workStart);
+    rgbBuf = lumaBuf;
+    if (coarse != MOT_COARSE_NONE) {
+        fineFrames++;
+        fineRows    += winEnd - winStart;
+        fineTotal   += height;
+    }
+
     /*
       if (reducer > 1) 
         // further reduce size of bitmap 
@@ -104,49 +665,148 @@ bool CMotion::checkMotion(camera_fb_t* fb)
           for (int c=0; c<sampleWidth; c++)      
             rgb_buf[c+(r*sampleWidth)] = rgb_buf[(c+(r*sampleWidth))*reducer]; 
     */
-    ESP_LOGD(CMOT_TAG, "checkMotion: JPEG to greyscale conversion %lu bytes in %lums", num_pixels, CurrentTime.ms() - dTime);
+    ESP_LOGD(CMOT_TAG, "checkMotion: JPEG to greyscale conversion %lu bytes in %lums", count, CurrentTime.ms() - dTime);
     dTime = CurrentTime.ms();
 
-    // compare each pixel in current frame with previous frame 
-    int changeCount = 0;
-    // set horizontal region of interest in image 
-    uint16_t startPixel = num_pixels*(detectStartBand-1)/detectNumBands;
-    uint16_t endPixel = num_pixels*(detectEndBand)/detectNumBands;
-    int moveThreshold = (endPixel-startPixel) * (11-motionVal)/100; // number of changed pixels that constitute a movement
-    for (int i=0; i<num_pixels; i++) {
-        if (abs((int)rgbBuf[i] - (int)prevBuf[i]) > detectChangeThreshold) {
-            if (i > startPixel && i < endPixel) changeCount++; // number of changed pixels
-            if (dbgMotion) changeMap[i] = 192; // populate changeMap image with changed pixels in gray
-        } else if (dbgMotion) changeMap[i] =  255; // set white 
-
-        lux += rgbBuf[i]; // for calculating light level
-    }
-    lightLevel = (lux*100)/(num_pixels*255); // light value as a %
+    // nothing to compare against after a size change, keep the current motion state. Without a
+    // reference there is no cascade window, the decode covered the whole region
+    if (!prevValid) {
+        assert(count == num_pixels);
+        if (model == MOT_MODEL_FRAME) {
+            memcpy(prevBuf, rgbBuf, num_pixels);
+        }
+        else {
+            motionBackgroundInit(rgbBuf, background, deviation, num_pixels);
+        }
+        prevValid   = true;
+        coarseValid = false;
+        ESP_LOGI(CMOT_TAG, "checkMotion: New reference image %lux%u", sampleWidth, height);
+
+        return nightTime ? false : motionStatus;
+    }
+
+    // compare each pixel in current frame with previous frame or the background, every decoded pixel is
+    // in the region of interest. Change count, light level, change bits for the debug map and the
+    // background update come from one pass
+    // with a grid only the spans of enabled cells are compared, each cell against its own threshold
+    // a global brightness step, lights or an exposure change, is matched out of the reference first
+    bool relit = illumOn && compensate(rgbBuf, offset, count);
+
+    // the histogram needs the reference before the compare pass replaces or moves it, only
+    // frames decoded in full are learnt from so a window of changed rows does not skew it
+    bool learn = autoOn && whole;
+    if (learn) {
+        sampleDiffs(rgbBuf, num_pixels);
+    }
+
+    // the change bits also give the area, centroid and projections for the motion box
+    // each band keeps its own counts, projections and blob, they are added up after
+    int64_t diffStart = esp_timer_get_time();
+    memset(colCount, 0, (sampleWidth * BAND_MAX_WORKERS + height) * sizeof(uint16_t));
+    if (bandCount > 1) {
+        bandPool.run(diffBandJob, this, bandCount);
+    }
+    else {
+        diffBand(rgbBuf, sampleWidth, &bands[0]);
+    }
+
+    CMotionDiff diff = bands[0].diff;
+    blob = bands[0].blob;
+    memcpy(cellChanged, bands[0].cellChanged, sizeof(cellChanged));
+    for (uint8_t b = 1; b < bandCount; b++) {
+        diff.changed    += bands[b].diff.changed;
+        diff.lux        += bands[b].diff.lux;
+        blob.area       += bands[b].blob.area;
+        blob.sumX       += bands[b].blob.sumX;
+        blob.sumY       += bands[b].blob.sumY;
+        for (uint32_t i = 0; i < MOT_GRID_CELLS; i++) {
+            cellChanged[i] += bands[b].cellChanged[i];
+        }
+        for (uint32_t x = 0; x < sampleWidth; x++) {
+            colCount[x] += bands[b].colCount[x];
+        }
+    }
+
+    workUs += (uint32_t)(esp_timer_get_time() - diffStart);
+    if (bandCount > 1) {
+        splitFrames++;
+        splitTotal += workUs;
+    }
+    else if (bench) {
+        singleFrames++;
+        singleTotal += workUs;
+    }
+
+    if (model == MOT_MODEL_FRAME) {
+        memcpy(prevBuf + offset, rgbBuf + offset, count); // save image for next comparison 
+    }
+
+    // the 1/8 reference follows the fine one for the rows it compared
+    if (coarse == MOT_COARSE_FULL) {
+        memcpy(coarseRef, coarseCur, bufCoarse);
+        coarseValid = true;
+    }
+    else if (coarse == MOT_COARSE_CHANGED) {
+        uint32_t coarseWidth = bufCoarse / coarseRows;
+        memcpy(coarseRef + coarseFirst * coarseWidth, coarseCur + coarseFirst * coarseWidth, (coarseLast - coarseFirst) * coarseWidth);
+    }
+
+    uint64_t cellBits = 0;
+    for (uint8_t row = 0; row < grid.rows; row++) {
+        for (uint8_t i = 0; i < spanCount[row]; i++) {
+            uint8_t cell = spans[row][i].cell;
+            if (cellChanged[cell] > cellLimit[cell]) {
+                cellBits |= 1ULL << cell;
+            }
+        }
+    }
+    cells = cellBits;
+    updateBox(sampleWidth, startRow, endRow);
+    if (learn) {
+        learnThresholds(diff.changed, cellBits);
+    }
+    if (relit && !cellBits) {
+        illumEvents++;
+        ESP_LOGI(CMOT_TAG, "checkMotion: Lighting change of %d ignored", lastStep);
+    }
+
+    uint32_t changeCount = diff.changed;
+    lux = diff.lux;
+    if (audit && cellBits) {
+        prefilterMisses++;
+    }
+    // light value as a % of the enabled region of interest, a window of rows keeps the level from the 1/8 pass
+    if (whole) {
+        lightLevel = gridPixels ? (lux*100)/(gridPixels*255) : 0;
+    }
     nightTime = isNight(nightSwitch);
-    memcpy(prevBuf, rgbBuf, num_pixels); // save image for next comparison 
-    // esp32-cam issue #126
-    if (rgbBuf == NULL) {
-        ESP_LOGE(CMOT_TAG, "checkMotion: Memory leak, heap now: %u, pSRAM now: %u", heap_caps_get_free_size(MALLOC_CAP_8BIT), heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
-    }
-    free(rgbBuf);
-    rgbBuf = NULL;
-    ESP_LOGD(CMOT_TAG, "checkMotion: Detected %u changes, threshold %u, light level %u, in %lums", changeCount, moveThreshold, lightLevel, CurrentTime.ms() - dTime);
+    ESP_LOGD(CMOT_TAG, "checkMotion: Detected %lu changes, cells %08lx%08lx, light level %u, in %lums", changeCount, (uint32_t)(cellBits >> 32), (uint32_t)cellBits, lightLevel, CurrentTime.ms() - dTime);
     dTime = CurrentTime.ms();
 
-    if (changeCount > moveThreshold) {
+    updateStatus(cellBits);
+
+    // the debug map is kept as bits, the jpeg is only made when someone fetches it
+    if (dbgMotion && changeMap) {
+        storeMap(cellBits, sampleWidth);
+    }
+   
+    // motionStatus indicates whether motion previously ongoing or not
+    return nightTime ? false : motionStatus;
+}
+
+void CMotion::updateStatus(uint64_t cellBits)
+{
+    if (cellBits) {
         ESP_LOGI(CMOT_TAG, "checkMotion: ### Change detected");
+        changeFrames++;
         motionCnt++; // number of consecutive changes
         // need minimum sequence of changes to signal valid movement
         if (!motionStatus && motionCnt >= detectMotionFrames) {
             ESP_LOGI(CMOT_TAG, "checkMotion: ***** Motion - START");
+            triggers++;
             motionStatus = true; // motion started
         } 
 
-        if (dbgMotion)
-            // to highlight movement detected in changeMap image, set all gray in region of interest to black
-            for (int i=0; i<num_pixels; i++) 
-                if (i > startPixel && i < endPixel && changeMap[i] < 255) changeMap[i] = 0;
-
     } else {
         // insufficient change
         if (motionStatus) {
@@ -159,23 +819,599 @@ bool CMotion::checkMotion(camera_fb_t* fb)
     if (motionStatus) {
         ESP_LOGI(CMOT_TAG, "checkMotion: *** Motion - ongoing %lu frames", motionCnt);
     }
+}
+
+int CMotion::coarsePass(camera_fb_t* fb, uint16_t startRow, uint16_t height, uint32_t* decodeUs, uint16_t* winStart, uint16_t* winEnd)
+{
+    uint32_t coarseWidth;
+    uint16_t coarseStart, coarseEnd;
+    getCoarseRegion(&coarseWidth, &coarseStart, &coarseEnd);
+    if (!bufCoarse || !decodeFrame(fb, JPG_SCALE_8X, coarseStart, coarseEnd, coarseWidth, coarseCur, bufCoarse, decodeUs)) {
+        coarseValid = false;
+
+        return MOT_COARSE_NONE;
+    }
+
+    // the fine pass runs in full now and then so the background and thresholds see quiet frames
+    if (!coarseValid || ++coarseRun >= MOT_CASCADE_REFRESH) {
+        coarseRun = 0;
+
+        return MOT_COARSE_FULL;
+    }
+
+    CMotionDiff diff;
+    motionDiff(coarseCur, coarseRef, bufCoarse, detectChangeThreshold, coarseBits, &diff);
+    lightLevel = (diff.lux*100)/(bufCoarse*255);
+    if (diff.changed * 100 <= bufCoarse * MOT_CASCADE_PRE) {
+        coarseFrames++;
+
+        return MOT_COARSE_QUIET;
+    }
 
-    if (dbgMotion) { 
-        // build jpeg of changeMap for debug streaming
-        dTime = CurrentTime.ms();
-        if (!fmt2jpg(changeMap, num_pixels, sampleWidth, sampleHeight, PIXFORMAT_GRAYSCALE, 80, &jpgBuf, &jpg_len)) {
-            ESP_LOGE(CMOT_TAG, "checkMotion: fmt2jpg() failed");
+    // the changed rows plus a margin are confirmed at the fine scale
+    uint16_t rows   = coarseEnd - coarseStart;
+    coarseRows      = rows;
+    int32_t first   = rows;
+    int32_t last    = -1;
+    for (uint32_t i = 0; i < bufCoarse; i++) {
+        if ((coarseBits[i >> 3] >> (i & 7)) & 1) {
+            int32_t row = i / coarseWidth;
+            first   = row < first ? row : first;
+            last    = row;
         }
-        // prevent streaming from accessing jpeg while it is being updated
-        memcpy(jpgImg, jpgBuf, jpg_len);
-        jpgImgSize = jpg_len; 
-        free(jpgBuf);
-        jpgBuf = NULL;
-        ESP_LOGD(CMOT_TAG, "checkMotion: Created changeMap JPEG %d bytes in %lums", jpg_len, CurrentTime.ms() - dTime);
     }
-   
-    // motionStatus indicates whether motion previously ongoing or not
-    return nightTime ? false : motionStatus;
+    first   = first > MOT_CASCADE_MARGIN ? first - MOT_CASCADE_MARGIN : 0;
+    last    = last + 1 + MOT_CASCADE_MARGIN < rows ? last + 1 + MOT_CASCADE_MARGIN : rows;
+    coarseFirst = first;
+    coarseLast  = last;
+
+    // coarse rows are 8 frame rows, fine rows downsize frame rows
+    uint32_t downsize   = (1 << scaleFactor) * sampleRate;
+    int32_t start       = (int32_t)(((coarseStart + first) << JPG_SCALE_8X) / downsize) - startRow;
+    int32_t end         = (int32_t)((((coarseStart + last) << JPG_SCALE_8X) + downsize - 1) / downsize) - startRow;
+    *winStart   = start < 0 ? 0 : start;
+    *winEnd     = end > height ? height : end;
+    if (*winStart >= *winEnd) {
+        *winStart   = 0;
+        *winEnd     = height;
+    }
+    coarseRun   = 0;
+
+    return MOT_COARSE_CHANGED;
+}
+
+bool CMotion::decodeFrame(camera_fb_t* fb, jpg_scale_t scale, uint16_t startRow, uint16_t endRow, uint32_t width, uint8_t* out, uint32_t outSize, uint32_t* decodeUs)
+{
+    int64_t decodeStart = esp_timer_get_time();
+    bool decoded = false;
+
+    // luma only decode straight into our own buffer
+    if (decoder == MOT_DECODE_LUMA && out) {
+        int ret = lumaDecoder.decode(fb->buf, fb->len, out, outSize, scale, startRow, endRow);
+        if (ret == JPL_RET_OK && lumaDecoder.width() == width && lumaDecoder.height() == endRow - startRow) {
+            decoded = true;
+        }
+        else {
+            decodeFallbacks++;
+            ESP_LOGD(CMOT_TAG, "decodeFrame: Luma decode failed [%d], using jpg2rgb", ret);
+        }
+    }
+
+    // the fallback writes gray into the same buffer, nothing is allocated per frame. A window
+    // clamped to a smaller image would leave the caller's rows short, so it has to match too
+    if (!decoded) {
+        uint16_t outWidth = 0, outRows = 0;
+        if (!out || !jpg2rgb((uint8_t*)fb->buf, fb->len, out, outSize, scale, startRow, endRow, &outWidth, &outRows)) {
+            ESP_LOGE(CMOT_TAG, "decodeFrame: jpg2rgb() failed");
+
+            return false;
+        }
+        if (outWidth != width || outRows != endRow - startRow) {
+            ESP_LOGE(CMOT_TAG, "decodeFrame: jpg2rgb() gave %ux%u, expected %lux%u", outWidth, outRows, width, endRow - startRow);
+
+            return false;
+        }
+    }
+
+    *decodeUs += (uint32_t)(esp_timer_get_time() - decodeStart);
+
+    return true;
+}
+
+void CMotion::countDecode(uint32_t decodeUs)
+{
+    // per frame, a 1/8 pass and the fine decode after it count as one
+    decodeFrames++;
+    decodeTotal += decodeUs;
+    if (decodeUs > decodeMax) {
+        decodeMax = decodeUs;
+    }
+}
+
+static void copyBits(uint8_t* dst, uint32_t pos, const uint8_t* src, uint32_t count)
+{
+    // src bit 0 lands on dst bit pos, dst is clear so the bits are ORed in
+    uint32_t shift  = pos & 7;
+    uint32_t bytes  = (count + 7) / 8;
+    uint8_t* out    = dst + (pos >> 3);
+    for (uint32_t i = 0; i < bytes; i++) {
+        uint8_t value = src[i];
+        if (i == bytes - 1 && (count & 7)) {
+            value &= (1 << (count & 7)) - 1;
+        }
+
+        out[i] |= value << shift;
+        if (shift && (value >> (8 - shift))) {
+            out[i + 1] |= value >> (8 - shift);
+        }
+    }
+}
+
+void CMotion::storeMap(uint64_t cellBits, uint32_t sampleWidth)
+{
+    // with one cell the changed pixels are kept, a grid only shows its cells
+    xSemaphoreTake(mapMutex, portMAX_DELAY);
+    if (gridWhole) {
+        memset(changeMap, 0, (bufPixels + 7) / 8);
+        for (uint8_t b = 0; b < bandCount; b++) {
+            copyBits(changeMap, bands[b].rowStart * sampleWidth, bands[b].bits, (bands[b].rowEnd - bands[b].rowStart) * sampleWidth);
+        }
+    }
+    mapCells    = cellBits;
+    mapWhole    = gridWhole;
+    mapSeq++;
+    xSemaphoreGive(mapMutex);
+}
+
+bool CMotion::encodeMap()
+{
+    // changed pixels in gray, or black when they amounted to movement, on white
+    xSemaphoreTake(mapMutex, portMAX_DELAY);
+    uint32_t seq = mapSeq;
+    if (mapWhole) {
+        uint8_t changeVal = mapCells ? 0 : 192;
+        for (uint32_t i = 0; i < mapPixels; i++) {
+            mapGray[i] = (changeMap[i >> 3] >> (i & 7)) & 1 ? changeVal : 255;
+        }
+    }
+    else {
+        paintCells(mapGray, mapCells, mapWidth);
+    }
+    xSemaphoreGive(mapMutex);
+
+    // into the back buffer, the reader keeps the front one until the next fetch
+    uint32_t dTime  = CurrentTime.ms();
+    uint8_t back    = jpgFront ^ 1;
+    jpgImg          = jpgBuf[back];
+    jpgWritten      = 0;
+    jpgOverflow     = false;
+    if (!fmt2jpg_cb(mapGray, mapPixels, mapWidth, mapPixels / mapWidth, PIXFORMAT_GRAYSCALE, 80, writeJpg, this) || jpgOverflow) {
+        ESP_LOGE(CMOT_TAG, "encodeMap: fmt2jpg_cb() failed");
+
+        return false;
+    }
+    jpgLen[back]    = jpgWritten;
+    jpgFront        = back;
+    jpgSeq          = seq;
+    ESP_LOGD(CMOT_TAG, "encodeMap: Created changeMap JPEG %d bytes in %lums", jpgWritten, CurrentTime.ms() - dTime);
+
+    return true;
+}
+
+size_t CMotion::writeJpg(void* arg, size_t index, const void* data, size_t len)
+{
+    CMotion* motion = (CMotion*)arg;
+    if (index + len > motion->jpgImgCap) {
+        motion->jpgOverflow = true;
+
+        return 0;
+    }
+
+    memcpy(motion->jpgImg + index, data, len);
+    if (index + len > motion->jpgWritten) {
+        motion->jpgWritten = index + len;
+    }
+
+    return len;
+}
+
+void CMotion::setDecoder(CMotionDecoder newDecoder)
+{
+    decoder = newDecoder;
+    resetStats();
+
+    ESP_LOGI(CMOT_TAG, "setDecoder: Using %s decoder", decoder == MOT_DECODE_LUMA ? "luma" : "RGB");
+}
+
+void CMotion::setPrefilter(bool enable)
+{
+    prefilterOn = enable;
+    prefilter.reset();
+    resetStats();
+
+    ESP_LOGI(CMOT_TAG, "setPrefilter: Prefilter %s", enable ? "on" : "off");
+}
+
+void CMotion::setModel(CMotionModel newModel, uint8_t newRateShift)
+{
+    model       = newModel;
+    rateShift   = newRateShift;
+
+    // the reference buffers differ between models, resize and start again from the next frame
+    freeBuffers();
+    sizeBuffers();
+    prevValid   = false;
+    resetStats();
+
+    ESP_LOGI(CMOT_TAG, "setModel: Comparing against %s, rate 1/%u", model == MOT_MODEL_FRAME ? "previous frame" : model == MOT_MODEL_AVERAGE ? "background" : "adaptive background", 1 << rateShift);
+}
+
+bool CMotion::setGrid(const CMotionGrid* newGrid)
+{
+    uint32_t count = newGrid->cols * newGrid->rows;
+    if (!newGrid->cols || !newGrid->rows || newGrid->cols > MOT_GRID_MAX_COLS || newGrid->rows > MOT_GRID_MAX_ROWS) {
+        ESP_LOGE(CMOT_TAG, "setGrid: Invalid grid %ux%u", newGrid->cols, newGrid->rows);
+
+        return false;
+    }
+
+    uint64_t used = count == MOT_GRID_CELLS ? newGrid->mask : newGrid->mask & ((1ULL << count) - 1);
+    if (!used) {
+        ESP_LOGE(CMOT_TAG, "setGrid: No cells enabled");
+
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (newGrid->sensitivity[i] > 10) {
+            ESP_LOGE(CMOT_TAG, "setGrid: Invalid sensitivity [%u] for cell %lu", newGrid->sensitivity[i], i);
+
+            return false;
+        }
+    }
+
+    grid        = *newGrid;
+    grid.mask   = used;
+    compileGrid();
+    cells       = 0;
+
+    ESP_LOGI(CMOT_TAG, "setGrid: %ux%u grid, %lu pixels enabled", grid.cols, grid.rows, gridPixels);
+
+    return true;
+}
+
+static void trimRange(const uint16_t* counts, uint32_t n, uint32_t trim, uint32_t* first, uint32_t* last)
+{
+    // drop up to trim changed pixels from each end, trim is under half the area so something is left
+    uint32_t sum = 0;
+    uint32_t i = 0;
+    while (i < n && sum + counts[i] <= trim) {
+        sum += counts[i++];
+    }
+
+    sum = 0;
+    uint32_t j = n;
+    while (j > i && sum + counts[j - 1] <= trim) {
+        sum += counts[--j];
+    }
+
+    *first  = i;
+    *last   = j;
+}
+
+void CMotion::updateBox(uint32_t sampleWidth, uint16_t startRow, uint16_t endRow)
+{
+    CMotionBox newBox;
+    memset(&newBox, 0, sizeof(newBox));
+
+    if (blob.area) {
+        uint32_t downsize = (1 << scaleFactor) * sampleRate;
+        uint32_t trim = blob.area >> MOT_BOX_TRIM_SHIFT;
+        uint32_t x0, x1, y0, y1;
+        trimRange(colCount, sampleWidth, trim, &x0, &x1);
+        trimRange(rowCount, endRow - startRow, trim, &y0, &y1);
+
+        newBox.x        = x0 * downsize;
+        newBox.y        = (startRow + y0) * downsize;
+        newBox.width    = (x1 - x0) * downsize;
+        newBox.height   = (y1 - y0) * downsize;
+        newBox.centerX  = blob.sumX / blob.area * downsize + downsize / 2;
+        newBox.centerY  = (startRow + blob.sumY / blob.area) * downsize + downsize / 2;
+        newBox.area     = blob.area * downsize * downsize;
+    }
+
+    portENTER_CRITICAL(&boxLock);
+    box = newBox;
+    portEXIT_CRITICAL(&boxLock);
+}
+
+void CMotion::getBox(CMotionBox* out)
+{
+    portENTER_CRITICAL(&boxLock);
+    *out = box;
+    portEXIT_CRITICAL(&boxLock);
+}
+
+void CMotion::sampleDiffs(const uint8_t* cur, uint32_t count)
+{
+    memset(frameHist, 0, sizeof(frameHist));
+    for (uint32_t i = 0; i < count; i += MOT_AUTO_STRIDE) {
+        int32_t ref = model == MOT_MODEL_FRAME ? prevBuf[i] : background[i] >> 8;
+        uint32_t diff = abs((int32_t)cur[i] - ref);
+        frameHist[diff < MOT_AUTO_BINS ? diff : MOT_AUTO_BINS - 1]++;
+    }
+}
+
+static uint32_t percentile(const uint32_t* hist, uint32_t bins, uint32_t pct)
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < bins; i++) {
+        total += hist[i];
+    }
+
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < bins; i++) {
+        sum += hist[i];
+        if (sum * 100 >= total * pct) {
+            return i;
+        }
+    }
+
+    return bins - 1;
+}
+
+uint32_t CMotion::learntThreshold()
+{
+    uint32_t threshold = percentile(diffHist, MOT_AUTO_BINS, MOT_AUTO_PERCENTILE) + MOT_AUTO_MARGIN;
+
+    return threshold < MOT_AUTO_MIN ? MOT_AUTO_MIN : threshold > MOT_AUTO_MAX ? MOT_AUTO_MAX : threshold;
+}
+
+void CMotion::learnThresholds(uint32_t changed, uint64_t cellBits)
+{
+    // learn from frames without change, or from change that has gone on so long it is the
+    // new noise floor, ie the lights went out and the old threshold triggers on every frame
+    if (cellBits && ++autoBusy < MOT_AUTO_STUCK) {
+        return;
+    }
+    if (!cellBits) {
+        autoBusy = 0;
+    }
+
+    // the floor has moved, what was learnt under the old one would only hold the new threshold back
+    if (autoBusy == MOT_AUTO_STUCK) {
+        memset(diffHist, 0, sizeof(diffHist));
+        memset(fracHist, 0, sizeof(fracHist));
+    }
+
+    for (uint32_t i = 0; i < MOT_AUTO_BINS; i++) {
+        diffHist[i] += frameHist[i];
+    }
+
+    // a stuck frame's changed fraction was counted at the threshold being replaced and would push the
+    // move percentage to its limit, its sampled differences give the fraction at the one being learnt
+    uint32_t fraction = gridPixels ? changed * 100 / gridPixels : 0;
+    if (cellBits) {
+        uint32_t threshold = learntThreshold();
+        uint32_t above = 0;
+        uint32_t total = 0;
+        for (uint32_t i = 0; i < MOT_AUTO_BINS; i++) {
+            total += frameHist[i];
+            above += i > threshold ? frameHist[i] : 0;
+        }
+        fraction = total ? above * 100 / total : 0;
+    }
+    fracHist[fraction]++;
+    autoFrames++;
+
+    if (autoFrames >= MOT_AUTO_WARMUP && !(autoFrames % MOT_AUTO_UPDATE)) {
+        uint32_t threshold = learntThreshold();
+        uint32_t move = percentile(fracHist, 101, MOT_AUTO_PERCENTILE) + 1;
+        move = move > MOT_AUTO_MAX_MOVE ? MOT_AUTO_MAX_MOVE : move;
+
+        if (threshold != (uint32_t)detectChangeThreshold || move != movePercent) {
+            ESP_LOGI(CMOT_TAG, "learnThresholds: Change threshold %u -> %lu, move %u%% -> %lu%%", detectChangeThreshold, threshold, movePercent, move);
+            detectChangeThreshold   = threshold;
+            movePercent             = move;
+            compileGrid();
+        }
+    }
+
+    // old lighting fades out of the histograms
+    if (!(autoFrames % MOT_AUTO_WINDOW)) {
+        for (uint32_t i = 0; i < MOT_AUTO_BINS; i++) {
+            diffHist[i] >>= 1;
+        }
+        for (uint32_t i = 0; i < 101; i++) {
+            fracHist[i] >>= 1;
+        }
+    }
+}
+
+bool CMotion::compensate(const uint8_t* cur, uint32_t offset, uint32_t count)
+{
+    CMotionMoments moments;
+    bool frame = model == MOT_MODEL_FRAME;
+    motionMoments(cur + offset, frame ? prevBuf + offset : NULL, frame ? NULL : background + offset, count, &moments);
+
+    float scale     = frame ? 1.0f : 256.0f;
+    float mean      = (float)moments.sum / count;
+    float refMean   = (float)moments.refSum / count / scale;
+    float var       = (float)moments.sumSq / count - mean * mean;
+    float refVar    = (float)moments.refSumSq / count / (scale * scale) - refMean * refMean;
+    lastStep        = roundf(mean - refMean);
+    if (fabsf(mean - refMean) < MOT_ILLUM_STEP) {
+        return false;
+    }
+
+    // the reference takes the current mean and contrast, what is left after that is local change
+    float gain = refVar > 1.0f ? sqrtf(var / refVar) : 1.0f;
+    gain = gain < MOT_ILLUM_MIN_GAIN ? MOT_ILLUM_MIN_GAIN : gain > MOT_ILLUM_MAX_GAIN ? MOT_ILLUM_MAX_GAIN : gain;
+    if (frame) {
+        for (uint32_t v = 0; v < 256; v++) {
+            float value = (v - refMean) * gain + mean;
+            illumLut[v] = value < 0 ? 0 : value > 255 ? 255 : (uint8_t)(value + 0.5f);
+        }
+        motionRemap(prevBuf + offset, count, illumLut);
+    }
+    else {
+        motionRemapBackground(background + offset, count, refMean * 256, gain * 256, mean * 256);
+    }
+
+    return true;
+}
+
+void CMotion::setIllumination(bool enable)
+{
+    illumOn = enable;
+    resetStats();
+
+    ESP_LOGI(CMOT_TAG, "setIllumination: Lighting compensation %s", enable ? "on" : "off");
+}
+
+void CMotion::setCascade(bool enable)
+{
+    cascadeOn   = enable;
+    coarseRun   = 0;
+
+    // the 1/8 buffers come and go with the cascade, a resize starts again from the next frame
+    sizeBuffers();
+    prevValid   = false;
+    resetStats();
+
+    ESP_LOGI(CMOT_TAG, "setCascade: Coarse to fine %s", enable ? "on" : "off");
+}
+
+void CMotion::setBands(uint8_t count)
+{
+    bandLimit = count < 1 ? 1 : count > BAND_MAX_WORKERS ? BAND_MAX_WORKERS : count;
+    resetStats();
+
+    ESP_LOGI(CMOT_TAG, "setBands: Up to %u bands, %u workers", bandLimit, bandPool.size());
+}
+
+int CMotion::startWorkers()
+{
+    return bandPool.start();
+}
+
+void CMotion::stopWorkers()
+{
+    bandPool.stop();
+}
+
+void CMotion::setDebug(bool enable)
+{
+    dbgMotion = enable;
+
+    // the map buffers come and go with debugging, a resize starts again from the next frame
+    freeBuffers();
+    sizeBuffers();
+    prevValid = false;
+
+    ESP_LOGI(CMOT_TAG, "setDebug: Change map %s", enable ? "on" : "off");
+}
+
+void CMotion::setAutoThreshold(bool enable)
+{
+    autoOn      = enable;
+    autoFrames  = 0;
+    autoBusy    = 0;
+    memset(diffHist, 0, sizeof(diffHist));
+    memset(fracHist, 0, sizeof(fracHist));
+
+    // back to the configured values, auto starts from them too
+    detectChangeThreshold   = manualThreshold;
+    movePercent             = 11 - motionVal;
+    compileGrid();
+
+    ESP_LOGI(CMOT_TAG, "setAutoThreshold: Auto threshold %s", enable ? "on" : "off");
+}
+
+void CMotion::getGrid(CMotionGrid* out)
+{
+    *out = grid;
+}
+
+uint64_t CMotion::getCells()
+{
+    return cells;
+}
+
+uint8_t CMotion::getLightLevel()
+{
+    return lightLevel;
+}
+
+void CMotion::getStats(CMotionStats* stats)
+{
+    stats->decoder      = decoder;
+    stats->frames       = decodeFrames;
+    stats->fallbacks    = decodeFallbacks;
+    stats->avgDecodeUs  = decodeFrames ? (uint32_t)(decodeTotal / decodeFrames) : 0;
+    stats->maxDecodeUs  = decodeMax;
+#ifdef MOTION_HEAP_AUDIT
+    stats->heapOps      = heapOps;
+#else
+    stats->heapOps      = UINT32_MAX;
+#endif
+    stats->prefilter    = prefilterOn;
+    stats->checked      = prefilterChecked;
+    stats->skipped      = prefilterSkipped;
+    stats->audits       = prefilterAudits;
+    stats->misses       = prefilterMisses;
+    stats->model        = model;
+    stats->rateShift    = rateShift;
+    stats->changeFrames = changeFrames;
+    stats->triggers     = triggers;
+    stats->autoTune     = autoOn;
+    stats->threshold    = detectChangeThreshold;
+    stats->movePercent  = movePercent;
+    stats->quietFrames  = autoFrames;
+    stats->illumination = illumOn;
+    stats->lastStep     = lastStep;
+    stats->illumEvents  = illumEvents;
+    stats->cascade      = cascadeOn;
+    stats->coarseFrames = coarseFrames;
+    stats->fineFrames   = fineFrames;
+    stats->finePercent  = fineTotal ? (uint8_t)(fineRows * 100 / fineTotal) : 0;
+    stats->bands        = bandLimit < bandPool.size() ? bandLimit : (bandPool.size() ? bandPool.size() : 1);
+    stats->splitFrames  = splitFrames;
+    stats->splitUs      = splitFrames ? (uint32_t)(splitTotal / splitFrames) : 0;
+    stats->singleFrames = singleFrames;
+    stats->singleUs     = singleFrames ? (uint32_t)(singleTotal / singleFrames) : 0;
+    stats->speedup      = stats->splitUs ? (uint16_t)(stats->singleUs * 100 / stats->splitUs) : 0;
+}
+
+void CMotion::resetStats()
+{
+    decodeFrames    = 0;
+    decodeFallbacks = 0;
+    decodeTotal     = 0;
+    decodeMax       = 0;
+    heapOps         = 0;
+
+    prefilterRun        = 0;
+    prefilterChecked    = 0;
+    prefilterSkipped    = 0;
+    prefilterAudits     = 0;
+    prefilterMisses     = 0;
+
+    changeFrames        = 0;
+    triggers            = 0;
+    lastStep            = 0;
+    illumEvents         = 0;
+
+    coarseFrames        = 0;
+    fineFrames          = 0;
+    fineRows            = 0;
+    fineTotal           = 0;
+
+    benchRun            = 0;
+    splitFrames         = 0;
+    splitTotal          = 0;
+    singleFrames        = 0;
+    singleTotal         = 0;
 }
 
 bool CMotion::getMotion()
@@ -183,20 +1419,38 @@ bool CMotion::getMotion()
   return motionStatus;
 }
 
-bool CMotion::fetchMoveMap(uint8_t **out, size_t *out_len)
+bool CMotion::fetchMoveMap(uint8_t* out, size_t outSize, size_t* out_len)
 {
-    // return change map jpeg for streaming               
-    *out = jpgImg;
-    *out_len = jpgImgSize;
+    // copy the change map jpeg out for streaming, only encoded when a newer map was stored. The
+    // buffers go with freeBuffers() and the next encode, so nothing is handed out past the lock
+    bool changed = false;
+    *out_len = 0;
+    xSemaphoreTake(fetchMutex, portMAX_DELAY);
+    if (changeMap && mapSeq != jpgSeq) {
+        changed = encodeMap();
+    }
+    if (jpgBuf[jpgFront] && jpgLen[jpgFront]) {
+        if (jpgLen[jpgFront] <= outSize) {
+            memcpy(out, jpgBuf[jpgFront], jpgLen[jpgFront]);
+            *out_len = jpgLen[jpgFront];
+        }
+        else {
+            ESP_LOGW(CMOT_TAG, "fetchMoveMap: Map [%u] bytes does not fit [%u]", jpgLen[jpgFront], outSize);
+        }
+    }
+    xSemaphoreGive(fetchMutex);
 
-    if (lastImgLen != jpgImgSize) {
-        // image changed
-        lastImgLen = jpgImgSize;
+    return changed;
+}
 
-        return true;
-    }
-  
-    return false;
+size_t CMotion::getMoveMapSize()
+{
+    // largest jpeg fetchMoveMap() can return at the current size, 0 when debugging is off
+    xSemaphoreTake(fetchMutex, portMAX_DELAY);
+    size_t size = jpgImgCap;
+    xSemaphoreGive(fetchMutex);
+
+    return size;
 }
 
 bool CMotion::isNight(uint8_t nightSwitch)
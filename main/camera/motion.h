@@ -1,9 +1,145 @@
 #ifndef MOTION_H
 #define MOTION_H
 
+#include <atomic>
 #include "globals.h"
+#include "jpgluma.h"
+#include "motionkernel.h"
+#include "prefilter.h"
+#include "bandpool.h"
 
-#define MAX_IMAGE_SIZE  32*1024
+#define MAX_IMAGE_SIZE  32*1024 // largest region of interest in pixels
+#define MOT_JPG_HEADER  1024    // debug jpeg room on top of one byte per pixel
+
+#define MOT_BG_RATE_SHIFT   4   // default background learning rate, 1/16 of the way to each frame
+#define MOT_BG_MAX_SHIFT    8
+#define MOT_BG_DEV_MULT     3   // adaptive threshold in mean absolute deviations
+
+#define MOT_GRID_MAX_COLS   8
+#define MOT_GRID_MAX_ROWS   8
+#define MOT_GRID_CELLS      (MOT_GRID_MAX_COLS * MOT_GRID_MAX_ROWS) // one bit each in the cell bitmap
+
+#define MOT_BOX_TRIM_SHIFT  5   // area >> this changed pixels are left outside each edge of the box so stray noise does not stretch it
+
+#define MOT_AUTO_BINS       64  // pixel differences, the last bin holds everything larger
+#define MOT_AUTO_STRIDE     4   // every nth pixel goes into the difference histogram
+#define MOT_AUTO_PERCENTILE 99  // of quiet frame differences and changed fractions
+#define MOT_AUTO_MARGIN     2   // added to the difference percentile for the change threshold
+#define MOT_AUTO_MIN        5
+#define MOT_AUTO_MAX        60
+#define MOT_AUTO_MAX_MOVE   50  // percent of a cell
+#define MOT_AUTO_WARMUP     32  // quiet frames before the first update
+#define MOT_AUTO_UPDATE     16  // quiet frames between updates
+#define MOT_AUTO_WINDOW     256 // quiet frames between halving the histograms
+#define MOT_AUTO_STUCK      50  // frames in a row with change before they are learnt from anyway
+
+#define MOT_ILLUM_STEP      6   // mean brightness change, in gray levels, matched out of the reference as a lighting change
+#define MOT_ILLUM_MIN_GAIN  0.5f
+#define MOT_ILLUM_MAX_GAIN  2.0f
+
+#define MOT_CASCADE_PRE     1   // percent of the coarse region of interest that has to change before the fine decode
+#define MOT_CASCADE_MARGIN  1   // coarse rows either side of the changed ones decoded at the fine scale
+#define MOT_CASCADE_REFRESH 16  // quiet coarse frames between full fine passes, keeps backgrounds and thresholds learning
+
+#define MOT_BAND_MIN_ROWS   8   // rows each band needs before the fine window is split
+#define MOT_BAND_BENCH      32  // every nth split frame runs on one task to measure the speedup
+#define MOT_BAND_COEFS      16  // coefficients kept per block on average for a split frame, more falls back to one task
+
+//coarse pass results
+#define MOT_COARSE_QUIET    0   // nothing changed, no fine decode
+#define MOT_COARSE_CHANGED  1   // fine decode of the changed rows
+#define MOT_COARSE_FULL     2   // fine decode of the whole region of interest
+#define MOT_COARSE_NONE     3   // no 1/8 image, fine decode of the whole region of interest
+
+//count heap operations made by checkMotion, needs CONFIG_HEAP_USE_HOOKS
+//#define MOTION_HEAP_AUDIT
+
+//how frames are turned into grayscale for comparison
+typedef enum {
+    MOT_DECODE_RGB,     // esp_jpg_decode to RGB888 then averaged to gray
+    MOT_DECODE_LUMA     // Y channel only, falls back to RGB for jpegs it can't handle
+} CMotionDecoder;
+
+//what each frame is compared against
+typedef enum {
+    MOT_MODEL_FRAME,    // the previous frame
+    MOT_MODEL_AVERAGE,  // running average background, fixed threshold
+    MOT_MODEL_ADAPTIVE  // running average background, threshold raised for noisy pixels
+} CMotionModel;
+
+//region of interest split into cols x rows cells, cell = row * cols + col
+typedef struct {
+    uint8_t     cols;
+    uint8_t     rows;
+    uint64_t    mask;                           // enabled cells
+    uint8_t     sensitivity[MOT_GRID_CELLS];    // 1 - 10 like motionVal, 0 uses motionVal
+} CMotionGrid;
+
+//pixels of one enabled cell in every image row of its grid row
+typedef struct {
+    uint16_t    start;
+    uint16_t    length;
+    uint8_t     cell;
+} CMotionSpan;
+
+//where the change was in the last compared frame, in frame pixels
+typedef struct {
+    uint16_t    x;
+    uint16_t    y;
+    uint16_t    width;
+    uint16_t    height;
+    uint16_t    centerX;
+    uint16_t    centerY;
+    uint32_t    area;           // changed pixels scaled to the frame, 0 when nothing changed
+} CMotionBox;
+
+//one horizontal band of the fine decode and compare, each worker has its own accumulators
+typedef struct {
+    uint16_t    rowStart;       // region of interest rows, [rowStart, rowEnd)
+    uint16_t    rowEnd;
+    uint8_t*    bits;           // change bits from rowStart on
+    uint8_t*    spanBits;
+    uint16_t*   colCount;
+    CMotionDiff diff;
+    CMotionBlob blob;
+    uint32_t    cellChanged[MOT_GRID_CELLS];
+    bool        decoded;
+} CMotionBand;
+
+typedef struct {
+    uint8_t     decoder;
+    uint32_t    frames;
+    uint32_t    fallbacks;
+    uint32_t    avgDecodeUs;
+    uint32_t    maxDecodeUs;
+    uint32_t    heapOps;        // mallocs and frees inside checkMotion, UINT32_MAX when not audited
+    uint8_t     prefilter;
+    uint32_t    checked;        // frames seen by the prefilter
+    uint32_t    skipped;        // decodes it avoided
+    uint32_t    audits;         // skippable frames decoded anyway
+    uint32_t    misses;         // audits that found movement
+    uint8_t     model;
+    uint8_t     rateShift;
+    uint32_t    changeFrames;   // frames over the movement threshold
+    uint32_t    triggers;       // motion starts, on a still replay every one is false
+    uint8_t     autoTune;
+    uint8_t     threshold;      // change threshold in use
+    uint8_t     movePercent;    // of the enabled pixels, cells with their own sensitivity excepted
+    uint32_t    quietFrames;    // frames learnt from by the auto threshold
+    uint8_t     illumination;
+    int16_t     lastStep;       // mean brightness change of the last frame against its reference
+    uint32_t    illumEvents;    // lighting changes that were not motion once compensated
+    uint8_t     cascade;
+    uint32_t    coarseFrames;   // frames settled by the 1/8 pass alone
+    uint32_t    fineFrames;     // frames the 1/8 pass sent on to the fine decode
+    uint8_t     finePercent;    // of the region of interest rows decoded by those fine passes
+    uint8_t     bands;          // most bands a frame is split into, 1 runs on the motion task alone
+    uint32_t    splitFrames;
+    uint32_t    splitUs;        // average decode and compare time of a split frame
+    uint32_t    singleFrames;   // split frames run on one task instead for comparison
+    uint32_t    singleUs;
+    uint16_t    speedup;        // singleUs / splitUs x 100
+} CMotionStats;
 
 class CMotion {
   public:
@@ -14,10 +150,54 @@ class CMotion {
     void        setDetectionParameters(uint32_t motionFrames, uint32_t nightFrames, uint32_t threshold);
     bool        checkMotion(camera_fb_t* fb);
     bool        getMotion();
-    bool        fetchMoveMap(uint8_t **out, size_t *out_len);
+    bool        fetchMoveMap(uint8_t* out, size_t outSize, size_t* out_len);
+    size_t      getMoveMapSize();
     bool        isNight(uint8_t nightSwitch);
+    void        setDecoder(CMotionDecoder newDecoder);
+    void        setPrefilter(bool enable);
+    void        setModel(CMotionModel newModel, uint8_t newRateShift);
+    bool        setGrid(const CMotionGrid* newGrid);
+    void        getGrid(CMotionGrid* out);
+    uint64_t    getCells();
+    uint8_t     getLightLevel();
+    void        getBox(CMotionBox* out);
+    void        setAutoThreshold(bool enable);
+    void        setIllumination(bool enable);
+    void        setCascade(bool enable);
+    void        setBands(uint8_t count);
+    void        setDebug(bool enable);
+    int         startWorkers();
+    void        stopWorkers();
+    void        getStats(CMotionStats* stats);
+    void        resetStats();
     
   private:
+    bool        compareFrame(camera_fb_t* fb);
+    bool        decodeFrame(camera_fb_t* fb, jpg_scale_t scale, uint16_t startRow, uint16_t endRow, uint32_t width, uint8_t* out, uint32_t outSize, uint32_t* decodeUs);
+    void        countDecode(uint32_t decodeUs);
+    void        getRegion(uint32_t* sampleWidth, uint16_t* startRow, uint16_t* endRow);
+    void        getCoarseRegion(uint32_t* width, uint16_t* startRow, uint16_t* endRow);
+    bool        useCascade();
+    int         coarsePass(camera_fb_t* fb, uint16_t startRow, uint16_t height, uint32_t* decodeUs, uint16_t* winStart, uint16_t* winEnd);
+    void        updateStatus(uint64_t cellBits);
+    void        compileGrid();
+    void        diffSpan(const uint8_t* cur, uint32_t offset, uint32_t count, uint8_t* bits, CMotionDiff* result);
+    void        diffBand(const uint8_t* cur, uint32_t sampleWidth, CMotionBand* band);
+    uint8_t     splitBands(uint32_t sampleWidth, uint16_t startRow, uint16_t winStart, uint16_t winEnd, uint8_t count);
+    static void decodeBandJob(void* arg, uint8_t index);
+    static void diffBandJob(void* arg, uint8_t index);
+    void        paintCells(uint8_t* map, uint64_t cells, uint32_t sampleWidth);
+    void        storeMap(uint64_t cellBits, uint32_t sampleWidth);
+    bool        encodeMap();
+    void        updateBox(uint32_t sampleWidth, uint16_t startRow, uint16_t endRow);
+    void        sampleDiffs(const uint8_t* cur, uint32_t count);
+    bool        compensate(const uint8_t* cur, uint32_t offset, uint32_t count);
+    void        learnThresholds(uint32_t changed, uint64_t cellBits);
+    uint32_t    learntThreshold();
+    bool        sizeBuffers();
+    void        freeBuffers();
+    static size_t writeJpg(void* arg, size_t index, const void* data, size_t len);
+
     int         detectMotionFrames;
     int         detectNightFrames;
     int         detectNumBands;
@@ -28,7 +208,6 @@ class CMotion {
     uint8_t     lightLevel;
     uint8_t     nightSwitch;
     float       motionVal;
-    size_t      jpgImgSize;
 
     uint32_t    scaleFactor;
     uint32_t    sampleRate;
@@ -37,16 +216,121 @@ class CMotion {
     
     bool        dbgMotion;
     bool        motionStatus;
+    bool        prevValid;
 
     uint32_t    motionCnt;
-    size_t      lastImgLen;
 
     bool        nightTime;
     uint16_t    nightCnt;
 
-    uint8_t*    changeMap;
     uint8_t*    prevBuf;
-    uint8_t*    jpgImg;
+    uint8_t*    lumaBuf;
+    uint8_t*    changeBits;
+    uint16_t*   background;     // 8.8 running average
+    uint16_t*   deviation;      // 8.8 running mean absolute difference
+    uint32_t    bufPixels;      // region of interest the buffers were sized for
+    uint32_t    bufWidth;
+    uint32_t    bufCoarse;      // 1/8 region of interest, 0 without the cascade
+
+    // debug map, stored every frame as bits and only made into a jpeg when it is fetched
+    uint8_t*            changeMap;      // 1 bit per pixel of the region of interest
+    uint64_t            mapCells;
+    bool                mapWhole;
+    uint32_t            mapSeq;         // maps stored
+    uint32_t            mapPixels;
+    uint32_t            mapWidth;
+    uint8_t*            mapGray;        // the map expanded for the encoder
+    uint8_t*            jpgBuf[2];      // a failed encode leaves the last good map in the front one
+    size_t              jpgLen[2];
+    uint8_t             jpgFront;
+    uint32_t            jpgSeq;         // map in the front jpeg
+    uint8_t*            jpgImg;         // jpeg being written
+    size_t              jpgImgCap;
+    size_t              jpgWritten;
+    bool                jpgOverflow;
+    SemaphoreHandle_t   mapMutex;       // changeMap and what goes with it
+    SemaphoreHandle_t   fetchMutex;     // the debug buffers while a fetch uses them
+
+    CJpegLuma       lumaDecoder;
+    CMotionDecoder  decoder;
+    uint32_t        decodeFrames;
+    uint32_t        decodeFallbacks;
+    uint64_t        decodeTotal;
+    uint32_t        decodeMax;
+    uint32_t        heapOps;
+
+    CMotionPrefilter    prefilter;
+    bool                prefilterOn;
+    uint32_t            prefilterRun;
+    uint32_t            prefilterChecked;
+    uint32_t            prefilterSkipped;
+    uint32_t            prefilterAudits;
+    uint32_t            prefilterMisses;
+
+    CMotionModel        model;
+    uint8_t             rateShift;
+    uint32_t            changeFrames;
+    uint32_t            triggers;
+
+    CMotionGrid         grid;
+    bool                gridWhole;      // one enabled cell, the image is compared in a single pass
+    uint32_t            gridPixels;     // enabled pixels
+    uint16_t            gridRowStart[MOT_GRID_MAX_ROWS + 1];
+    uint8_t             spanCount[MOT_GRID_MAX_ROWS];
+    CMotionSpan         spans[MOT_GRID_MAX_ROWS][MOT_GRID_MAX_COLS];
+    uint32_t            cellLimit[MOT_GRID_CELLS];
+    uint32_t            cellChanged[MOT_GRID_CELLS];
+    std::atomic<uint64_t> cells;
+
+    uint16_t*           colCount;       // changed pixels in each column and row of the region of interest
+    uint16_t*           rowCount;
+    uint8_t*            spanBits;       // change bits of one grid span
+    CMotionBlob         blob;
+    CMotionBox          box;
+    portMUX_TYPE        boxLock;
+
+    bool                autoOn;
+    int                 manualThreshold;
+    uint8_t             movePercent;
+    uint32_t            autoFrames;
+    uint32_t            autoBusy;
+    uint32_t            frameHist[MOT_AUTO_BINS];   // this frame, added to diffHist only if it was quiet
+    uint32_t            diffHist[MOT_AUTO_BINS];
+    uint32_t            fracHist[101];              // changed percent of quiet frames
+
+    bool                illumOn;
+    int16_t             lastStep;
+    uint32_t            illumEvents;
+    uint8_t             illumLut[256];
+
+    bool                cascadeOn;
+    uint8_t*            coarseCur;      // 1/8 gray image of the region of interest
+    uint8_t*            coarseRef;      // as it was when the fine reference last saw those rows
+    uint8_t*            coarseBits;
+    bool                coarseValid;
+    uint32_t            coarseRun;      // quiet coarse frames since the last full fine pass
+    uint16_t            coarseRows;
+    uint16_t            coarseFirst;    // changed coarse rows, margin included
+    uint16_t            coarseLast;
+    uint32_t            coarseFrames;
+    uint32_t            fineFrames;
+    uint64_t            fineRows;
+    uint64_t            fineTotal;      // rows the fine passes could have decoded
+
+    CBandPool           bandPool;
+    uint8_t             bandLimit;
+    uint8_t             bandCount;      // bands of the last frame
+    CMotionBand         bands[BAND_MAX_WORKERS];
+    CJpegLuma           bandDecoder[BAND_MAX_WORKERS];
+    CJpegCoefs          bandCoefs;      // the window entropy decoded once, each band does its own IDCT
+    uint16_t*           bandCols;       // column projections of the bands after the first
+    uint16_t            bandStartRow;
+    uint32_t            bandWidth;
+    uint32_t            benchRun;
+    uint32_t            splitFrames;
+    uint64_t            splitTotal;
+    uint32_t            singleFrames;
+    uint64_t            singleTotal;
 };
 
 #endif
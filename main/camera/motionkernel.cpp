@@ -0,0 +1,254 @@
+#include <string.h>
+#include "motionkernel.h"
+
+#define CMK_TAG "MotionKernel"
+
+#define LANE_HIGH   0x80808080
+#define LANE_LOW    0x01010101
+#define LANE_EVEN   0x00FF00FF
+
+// pixels per nibble index
+static const uint8_t nibbleCount[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+static inline uint32_t load32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, 4);
+
+    return value;
+}
+
+// high bit of every byte lane where a < b, no borrow crosses lanes
+static inline uint32_t laneBorrow(uint32_t a, uint32_t b)
+{
+    uint32_t diff = (a | LANE_HIGH) - (b & ~LANE_HIGH);
+    diff ^= (a ^ ~b) & LANE_HIGH;
+
+    return ((~a & b) | (~(a ^ b) & diff)) & LANE_HIGH;
+}
+
+// nibble of 4 flags, one per byte lane, from the lane high bits
+static inline uint32_t laneBits(uint32_t high)
+{
+    return (((high >> 7) * 0x01020408) >> 24) & 0x0F;
+}
+
+// changed lanes of 4 pixels as a nibble
+static inline uint32_t diffWord(uint32_t a, uint32_t b, uint32_t limit)
+{
+    // per lane a - b, negated in the lanes that borrowed gives |a - b|
+    uint32_t diff = (a | LANE_HIGH) - (b & ~LANE_HIGH);
+    diff ^= (a ^ ~b) & LANE_HIGH;
+    uint32_t neg = (laneBorrow(a, b) >> 7) * 0xFF;
+    uint32_t absDiff = (diff ^ neg) + (neg & LANE_LOW);
+
+    // |a - b| > threshold is |a - b| >= threshold + 1, no borrow
+    return laneBits(~laneBorrow(absDiff, limit) & LANE_HIGH);
+}
+
+void motionDiff(const uint8_t* cur, const uint8_t* prev, uint32_t count, uint8_t threshold, uint8_t* changeBits, CMotionDiff* result)
+{
+    uint32_t changed = 0;
+    uint32_t lux = 0;
+    uint32_t i = 0;
+
+    // a threshold of 255 can never be exceeded, the lane compare needs threshold + 1 to fit a byte
+    if (threshold == 255) {
+        for (; i < count; i++) lux += cur[i];
+        if (changeBits) memset(changeBits, 0, (count + 7) >> 3);
+        result->changed = 0;
+        result->lux     = lux;
+
+        return;
+    }
+
+    uint32_t limit = (threshold + 1) * LANE_LOW;
+
+    // 8 pixels, one change byte, per pass. Lux is summed in 16 bit lanes
+    // which are folded before they can overflow
+    uint32_t luxLanes = 0;
+    uint32_t lanePasses = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint32_t a0 = load32(cur + i);
+        uint32_t a1 = load32(cur + i + 4);
+
+        uint32_t bits = diffWord(a0, load32(prev + i), limit) | (diffWord(a1, load32(prev + i + 4), limit) << 4);
+        changed += nibbleCount[bits & 0x0F] + nibbleCount[bits >> 4];
+        if (changeBits) {
+            changeBits[i >> 3] = bits;
+        }
+
+        luxLanes += (a0 & LANE_EVEN) + ((a0 >> 8) & LANE_EVEN) + (a1 & LANE_EVEN) + ((a1 >> 8) & LANE_EVEN);
+        if (++lanePasses == 64) {
+            lux += (luxLanes & 0xFFFF) + (luxLanes >> 16);
+            luxLanes = 0;
+            lanePasses = 0;
+        }
+    }
+    lux += (luxLanes & 0xFFFF) + (luxLanes >> 16);
+
+    // tail
+    if (i < count) {
+        uint8_t bits = 0;
+        for (uint32_t bit = 0; i < count; i++, bit++) {
+            if (abs((int)cur[i] - (int)prev[i]) > threshold) {
+                bits |= 1 << bit;
+                changed++;
+            }
+            lux += cur[i];
+        }
+        if (changeBits) {
+            changeBits[(count - 1) >> 3] = bits;
+        }
+    }
+
+    result->changed = changed;
+    result->lux     = lux;
+
+#ifdef MOTION_KERNEL_VERIFY
+    CMotionDiff check;
+    motionDiffScalar(cur, prev, count, threshold, NULL, &check);
+    if (check.changed != result->changed || check.lux != result->lux) {
+        ESP_LOGE(CMK_TAG, "motionDiff: Mismatch changed %lu/%lu lux %lu/%lu", result->changed, check.changed, result->lux, check.lux);
+    }
+#endif
+}
+
+void motionDiffScalar(const uint8_t* cur, const uint8_t* prev, uint32_t count, uint8_t threshold, uint8_t* changeBits, CMotionDiff* result)
+{
+    uint32_t changed = 0;
+    uint32_t lux = 0;
+
+    if (changeBits) {
+        memset(changeBits, 0, (count + 7) >> 3);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (abs((int)cur[i] - (int)prev[i]) > threshold) {
+            changed++;
+            if (changeBits) changeBits[i >> 3] |= 1 << (i & 7);
+        }
+        lux += cur[i];
+    }
+
+    result->changed = changed;
+    result->lux     = lux;
+}
+
+void motionBackground(const uint8_t* cur, uint16_t* background, uint16_t* deviation, uint32_t count, uint8_t threshold, uint8_t rateShift, uint8_t devMult, uint8_t* changeBits, CMotionDiff* result)
+{
+    uint32_t changed = 0;
+    uint32_t lux = 0;
+    int32_t base = threshold << 8;
+
+    if (changeBits) {
+        memset(changeBits, 0, (count + 7) >> 3);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t pixel = cur[i] << 8;
+        int32_t back = background[i];
+        int32_t diff = abs(pixel - back);
+
+        int32_t limit = base;
+        if (deviation) {
+            int32_t dev = deviation[i];
+            if (dev * devMult > limit) {
+                limit = dev * devMult;
+            }
+            // only unchanged pixels teach the deviation, a subject passing
+            // through must not raise the threshold that detects it
+            if (diff <= limit) {
+                deviation[i] = dev + ((diff - dev) >> rateShift);
+            }
+        }
+
+        if (diff > limit) {
+            changed++;
+            if (changeBits) changeBits[i >> 3] |= 1 << (i & 7);
+        }
+
+        background[i] = back + ((pixel - back) >> rateShift);
+        lux += cur[i];
+    }
+
+    result->changed = changed;
+    result->lux     = lux;
+}
+
+void motionBackgroundInit(const uint8_t* cur, uint16_t* background, uint16_t* deviation, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        background[i] = cur[i] << 8;
+    }
+
+    if (deviation) {
+        memset(deviation, 0, count * sizeof(uint16_t));
+    }
+}
+
+void motionBlobAdd(const uint8_t* changeBits, uint32_t count, uint32_t start, uint32_t width, uint16_t* colCount, uint16_t* rowCount, CMotionBlob* blob)
+{
+    uint32_t bytes = (count + 7) >> 3;
+    for (uint32_t k = 0; k < bytes; k++) {
+        uint32_t bits = changeBits[k];
+        if (!bits) {
+            continue;
+        }
+
+        // the last byte may have bits past count
+        if ((k << 3) + 8 > count) {
+            bits &= (1 << (count - (k << 3))) - 1;
+        }
+
+        while (bits) {
+            uint32_t pixel = start + (k << 3) + __builtin_ctz(bits);
+            uint32_t y = pixel / width;
+            uint32_t x = pixel - y * width;
+            bits &= bits - 1;
+
+            colCount[x]++;
+            rowCount[y]++;
+            blob->area++;
+            blob->sumX += x;
+            blob->sumY += y;
+        }
+    }
+}
+
+void motionMoments(const uint8_t* cur, const uint8_t* prev, const uint16_t* background, uint32_t count, CMotionMoments* result)
+{
+    uint32_t sum = 0;
+    uint64_t sumSq = 0;
+    uint64_t refSum = 0;
+    uint64_t refSumSq = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t pixel = cur[i];
+        uint32_t ref = prev ? prev[i] : background[i];
+        sum += pixel;
+        sumSq += pixel * pixel;
+        refSum += ref;
+        refSumSq += (uint64_t)ref * ref;
+    }
+
+    result->sum         = sum;
+    result->sumSq       = sumSq;
+    result->refSum      = refSum;
+    result->refSumSq    = refSumSq;
+}
+
+void motionRemap(uint8_t* prev, uint32_t count, const uint8_t* lut)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        prev[i] = lut[prev[i]];
+    }
+}
+
+void motionRemapBackground(uint16_t* background, uint32_t count, int32_t refMean, int32_t gain, int32_t mean)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t value = (((int32_t)background[i] - refMean) * gain >> 8) + mean;
+        background[i] = value < 0 ? 0 : value > 0xFF00 ? 0xFF00 : value;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef MOTIONKERNEL_H
+#define MOTIONKERNEL_H
+
+#include "globals.h"
+
+//Check every SWAR result against the scalar kernel and log mismatches
+//#define MOTION_KERNEL_VERIFY
+
+typedef struct {
+    uint32_t    changed;    // pixels that differ by more than the threshold
+    uint32_t    lux;        // sum of the current pixels
+} CMotionDiff;
+
+typedef struct {
+    uint64_t    sum;        // current image
+    uint64_t    sumSq;
+    uint64_t    refSum;     // reference, in 8.8 for a background
+    uint64_t    refSumSq;
+} CMotionMoments;
+
+typedef struct {
+    uint32_t    area;       // changed pixels
+    uint32_t    sumX;
+    uint32_t    sumY;
+} CMotionBlob;
+
+// compares count pixels of the current and previous gray images in one pass, pixel i
+// sets bit (i & 7) of changeBits[i >> 3] when it changed, changeBits may be NULL
+void motionDiff(const uint8_t* cur, const uint8_t* prev, uint32_t count, uint8_t threshold, uint8_t* changeBits, CMotionDiff* result);
+
+// byte at a time reference for the above
+void motionDiffScalar(const uint8_t* cur, const uint8_t* prev, uint32_t count, uint8_t threshold, uint8_t* changeBits, CMotionDiff* result);
+
+// compares count pixels against a running average background kept in 8.8 fixed point and moves
+// it 1 / (1 << rateShift) of the way to the current image in the same pass. When deviation is
+// given it holds the running mean absolute difference, also 8.8, and a pixel only counts as
+// changed beyond devMult times that, so noisy pixels get a higher threshold than still ones
+void motionBackground(const uint8_t* cur, uint16_t* background, uint16_t* deviation, uint32_t count, uint8_t threshold, uint8_t rateShift, uint8_t devMult, uint8_t* changeBits, CMotionDiff* result);
+
+// adds the changed pixels of count change bits to the blob and the column and row projections,
+// bit 0 is pixel start of an image width pixels wide. Only set bits are visited
+void motionBlobAdd(const uint8_t* changeBits, uint32_t count, uint32_t start, uint32_t width, uint16_t* colCount, uint16_t* rowCount, CMotionBlob* blob);
+
+// sums and squares of the current image and of the reference, either the previous
+// image or a background, in one pass for the global brightness and contrast of both
+void motionMoments(const uint8_t* cur, const uint8_t* prev, const uint16_t* background, uint32_t count, CMotionMoments* result);
+
+// maps every reference pixel through lut, used to match the previous image to the current lighting
+void motionRemap(uint8_t* prev, uint32_t count, const uint8_t* lut);
+
+// moves every background pixel to (back - refMean) * gain + mean, all 8.8
+void motionRemapBackground(uint16_t* background, uint32_t count, int32_t refMean, int32_t gain, int32_t mean);
+
+// starts the background from the current image with no deviation
+void motionBackgroundInit(const uint8_t* cur, uint16_t* background, uint16_t* deviation, uint32_t count);
+
+#endif
@@ -0,0 +1,216 @@
+#include "esp_heap_caps.h"
+#include "prebuffer.h"
+
+#define CPRE_TAG "CPreBuffer"
+
+CPreBuffer::CPreBuffer()
+{
+    arena       = NULL;
+    arenaSize   = 0;
+    windowMs    = PRE_DEFAULT_SECONDS * 1000;
+    writePos    = 0;
+    usedBytes   = 0;
+    frameHead   = 0;
+    frameCnt    = 0;
+    lock        = xSemaphoreCreateMutex();
+}
+
+CPreBuffer::~CPreBuffer()
+{
+    deinit();
+
+    if (lock) {
+        vSemaphoreDelete(lock);
+    }
+}
+
+int CPreBuffer::init(uint32_t seconds, uint32_t byteBudget)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    windowMs    = seconds * 1000;
+    byteBudget  &= ~3;
+
+    // frames are stored once, in PSRAM, and written to the AVI straight from here
+    if (arenaSize != byteBudget) {
+        if (arena) {
+            heap_caps_free(arena);
+            arena       = NULL;
+            arenaSize   = 0;
+        }
+
+        if (byteBudget) {
+            arena = (uint8_t*)heap_caps_malloc(byteBudget, MALLOC_CAP_SPIRAM);
+            if (!arena) {
+                ESP_LOGE(CPRE_TAG, "init: Unable to allocate [%lu] bytes", byteBudget);
+                xSemaphoreGive(lock);
+
+                return PRE_RET_ALLOC_ERROR;
+            }
+            arenaSize = byteBudget;
+        }
+    }
+
+    writePos    = 0;
+    usedBytes   = 0;
+    frameHead   = 0;
+    frameCnt    = 0;
+
+    xSemaphoreGive(lock);
+
+    ESP_LOGI(CPRE_TAG, "init: %lu s, %lu bytes", seconds, byteBudget);
+
+    return PRE_RET_OK;
+}
+
+void CPreBuffer::deinit()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    if (arena) {
+        heap_caps_free(arena);
+        arena = NULL;
+    }
+
+    arenaSize   = 0;
+    writePos    = 0;
+    usedBytes   = 0;
+    frameHead   = 0;
+    frameCnt    = 0;
+
+    xSemaphoreGive(lock);
+}
+
+bool CPreBuffer::isReady()
+{
+    return arena && windowMs;
+}
+
+int CPreBuffer::push(const uint8_t* buf, uint32_t len, uint32_t timeMs)
+{
+    // the capture task must not wait for a drain to reach the card, the frame is dropped instead
+    if (xSemaphoreTake(lock, 0) != pdTRUE) {
+        return PRE_RET_BUSY;
+    }
+
+    if (!isReady()) {
+        xSemaphoreGive(lock);
+
+        return PRE_RET_NOT_READY;
+    }
+
+    if (len > arenaSize) {
+        xSemaphoreGive(lock);
+        ESP_LOGW(CPRE_TAG, "push: Frame too large [%lu]", len);
+
+        return PRE_RET_TOO_LARGE;
+    }
+
+    // expire frames that fall outside the time window
+    while (frameCnt && (timeMs - frames[frameHead].time > windowMs || frameCnt == PRE_MAX_FRAMES)) {
+        dropOldest();
+    }
+
+    // wrap to the start of the arena if the frame does not fit at the end,
+    // everything still stored past the write position is older than what follows
+    if (arenaSize - writePos < len) {
+        while (frameCnt && frames[frameHead].offset >= writePos) {
+            dropOldest();
+        }
+        writePos = 0;
+    }
+
+    // make room by dropping the oldest frames the new one would overwrite
+    while (frameCnt && overlapsOldest(writePos, writePos + len)) {
+        dropOldest();
+    }
+
+    CPreBufferFrame* frame = &frames[(frameHead + frameCnt) % PRE_MAX_FRAMES];
+    frame->offset   = writePos;
+    frame->len      = len;
+    frame->time     = timeMs;
+    memcpy(arena + writePos, buf, len);
+
+    writePos    = (writePos + len + 3) & ~3;
+    usedBytes   += len;
+    frameCnt++;
+
+    xSemaphoreGive(lock);
+
+    return PRE_RET_OK;
+}
+
+void CPreBuffer::clear()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    writePos    = 0;
+    usedBytes   = 0;
+    frameHead   = 0;
+    frameCnt    = 0;
+
+    xSemaphoreGive(lock);
+}
+
+uint32_t CPreBuffer::count()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t frameCount = frameCnt;
+    xSemaphoreGive(lock);
+
+    return frameCount;
+}
+
+uint32_t CPreBuffer::bytes()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t byteCount = usedBytes;
+    xSemaphoreGive(lock);
+
+    return byteCount;
+}
+
+int CPreBuffer::drain(CPreBufferDrain drainFrame, void* arg, uint32_t* drained)
+{
+    // the frames are handed out of the arena itself, so the lock is held until the
+    // last one is written and the ring cleared. A clear, init or deinit from another
+    // task waits for the drain and push drops frames rather than overwrite them
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    int ret = PRE_RET_OK;
+    uint32_t index = 0;
+    for (; index < frameCnt; index++) {
+        CPreBufferFrame* frame = &frames[(frameHead + index) % PRE_MAX_FRAMES];
+        ret = drainFrame(arg, index, arena + frame->offset, frame->len, frame->time);
+        if (ret != PRE_RET_OK) {
+            break;
+        }
+    }
+
+    writePos    = 0;
+    usedBytes   = 0;
+    frameHead   = 0;
+    frameCnt    = 0;
+
+    xSemaphoreGive(lock);
+
+    if (drained) {
+        *drained = index;
+    }
+
+    return ret;
+}
+
+void CPreBuffer::dropOldest()
+{
+    usedBytes -= frames[frameHead].len;
+    frameHead = (frameHead + 1) % PRE_MAX_FRAMES;
+    frameCnt--;
+}
+
+bool CPreBuffer::overlapsOldest(uint32_t start, uint32_t end)
+{
+    CPreBufferFrame* frame = &frames[frameHead];
+
+    return frame->offset < end && frame->offset + frame->len > start;
+}
@@ -0,0 +1,57 @@
+#ifndef PREBUFFER_H
+#define PREBUFFER_H
+
+#include "globals.h"
+
+//Return values
+#define PRE_RET_OK              0
+#define PRE_RET_ALLOC_ERROR     1
+#define PRE_RET_NOT_READY       2
+#define PRE_RET_TOO_LARGE       3
+#define PRE_RET_BUSY            4
+
+#define PRE_DEFAULT_SECONDS     3
+#define PRE_DEFAULT_SHARE       4 // the default budget is 1 / this of the free PSRAM
+#define PRE_MAX_BUDGET          (1024 * 1024) // bytes of PSRAM the default budget is capped at
+#define PRE_MAX_FRAMES          128
+
+typedef struct {
+    uint32_t    offset;
+    uint32_t    len;
+    uint32_t    time;   // capture time [ms]
+} CPreBufferFrame;
+
+// called for every buffered frame, oldest first, while the ring is locked.
+// A non zero return stops the drain and is passed back
+typedef int (*CPreBufferDrain)(void* arg, uint32_t index, const uint8_t* buf, uint32_t len, uint32_t timeMs);
+
+class CPreBuffer {
+public:
+    CPreBuffer();
+    ~CPreBuffer();
+
+    int         init(uint32_t seconds, uint32_t byteBudget);
+    void        deinit();
+    bool        isReady();
+    int         push(const uint8_t* buf, uint32_t len, uint32_t timeMs);
+    void        clear();
+    uint32_t    count();
+    uint32_t    bytes();
+    int         drain(CPreBufferDrain drainFrame, void* arg, uint32_t* drained);
+
+private:
+    void        dropOldest();
+    bool        overlapsOldest(uint32_t start, uint32_t end);
+
+    uint8_t*        arena;
+    uint32_t        arenaSize;
+    uint32_t        windowMs;
+    uint32_t        writePos;
+    uint32_t        usedBytes;
+    CPreBufferFrame frames[PRE_MAX_FRAMES];
+    uint32_t        frameHead;
+    uint32_t        frameCnt;
+    SemaphoreHandle_t lock;
+};
+
+#endif
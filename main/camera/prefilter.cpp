@@ -0,0 +1,180 @@
+#include <string.h>
+#include <stdlib.h>
+#include "prefilter.h"
+
+#define CPRF_TAG "CMotionPrefilter"
+
+CMotionPrefilter::CMotionPrefilter()
+{
+    regionFirst = 0;
+    regionLast  = 0xFFFF;
+
+    reset();
+}
+
+void CMotionPrefilter::setRegion(uint16_t firstRow, uint16_t lastRow)
+{
+    regionFirst = firstRow;
+    regionLast  = lastRow;
+
+    reset();
+}
+
+void CMotionPrefilter::reset()
+{
+    mcusPerRow  = 0;
+    interval    = 0;
+    rowFirst    = 0;
+    rowCount    = 0;
+    binCount    = 0;
+    baseBins    = 0;
+    baseFrames  = 0;
+}
+
+bool CMotionPrefilter::unchanged(const uint8_t* src, size_t len)
+{
+    if (!profile(src, len)) {
+        reset();
+
+        return false;
+    }
+
+    // a different layout, ie a new frame size or restart interval, starts a new baseline
+    if (binCount != baseBins) {
+        baseBins    = binCount;
+        baseFrames  = 0;
+    }
+
+    bool same = baseFrames >= PRF_WARMUP;
+    for (uint16_t i = 0; i < binCount; i++) {
+        int32_t value = (int32_t)bins[i] << PRF_FIXED_SHIFT;
+        if (!baseFrames) {
+            mean[i] = value;
+            dev[i]  = 0;
+
+            continue;
+        }
+
+        int32_t diff = abs(value - mean[i]);
+        if (diff > PRF_DEV_MULT * dev[i] + (mean[i] >> PRF_MIN_SHIFT)) {
+            same = false;
+        }
+
+        mean[i] += (value - mean[i]) >> PRF_ALPHA_SHIFT;
+        dev[i]  += (diff - dev[i]) >> PRF_ALPHA_SHIFT;
+    }
+    baseFrames++;
+
+    return same;
+}
+
+bool CMotionPrefilter::profile(const uint8_t* src, size_t len)
+{
+    if (len < 4 || src[0] != 0xFF || src[1] != 0xD8) {
+        return false;
+    }
+
+    // walk the marker segments to the start of scan
+    uint16_t width  = 0;
+    uint16_t height = 0;
+    uint8_t hMax    = 1;
+    uint8_t vMax    = 1;
+    interval        = 0;
+    size_t pos      = 2;
+    bool scan       = false;
+    while (!scan && pos + 4 <= len) {
+        if (src[pos] != 0xFF) {
+            return false;
+        }
+
+        uint8_t marker = src[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+
+            continue;
+        }
+
+        uint16_t segLen = (src[pos + 2] << 8) | src[pos + 3];
+        const uint8_t* seg = src + pos + 4;
+        if (segLen < 2 || pos + 2 + segLen > len) {
+            return false;
+        }
+
+        if (marker >= 0xC0 && marker <= 0xC2) {
+            if (segLen < 8 || segLen < 8 + 3 * seg[5]) {
+                return false;
+            }
+            height  = (seg[1] << 8) | seg[2];
+            width   = (seg[3] << 8) | seg[4];
+            for (uint8_t i = 0; i < seg[5]; i++) {
+                uint8_t h = seg[6 + 3 * i + 1] >> 4;
+                uint8_t v = seg[6 + 3 * i + 1] & 0x0F;
+                hMax = h > hMax ? h : hMax;
+                vMax = v > vMax ? v : vMax;
+            }
+        }
+        else if (marker == 0xDD && segLen >= 4) {
+            interval = (seg[0] << 8) | seg[1];
+        }
+        else if (marker == 0xDA) {
+            scan = true;
+        }
+
+        pos += 2 + segLen;
+    }
+
+    if (!scan || !width || !height) {
+        return false;
+    }
+
+    // without restart markers only the total size says anything
+    if (!interval) {
+        binCount    = 1;
+        bins[0]     = len;
+
+        return true;
+    }
+
+    uint16_t mcuRows    = (height + 8 * vMax - 1) / (8 * vMax);
+    uint16_t lastRow    = (regionLast + 8 * vMax - 1) / (8 * vMax);
+    mcusPerRow          = (width + 8 * hMax - 1) / (8 * hMax);
+    rowFirst            = regionFirst / (8 * vMax);
+    rowCount            = (lastRow < mcuRows ? lastRow : mcuRows) - rowFirst;
+    if (rowFirst >= mcuRows || !rowCount) {
+        return false;
+    }
+    binCount = rowCount < PRF_MAX_BINS ? rowCount : PRF_MAX_BINS;
+    memset(bins, 0, sizeof(bins[0]) * binCount);
+
+    // bytes between restart markers, 0xFF00 stuffing and 0xFFFF fill are skipped by the marker check
+    const uint8_t* end      = src + len;
+    const uint8_t* p        = src + pos;
+    const uint8_t* segStart = p;
+    uint32_t segment        = 0;
+    while (p + 1 < end && (p = (const uint8_t*)memchr(p, 0xFF, end - p - 1)) != NULL) {
+        uint8_t marker = p[1];
+        if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0xD9) {
+            addSegment(segment++, p - segStart);
+            segStart = p + 2;
+
+            if (marker == 0xD9) {
+                break;
+            }
+        }
+
+        p += marker == 0xFF ? 1 : 2;
+    }
+
+    return true;
+}
+
+void CMotionPrefilter::addSegment(uint32_t segment, uint32_t bytes)
+{
+    // a segment is counted against the MCU row it starts in
+    uint32_t row = segment * interval / mcusPerRow;
+    if (row < rowFirst || row >= rowFirst + rowCount) {
+        return;
+    }
+
+    bins[(row - rowFirst) * binCount / rowCount] += bytes;
+}
@@ -0,0 +1,46 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include "globals.h"
+
+#define PRF_MAX_BINS        64  // restart segments in the region of interest are summed into at most this many bins
+#define PRF_WARMUP          8   // frames of baseline before anything is called unchanged
+#define PRF_ALPHA_SHIFT     3   // baseline follows each bin with weight 1/8
+#define PRF_FIXED_SHIFT     4   // baseline mean and deviation are kept in 1/16 bytes
+#define PRF_DEV_MULT        3   // a bin is unchanged within this many mean deviations
+#define PRF_MIN_SHIFT       5   // plus 1/32 of its mean, so a perfectly still scene has some slack
+#define PRF_AUDIT_EVERY     8   // every nth skippable frame is decoded anyway to measure misses
+
+// compressed domain motion prefilter, a still scene gives jpegs whose size and
+// bytes per restart interval hardly change. Frames from the sensor carry a DRI
+// so the entropy coded bytes of every MCU row in the region of interest can be
+// found with a marker scan, without one only the total size is compared
+class CMotionPrefilter {
+public:
+    CMotionPrefilter();
+
+    void        setRegion(uint16_t firstRow, uint16_t lastRow);
+    void        reset();
+    bool        unchanged(const uint8_t* src, size_t len);
+
+private:
+    bool        profile(const uint8_t* src, size_t len);
+    void        addSegment(uint32_t segment, uint32_t bytes);
+
+    uint16_t    regionFirst;    // region of interest in image rows
+    uint16_t    regionLast;
+
+    uint16_t    mcusPerRow;
+    uint16_t    interval;
+    uint16_t    rowFirst;       // region of interest in MCU rows
+    uint16_t    rowCount;
+
+    uint16_t    binCount;
+    uint16_t    baseBins;
+    uint32_t    baseFrames;
+    uint32_t    bins[PRF_MAX_BINS];
+    int32_t     mean[PRF_MAX_BINS];
+    int32_t     dev[PRF_MAX_BINS];
+};
+
+#endif
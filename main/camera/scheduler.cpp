@@ -0,0 +1,238 @@
+#include <math.h>
+#include "scheduler.h"
+
+#define CSCH_TAG "CFrameScheduler"
+
+CFrameScheduler::CFrameScheduler()
+{
+    timer           = NULL;
+    triggerQueue    = NULL;
+    statsLock       = portMUX_INITIALIZER_UNLOCKED;
+    running         = false;
+    frameInterval   = 1000000;
+    jitterBudget    = SCH_JITTER_BUDGET_US;
+    startTime       = 0;
+    lastFrame       = 0;
+
+    resetStats();
+}
+
+CFrameScheduler::~CFrameScheduler()
+{
+    stop();
+
+    if (timer) {
+        esp_timer_delete(timer);
+    }
+}
+
+int CFrameScheduler::start(QueueHandle_t queue)
+{
+    stop();
+
+    if (!queue) {
+        ESP_LOGE(CSCH_TAG, "start: Invalid trigger queue");
+
+        return SCH_RET_INVALID;
+    }
+
+    if (!timer) {
+        esp_timer_create_args_t timerArgs = {};
+        timerArgs.callback          = timerCallback;
+        timerArgs.arg               = this;
+        timerArgs.dispatch_method   = ESP_TIMER_TASK;
+        timerArgs.name              = "frameScheduler";
+
+        if (esp_timer_create(&timerArgs, &timer) != ESP_OK) {
+            ESP_LOGE(CSCH_TAG, "start: Unable to create timer");
+            timer = NULL;
+
+            return SCH_RET_TIMER_FAIL;
+        }
+    }
+
+    triggerQueue = queue;
+    resetStats();
+
+    return startTimer();
+}
+
+int CFrameScheduler::stop()
+{
+    if (running) {
+        esp_timer_stop(timer);
+        running = false;
+
+        ESP_LOGI(CSCH_TAG, "stop: Stopped");
+    }
+
+    return SCH_RET_OK;
+}
+
+bool CFrameScheduler::isRunning()
+{
+    return running;
+}
+
+int CFrameScheduler::setFPS(float fps)
+{
+    if (fps <= 0.0f) {
+        ESP_LOGW(CSCH_TAG, "setFPS: Invalid fps [%0.2f]", fps);
+
+        return SCH_RET_INVALID;
+    }
+
+    return setInterval((uint64_t)llround(1000000.0 / fps));
+}
+
+int CFrameScheduler::setInterval(uint64_t intervalUs)
+{
+    if (intervalUs < SCH_MIN_INTERVAL_US || intervalUs > SCH_MAX_INTERVAL_US) {
+        ESP_LOGW(CSCH_TAG, "setInterval: Invalid interval [%llu us]", intervalUs);
+
+        return SCH_RET_INVALID;
+    }
+
+    portENTER_CRITICAL(&statsLock);
+    frameInterval = intervalUs;
+    portEXIT_CRITICAL(&statsLock);
+
+    //rebase deadlines on the new interval
+    if (running) {
+        esp_timer_stop(timer);
+
+        return startTimer();
+    }
+
+    return SCH_RET_OK;
+}
+
+float CFrameScheduler::getFPS()
+{
+    return 1000000.0f / (float)frameInterval;
+}
+
+uint64_t CFrameScheduler::getInterval()
+{
+    return frameInterval;
+}
+
+void CFrameScheduler::setJitterBudget(uint32_t budgetUs)
+{
+    jitterBudget = budgetUs;
+}
+
+uint32_t CFrameScheduler::reportFrame(const CFrameTrigger* trigger)
+{
+    // how late the frame arrived against its absolute deadline
+    int64_t late = esp_timer_get_time() - trigger->deadline;
+    uint32_t lateUs = late > 0 ? (uint32_t)late : 0;
+
+    portENTER_CRITICAL(&statsLock);
+    frameCount++;
+    lateTotal += lateUs;
+    lateLast = lateUs;
+    if (lateUs > lateMax) lateMax = lateUs;
+    if (lateUs > jitterBudget) lateCount++;
+    portEXIT_CRITICAL(&statsLock);
+
+    ESP_LOGD(CSCH_TAG, "reportFrame: Frame [%lu] late %lu us", trigger->frame, lateUs);
+
+    return lateUs;
+}
+
+void CFrameScheduler::reportMissed(uint32_t count)
+{
+    // triggers the capture task dropped to catch up, they were posted but never became frames
+    portENTER_CRITICAL(&statsLock);
+    missedCount += count;
+    portEXIT_CRITICAL(&statsLock);
+}
+
+void CFrameScheduler::getStats(CSchedulerStats* stats)
+{
+    int64_t elapsed = esp_timer_get_time() - statsTime;
+
+    portENTER_CRITICAL(&statsLock);
+    stats->intervalUs   = frameInterval;
+    stats->triggers     = triggerCount;
+    stats->missed       = missedCount;
+    stats->skipped      = skippedCount;
+    stats->frames       = frameCount;
+    stats->lateFrames   = lateCount;
+    stats->avgLateUs    = frameCount ? (uint32_t)(lateTotal / frameCount) : 0;
+    stats->maxLateUs    = lateMax;
+    stats->lastLateUs   = lateLast;
+    stats->actualFPS    = elapsed > 0 ? (1000000.0f * (float)frameCount) / (float)elapsed : 0.0f;
+    portEXIT_CRITICAL(&statsLock);
+}
+
+void CFrameScheduler::resetStats()
+{
+    portENTER_CRITICAL(&statsLock);
+    triggerCount    = 0;
+    missedCount     = 0;
+    skippedCount    = 0;
+    frameCount      = 0;
+    lateCount       = 0;
+    lateTotal       = 0;
+    lateMax         = 0;
+    lateLast        = 0;
+    statsTime       = esp_timer_get_time();
+    portEXIT_CRITICAL(&statsLock);
+}
+
+int CFrameScheduler::startTimer()
+{
+    // deadlines are absolute: startTime + n * frameInterval
+    // so the time taken by the capture loop never accumulates as drift.
+    // The callback may still run for the old timer, so the base is only
+    // changed under the lock it reads it with
+    portENTER_CRITICAL(&statsLock);
+    lastFrame = 0;
+    startTime = esp_timer_get_time();
+    portEXIT_CRITICAL(&statsLock);
+    if (esp_timer_start_periodic(timer, frameInterval) != ESP_OK) {
+        ESP_LOGE(CSCH_TAG, "startTimer: Unable to start timer");
+        running = false;
+
+        return SCH_RET_TIMER_FAIL;
+    }
+    running = true;
+
+    ESP_LOGI(CSCH_TAG, "startTimer: Interval %llu us (%0.2f fps)", frameInterval, getFPS());
+
+    return SCH_RET_OK;
+}
+
+void CFrameScheduler::timerCallback(void* arg)
+{
+    CFrameScheduler* pScheduler = (CFrameScheduler*)arg;
+
+    // find the most recent deadline, if the timer task was blocked past
+    // one or more deadlines they are skipped rather than fired in a burst.
+    // setInterval rebases from the capture task, the base, interval and last
+    // frame are read and advanced together so a rebase lands wholly before or after
+    int64_t now = esp_timer_get_time();
+    CFrameTrigger trigger;
+
+    portENTER_CRITICAL(&pScheduler->statsLock);
+    int64_t interval = (int64_t)pScheduler->frameInterval;
+    uint32_t frame = now > pScheduler->startTime ? (uint32_t)((now - pScheduler->startTime) / interval) : 0;
+    if (frame <= pScheduler->lastFrame) {
+        frame = pScheduler->lastFrame + 1;
+    }
+    trigger.frame       = frame;
+    trigger.deadline    = pScheduler->startTime + (int64_t)frame * interval;
+    trigger.given       = now;
+    pScheduler->skippedCount += frame - pScheduler->lastFrame - 1;
+    pScheduler->triggerCount++;
+    pScheduler->lastFrame = frame;
+    portEXIT_CRITICAL(&pScheduler->statsLock);
+
+    if (xQueueSend(pScheduler->triggerQueue, &trigger, 0) != pdTRUE) {
+        portENTER_CRITICAL(&pScheduler->statsLock);
+        pScheduler->missedCount++;
+        portEXIT_CRITICAL(&pScheduler->statsLock);
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "globals.h"
+
+//Return values
+#define SCH_RET_OK              0
+#define SCH_RET_INVALID         1
+#define SCH_RET_TIMER_FAIL      2
+
+#define SCH_JITTER_BUDGET_US    2000    // frames triggered later than this are counted as late
+#define SCH_MIN_INTERVAL_US     10000   // 100 fps upper limit
+#define SCH_MAX_INTERVAL_US     (24ULL * 60 * 60 * 1000000) // 1 frame a day for time lapse
+
+//trigger posted to the capture task for every deadline
+typedef struct {
+    uint32_t    frame;      // deadline number since scheduler start
+    int64_t     deadline;   // absolute deadline [us]
+    int64_t     given;      // time the trigger was posted [us]
+} CFrameTrigger;
+
+typedef struct {
+    uint64_t    intervalUs;
+    uint32_t    triggers;
+    uint32_t    missed;     // deadlines dropped because the capture task was still busy
+    uint32_t    skipped;    // deadlines passed while the timer was blocked
+    uint32_t    frames;
+    uint32_t    lateFrames; // frames acquired outside the jitter budget
+    uint32_t    avgLateUs;
+    uint32_t    maxLateUs;
+    uint32_t    lastLateUs;
+    float       actualFPS;
+} CSchedulerStats;
+
+class CFrameScheduler {
+public:
+    CFrameScheduler();
+    ~CFrameScheduler();
+
+    int         start(QueueHandle_t queue);
+    int         stop();
+    bool        isRunning();
+    int         setFPS(float fps);
+    int         setInterval(uint64_t intervalUs);
+    float       getFPS();
+    uint64_t    getInterval();
+    void        setJitterBudget(uint32_t budgetUs);
+    uint32_t    reportFrame(const CFrameTrigger* trigger);
+    void        reportMissed(uint32_t count);
+    void        getStats(CSchedulerStats* stats);
+    void        resetStats();
+
+private:
+    static void timerCallback(void* arg);
+    int         startTimer();
+
+    esp_timer_handle_t  timer;
+    QueueHandle_t       triggerQueue;
+    portMUX_TYPE        statsLock;
+    bool                running;
+    uint64_t            frameInterval;
+    uint32_t            jitterBudget;
+    int64_t             startTime;
+    uint32_t            lastFrame;
+
+    uint32_t            triggerCount;
+    uint32_t            missedCount;
+    uint32_t            skippedCount;
+    uint32_t            frameCount;
+    uint32_t            lateCount;
+    uint64_t            lateTotal;
+    uint32_t            lateMax;
+    uint32_t            lateLast;
+    int64_t             statsTime;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "trace.h"
+
+#define CTRACE_TAG "CLatencyTrace"
+
+CLatencyTrace LatencyTrace;
+
+//start and end stage of every span
+static const uint8_t spanStages[TRACE_SPAN_COUNT][2] = {
+    {TRACE_TRIGGER,         TRACE_ACQUIRED},
+    {TRACE_ACQUIRED,        TRACE_MOTION_START},
+    {TRACE_MOTION_START,    TRACE_MOTION_END},
+    {TRACE_ACQUIRED,        TRACE_QUEUED},
+    {TRACE_QUEUED,          TRACE_WRITTEN},
+    {TRACE_ACQUIRED,        TRACE_RETURNED},
+    {TRACE_TRIGGER,         TRACE_WRITTEN}
+};
+
+CLatencyTrace::CLatencyTrace()
+{
+    reset();
+}
+
+void CLatencyTrace::record(const uint32_t* stamps)
+{
+    // stages a frame never went through are left at 0
+    for (uint8_t i = 0; i < TRACE_SPAN_COUNT; i++) {
+        uint32_t start  = stamps[spanStages[i][0]];
+        uint32_t end    = stamps[spanStages[i][1]];
+        if (start && end) {
+            add(i, end - start);
+        }
+    }
+}
+
+void CLatencyTrace::add(uint8_t span, uint32_t us)
+{
+    // only atomic increments so any task can record without locking
+    buckets[span][bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t currentMax = maxima[span].load(std::memory_order_relaxed);
+    while (us > currentMax && !maxima[span].compare_exchange_weak(currentMax, us, std::memory_order_relaxed));
+}
+
+void CLatencyTrace::summary(uint8_t span, CTraceSummary* out)
+{
+    // copy the histogram first so the percentiles are consistent with each other
+    uint32_t snapshot[TRACE_BUCKETS];
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < TRACE_BUCKETS; i++) {
+        snapshot[i] = buckets[span][i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+    }
+
+    out->count  = total;
+    out->max    = maxima[span].load(std::memory_order_relaxed);
+    out->p50    = 0;
+    out->p95    = 0;
+    out->p99    = 0;
+
+    uint32_t p50Count = (total * 50 + 99) / 100;
+    uint32_t p95Count = (total * 95 + 99) / 100;
+    uint32_t p99Count = (total * 99 + 99) / 100;
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < TRACE_BUCKETS && seen < total; i++) {
+        if (!snapshot[i]) continue;
+
+        seen += snapshot[i];
+        uint32_t value = bucketValue(i);
+        if (value > out->max) value = out->max;
+        if (!out->p50 && seen >= p50Count) out->p50 = value;
+        if (!out->p95 && seen >= p95Count) out->p95 = value;
+        if (!out->p99 && seen >= p99Count) out->p99 = value;
+    }
+}
+
+void CLatencyTrace::reset()
+{
+    for (uint8_t s = 0; s < TRACE_SPAN_COUNT; s++) {
+        for (uint32_t i = 0; i < TRACE_BUCKETS; i++) {
+            buckets[s][i].store(0, std::memory_order_relaxed);
+        }
+        maxima[s].store(0, std::memory_order_relaxed);
+    }
+}
+
+uint32_t CLatencyTrace::bucketIndex(uint32_t us)
+{
+    // log2 bucket with TRACE_SUB_BITS of linear sub buckets
+    if (us < (1 << TRACE_SUB_BITS)) {
+        return us;
+    }
+
+    uint32_t msb = 31 - __builtin_clz(us);
+    uint32_t sub = (us >> (msb - TRACE_SUB_BITS)) & ((1 << TRACE_SUB_BITS) - 1);
+
+    return ((msb - TRACE_SUB_BITS + 1) << TRACE_SUB_BITS) + sub;
+}
+
+uint32_t CLatencyTrace::bucketValue(uint32_t index)
+{
+    // upper bound of the bucket
+    if (index < (1 << TRACE_SUB_BITS)) {
+        return index;
+    }
+
+    uint32_t msb = (index >> TRACE_SUB_BITS) + TRACE_SUB_BITS - 1;
+    uint32_t sub = index & ((1 << TRACE_SUB_BITS) - 1);
+    uint64_t low = ((uint64_t)((1 << TRACE_SUB_BITS) | sub)) << (msb - TRACE_SUB_BITS);
+    uint64_t high = low + (1ULL << (msb - TRACE_SUB_BITS)) - 1;
+
+    return high > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)high;
+}
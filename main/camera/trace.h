@@ -0,0 +1,61 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include "globals.h"
+
+#define TRACE_SUB_BITS      2 // 4 buckets per power of two, ~19% worst case resolution
+#define TRACE_BUCKETS       (((32 - TRACE_SUB_BITS) << TRACE_SUB_BITS) + (1 << TRACE_SUB_BITS))
+
+//timestamps taken on every frame
+typedef enum {
+    TRACE_TRIGGER,
+    TRACE_ACQUIRED,
+    TRACE_MOTION_START,
+    TRACE_MOTION_END,
+    TRACE_QUEUED,
+    TRACE_WRITTEN,
+    TRACE_RETURNED,
+    TRACE_STAGE_COUNT
+} CTraceStage;
+
+//latencies kept as histograms, each between two stages
+typedef enum {
+    TRACE_SPAN_CAPTURE,     // trigger given -> fb acquired
+    TRACE_SPAN_MOTION_WAIT, // fb acquired -> motion start
+    TRACE_SPAN_MOTION,      // motion start -> motion end
+    TRACE_SPAN_QUEUE,       // fb acquired -> queued for write
+    TRACE_SPAN_WRITE,       // queued -> written
+    TRACE_SPAN_HOLD,        // fb acquired -> fb returned
+    TRACE_SPAN_TOTAL,       // trigger given -> written
+    TRACE_SPAN_COUNT
+} CTraceSpan;
+
+typedef struct {
+    uint32_t    count;
+    uint32_t    p50;
+    uint32_t    p95;
+    uint32_t    p99;
+    uint32_t    max;
+} CTraceSummary;
+
+class CLatencyTrace {
+public:
+    CLatencyTrace();
+
+    void        record(const uint32_t* stamps);
+    void        add(uint8_t span, uint32_t us);
+    void        summary(uint8_t span, CTraceSummary* out);
+    void        reset();
+
+private:
+    static uint32_t bucketIndex(uint32_t us);
+    static uint32_t bucketValue(uint32_t index);
+
+    std::atomic<uint32_t>   buckets[TRACE_SPAN_COUNT][TRACE_BUCKETS];
+    std::atomic<uint32_t>   maxima[TRACE_SPAN_COUNT];
+};
+
+extern CLatencyTrace LatencyTrace;
+
+#endif
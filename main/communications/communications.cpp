@@ -1,4 +1,5 @@
 #include "communications.h"
+#include "taskconfig.h"
 
 CCommunications Communications;
 
@@ -124,7 +125,7 @@ COMReturn CCommunications::startComs()
 
 	Communications.comState = COM_RUN;
 
-	xTaskCreate(parseTask, "ComsParseTask", COMS_STACK_SIZE, NULL, COM_TASK_PRIORITY, NULL);
+	TaskConfig.create(TASK_COMS_PARSE, parseTask, NULL);
 
 	return COM_OK;
 }
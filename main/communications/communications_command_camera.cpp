@@ -67,6 +67,38 @@ COMReturn CComsCommandCamera::receive(CPacket* packet)
     case 0x11:
         return resendFrame(packet);
         break;
+
+    case 0x12:
+        return setConfig(packet);
+        break;
+
+    case 0x13:
+        return getConfig(packet);
+        break;
+
+    case 0x14:
+        return setWatch(packet);
+        break;
+
+    case 0x15:
+        return setSource(packet);
+        break;
+
+    case 0x16:
+        return startBurst(packet);
+        break;
+
+    case 0x17:
+        return setGrid(packet);
+        break;
+
+    case 0x18:
+        return getCells(packet);
+        break;
+
+    case 0x19:
+        return getBox(packet);
+        break;
     }
 
     packet->clear();
@@ -86,17 +118,17 @@ COMReturn CComsCommandCamera::sendFrame(CPacket* packet)
     ESP_LOGD(CAM_TAG, "sendFrame: Reading packet [%u]", framePacketNumber);
 
     uint32_t packetPosition = framePacketNumber * COMS_DEFAULT_PKT_SIZE;
-    int32_t dataLeft = currentFrame->len - packetPosition;
+    int32_t dataLeft = currentFrame->len() - packetPosition;
     if (dataLeft < 1) dataLeft = 0;
     uint32_t packetSize = COMS_DEFAULT_PKT_SIZE < dataLeft ? COMS_DEFAULT_PKT_SIZE : dataLeft;
     uint8_t* dataCopy = (uint8_t*)malloc(packetSize + sizeof(uint16_t));
     *((uint16_t*)dataCopy) = framePacketNumber;
-    memcpy(dataCopy + sizeof(uint16_t), currentFrame->buf + packetPosition, packetSize);
+    memcpy(dataCopy + sizeof(uint16_t), currentFrame->buf() + packetPosition, packetSize);
     packet->take(dataCopy, packetSize + sizeof(uint16_t));
 
     if (packetSize < COMS_DEFAULT_PKT_SIZE) {
         frameComplete = true;
-        ESP_LOGI(CAM_TAG, "sendFrame: Transfer complete [%u]", currentFrame->len);
+        ESP_LOGI(CAM_TAG, "sendFrame: Transfer complete [%u]", currentFrame->len());
 
         return COM_COMPLETE;
     }
@@ -124,22 +156,195 @@ COMReturn CComsCommandCamera::resendFrame(CPacket* packet)
     return COM_ERROR;
 }
 
+COMReturn CComsCommandCamera::setConfig(CPacket* packet)
+{
+    // [frame size] [jpeg quality]
+    if (packet->size() != 2) {
+        ESP_LOGE(CAM_TAG, "setConfig: Invalid request size [%u]", packet->size());
+
+        return COM_ERROR;
+    }
+
+    // the frame we hold may be the old size
+    clearFrame();
+
+    if (Camera.reconfigure((framesize_t)packet->data()[0], packet->data()[1]) != CAM_RET_OK) {
+        return COM_ERROR;
+    }
+
+    packet->clear();
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandCamera::getConfig(CPacket* packet)
+{
+    // [frame size] [jpeg quality] [last switch time us]
+    uint8_t data[2 + sizeof(uint32_t)];
+    uint32_t switchTime = Camera.getSwitchTime();
+    data[0] = Camera.getFrameSize();
+    data[1] = Camera.getQuality();
+    memcpy(data + 2, &switchTime, sizeof(uint32_t));
+
+    packet->clear();
+    packet->copy(data, sizeof(data));
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandCamera::setWatch(CPacket* packet)
+{
+    // [enable] [watch frame size] [record frame size]
+    if (packet->size() != 3) {
+        ESP_LOGE(CAM_TAG, "setWatch: Invalid request size [%u]", packet->size());
+
+        return COM_ERROR;
+    }
+
+    clearFrame();
+
+    if (Camera.setWatchMode(packet->data()[0], (framesize_t)packet->data()[1], (framesize_t)packet->data()[2]) != CAM_RET_OK) {
+        return COM_ERROR;
+    }
+
+    packet->clear();
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandCamera::setSource(CPacket* packet)
+{
+    // [loop] [path] to replay a jpeg directory or AVI, empty to go back to the sensor
+    if (packet->size() >= sizeof(fileName)) {
+        ESP_LOGE(CAM_TAG, "setSource: Invalid request size [%u]", packet->size());
+
+        return COM_ERROR;
+    }
+
+    clearFrame();
+    Camera.stop();
+
+    CFrameSource* source = &SensorSource;
+    if (packet->size() > 1) {
+        memcpy(fileName, packet->data() + 1, packet->size() - 1);
+        fileName[packet->size() - 1] = 0;
+
+        if (ReplaySource.open(fileName, packet->data()[0]) != SRC_RET_OK) {
+            Camera.start();
+
+            return COM_ERROR;
+        }
+        source = &ReplaySource;
+    }
+    else {
+        ReplaySource.close();
+    }
+
+    Camera.setFrameSource(source);
+    if (Camera.start() != CAM_RET_OK) {
+        return COM_ERROR;
+    }
+
+    packet->clear();
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandCamera::startBurst(CPacket* packet)
+{
+    // [frame count] [frame size] [0 = jpeg files, 1 = AVI]
+    if (packet->size() != 3) {
+        ESP_LOGE(CAM_TAG, "startBurst: Invalid request size [%u]", packet->size());
+
+        return COM_ERROR;
+    }
+
+    if (Camera.startBurst(packet->data()[0], (framesize_t)packet->data()[1], packet->data()[2]) != CAM_RET_OK) {
+        return COM_ERROR;
+    }
+
+    packet->clear();
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandCamera::setGrid(CPacket* packet)
+{
+    // [cols] [rows] [mask u64] [sensitivity per cell, 0 = default]
+    if (packet->size() < 2 + sizeof(uint64_t) || packet->size() != 2 + sizeof(uint64_t) + packet->data()[0] * packet->data()[1]) {
+        ESP_LOGE(CAM_TAG, "setGrid: Invalid request size [%u]", packet->size());
+
+        return COM_ERROR;
+    }
+
+    CMotionGrid grid;
+    memset(&grid, 0, sizeof(grid));
+    grid.cols = packet->data()[0];
+    grid.rows = packet->data()[1];
+    memcpy(&grid.mask, packet->data() + 2, sizeof(uint64_t));
+    if (grid.cols * grid.rows > MOT_GRID_CELLS) {
+        ESP_LOGE(CAM_TAG, "setGrid: Invalid grid %ux%u", grid.cols, grid.rows);
+
+        return COM_ERROR;
+    }
+    memcpy(grid.sensitivity, packet->data() + 2 + sizeof(uint64_t), grid.cols * grid.rows);
+
+    if (Camera.setMotionGrid(&grid) != CAM_RET_OK) {
+        return COM_ERROR;
+    }
+
+    packet->clear();
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandCamera::getCells(CPacket* packet)
+{
+    // [cols] [rows] [mask u64] [cells that saw movement in the last check u64]
+    CMotionGrid grid;
+    Camera.getMotionGrid(&grid);
+    uint64_t cells = Camera.getMotionCells();
+
+    uint8_t data[2 + 2 * sizeof(uint64_t)];
+    data[0] = grid.cols;
+    data[1] = grid.rows;
+    memcpy(data + 2, &grid.mask, sizeof(uint64_t));
+    memcpy(data + 2 + sizeof(uint64_t), &cells, sizeof(uint64_t));
+
+    packet->clear();
+    packet->copy(data, sizeof(data));
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandCamera::getBox(CPacket* packet)
+{
+    // [x] [y] [width] [height] [centre x] [centre y] u16 then [changed area u32], in frame pixels
+    CMotionBox box;
+    Camera.getMotionBox(&box);
+
+    packet->clear();
+    packet->copy((uint8_t*)&box, sizeof(CMotionBox));
+
+    return CComsCommand::receive(packet);
+}
+
 void CComsCommandCamera::clearFrame()
 {
     if (currentFrame) {
-        esp_camera_fb_return(currentFrame);
+        currentFrame->release();
         currentFrame = NULL;
     }
 }
 
-bool CComsCommandCamera::onFrame(camera_fb_t* frame)
+bool CComsCommandCamera::onFrame(CFrame* frame)
 {
     if (pCameraCurrent->started()) {
         if (pCameraCurrent->currentFrame == NULL) {
             ESP_LOGD(CAM_TAG, "onFrame: grabbed frame");
 
             pCameraCurrent->clearFrame();
-            pCameraCurrent->currentFrame = frame;
+            pCameraCurrent->currentFrame = frame->addRef();
 
             return true;
         }
@@ -18,11 +18,19 @@ public:
 private:
     COMReturn           sendFrame(CPacket* packet);
     COMReturn           resendFrame(CPacket* packet);
+    COMReturn           setConfig(CPacket* packet);
+    COMReturn           getConfig(CPacket* packet);
+    COMReturn           setWatch(CPacket* packet);
+    COMReturn           setSource(CPacket* packet);
+    COMReturn           startBurst(CPacket* packet);
+    COMReturn           setGrid(CPacket* packet);
+    COMReturn           getCells(CPacket* packet);
+    COMReturn           getBox(CPacket* packet);
     void                clearFrame();
-    static bool         onFrame(camera_fb_t* frame);
+    static bool         onFrame(CFrame* frame);
 
     char                fileName[512];
-    camera_fb_t*        currentFrame;
+    CFrame*             currentFrame;
     uint16_t            framePacketNumber;
     bool                frameComplete;
 };
@@ -0,0 +1,153 @@
+#include "communications.h"
+#include "communications_command_journal.h"
+
+#define JOURNAL_TAG "JournalCommand"
+
+CComsCommandJournal::CComsCommandJournal(uint8_t cmd, uint32_t timeout) : CComsCommand(cmd, timeout)
+{
+    firstRecord     = 0;
+    recordCount     = 0;
+    packetNumber    = 0;
+    sendComplete    = false;
+}
+
+CComsCommandJournal::~CComsCommandJournal()
+{
+    CComsCommand::~CComsCommand();
+}
+
+COMReturn CComsCommandJournal::start(CPacket* packet)
+{
+    // [from boot u16][from ms u64][to boot u16][to ms u64], nothing sends the whole journal
+    uint16_t fromBoot   = 0;
+    uint64_t from       = 0;
+    uint16_t toBoot     = UINT16_MAX;
+    uint64_t to         = UINT64_MAX;
+    if (packet->size() == 20) {
+        memcpy(&fromBoot, packet->data(), 2);
+        memcpy(&from, packet->data() + 2, 8);
+        memcpy(&toBoot, packet->data() + 10, 2);
+        memcpy(&to, packet->data() + 12, 8);
+    }
+    else if (packet->size()) {
+        ESP_LOGE(JOURNAL_TAG, "start: Invalid request size [%u]", packet->size());
+
+        return COM_ERROR;
+    }
+
+    packet->clear();
+
+    if (Camera.findEvents(fromBoot, from, toBoot, to, &firstRecord, &recordCount) != CAM_RET_OK) {
+        ESP_LOGE(JOURNAL_TAG, "start: Journal not available");
+
+        return COM_ERROR;
+    }
+    packetNumber    = 0;
+    sendComplete    = false;
+
+    // [boot u16][now ms u64][records u32][unflushed u32][first u32][matches u32]
+    CJournalInfo info;
+    Camera.getJournalInfo(&info);
+    uint8_t data[26];
+    memcpy(data, &info.boot, 2);
+    memcpy(data + 2, &info.now, 8);
+    memcpy(data + 10, &info.records, 4);
+    memcpy(data + 14, &info.unflushed, 4);
+    memcpy(data + 18, &firstRecord, 4);
+    memcpy(data + 22, &recordCount, 4);
+    packet->copy(data, sizeof(data));
+
+    ESP_LOGI(JOURNAL_TAG, "start: %lu of %lu records from [%lu]", recordCount, info.records, firstRecord);
+
+    return CComsCommand::start(packet);
+}
+
+COMReturn CComsCommandJournal::end(CPacket* packet)
+{
+    packet->clear();
+
+    uint8_t response = sendComplete ? COM_RESPONSE_COMPLETE : COM_RESPONSE_ERROR;
+    packet->copy(&response, 1);
+
+    return CComsCommand::end(packet);
+}
+
+COMReturn CComsCommandJournal::idle(CPacket* packet)
+{
+    packet->clear();
+
+    return CComsCommand::idle(packet);
+}
+
+COMReturn CComsCommandJournal::receive(CPacket* packet)
+{
+    uint8_t command = packet->data()[0];
+    packet->forward(1);
+
+    switch (command) {
+    case JOURNAL_CMD_NEXT:
+        return sendRecords(packet);
+        break;
+
+    case JOURNAL_CMD_RESEND:
+        return resendRecords(packet);
+        break;
+    }
+
+    packet->clear();
+
+    return COM_OK;
+}
+
+COMReturn CComsCommandJournal::sendRecords(CPacket* packet)
+{
+    // [packet u16] then up to JOURNAL_PKT_RECORDS records, a short packet is the last one
+    uint32_t sent = (uint32_t)packetNumber * JOURNAL_PKT_RECORDS;
+    uint32_t count = sent < recordCount ? recordCount - sent : 0;
+    if (count > JOURNAL_PKT_RECORDS) {
+        count = JOURNAL_PKT_RECORDS;
+    }
+
+    uint8_t* data = (uint8_t*)malloc(sizeof(uint16_t) + JOURNAL_PKT_RECORDS * JNL_RECORD_SIZE);
+    if (!data) {
+        ESP_LOGE(JOURNAL_TAG, "sendRecords: Unable to alloc memory for records");
+
+        return COM_ERROR_MALLOC;
+    }
+    memcpy(data, &packetNumber, sizeof(uint16_t));
+    uint32_t got = count ? Camera.readEvents(firstRecord + sent, count, (CJournalRecord*)(data + sizeof(uint16_t))) : 0;
+    if (got != count) {
+        ESP_LOGE(JOURNAL_TAG, "sendRecords: Unable to read records [%lu]", firstRecord + sent);
+        free(data);
+
+        return COM_ERROR_NOT_FOUND;
+    }
+    packet->take(data, sizeof(uint16_t) + got * JNL_RECORD_SIZE);
+
+    ESP_LOGI(JOURNAL_TAG, "sendRecords: Packet [%u] %lu records", packetNumber, got);
+
+    if (got < JOURNAL_PKT_RECORDS) {
+        sendComplete = true;
+
+        return COM_COMPLETE;
+    }
+
+    packetNumber++;
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandJournal::resendRecords(CPacket* packet)
+{
+    if (packet->size() == sizeof(uint16_t)) {
+        memcpy(&packetNumber, packet->data(), sizeof(uint16_t));
+
+        ESP_LOGW(JOURNAL_TAG, "resendRecords: Resending packet [%u]", packetNumber);
+
+        return sendRecords(packet);
+    }
+
+    ESP_LOGE(JOURNAL_TAG, "resendRecords: Invalid request size [%u]", packet->size());
+
+    return COM_ERROR;
+}
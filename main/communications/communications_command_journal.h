@@ -0,0 +1,34 @@
+#ifndef COMMUNICATIONS_COMMAND_JOURNAL_H
+#define COMMUNICATIONS_COMMAND_JOURNAL_H
+
+#include "communications_globals.h"
+#include "communications_command.h"
+#include "camera.h"
+
+//journal sub commands
+#define JOURNAL_CMD_NEXT        0x10
+#define JOURNAL_CMD_RESEND      0x11
+
+#define JOURNAL_PKT_RECORDS     (COMS_DEFAULT_PKT_SIZE / JNL_RECORD_SIZE)
+
+class CComsCommandJournal : public CComsCommand {
+public:
+    CComsCommandJournal(uint8_t cmd, uint32_t timeout);
+    ~CComsCommandJournal();
+
+    COMReturn	start(CPacket* packet);
+    COMReturn	end(CPacket* packet);
+    COMReturn	idle(CPacket* packet);
+    COMReturn	receive(CPacket* packet);
+
+private:
+    COMReturn   sendRecords(CPacket* packet);
+    COMReturn   resendRecords(CPacket* packet);
+
+    uint32_t    firstRecord;
+    uint32_t    recordCount;
+    uint16_t    packetNumber;
+    bool        sendComplete;
+};
+
+#endif
@@ -0,0 +1,285 @@
+#include "communications.h"
+#include "communications_command_stats.h"
+
+#define STATS_TAG "StatsCommand"
+
+CComsCommandStats::CComsCommandStats(uint8_t cmd, uint32_t timeout) : CComsCommand(cmd, timeout)
+{
+}
+
+CComsCommandStats::~CComsCommandStats()
+{
+    CComsCommand::~CComsCommand();
+}
+
+COMReturn CComsCommandStats::start(CPacket* packet)
+{
+    packet->clear();
+
+    return CComsCommand::start(packet);
+}
+
+COMReturn CComsCommandStats::end(CPacket* packet)
+{
+    packet->clear();
+
+    return CComsCommand::end(packet);
+}
+
+COMReturn CComsCommandStats::idle(CPacket* packet)
+{
+    return CComsCommand::idle(packet);
+}
+
+COMReturn CComsCommandStats::receive(CPacket* packet)
+{
+    uint8_t command = packet->data()[0];
+    packet->forward(1);
+
+    switch (command) {
+    case STATS_CMD_LATENCY:
+        return sendLatency(packet);
+        break;
+
+    case STATS_CMD_RESET:
+        LatencyTrace.reset();
+        ESP_LOGI(STATS_TAG, "receive: Latency histograms reset");
+        break;
+
+    case STATS_CMD_SCHEDULER:
+        return sendScheduler(packet);
+        break;
+
+    case STATS_CMD_STORAGE:
+        return sendStorage(packet);
+        break;
+
+    case STATS_CMD_TASKS:
+        return sendTasks(packet);
+        break;
+
+    case STATS_CMD_SET_TASK:
+        return setTask(packet);
+        break;
+
+    case STATS_CMD_WATCH:
+        return sendWatch(packet);
+        break;
+
+    case STATS_CMD_WATCH_RESET:
+        Camera.resetWatchStats();
+        ESP_LOGI(STATS_TAG, "receive: Watch stats reset");
+        break;
+
+    case STATS_CMD_BURST:
+        return sendBurst(packet);
+        break;
+
+    case STATS_CMD_MOTION:
+        return sendMotion(packet);
+        break;
+
+    case STATS_CMD_SET_DECODER:
+        // [decoder], resets the motion decode stats so the two can be compared on the same frames
+        if (packet->size() != 1 || packet->data()[0] > MOT_DECODE_LUMA) {
+            ESP_LOGE(STATS_TAG, "receive: Invalid decoder request");
+
+            return COM_ERROR;
+        }
+        Camera.setMotionDecoder((CMotionDecoder)packet->data()[0]);
+        break;
+
+    case STATS_CMD_SET_PREFILTER:
+        // [enable], resets the motion stats so skipped decodes and misses start from zero
+        if (packet->size() != 1) {
+            ESP_LOGE(STATS_TAG, "receive: Invalid prefilter request");
+
+            return COM_ERROR;
+        }
+        Camera.setMotionPrefilter(packet->data()[0]);
+        break;
+
+    case STATS_CMD_SET_MODEL:
+        // [model][rate shift], resets the motion stats so trigger counts can be compared on the same replay
+        if (packet->size() != 2 || packet->data()[0] > MOT_MODEL_ADAPTIVE || !packet->data()[1] || packet->data()[1] > MOT_BG_MAX_SHIFT) {
+            ESP_LOGE(STATS_TAG, "receive: Invalid motion model request");
+
+            return COM_ERROR;
+        }
+        Camera.setMotionModel((CMotionModel)packet->data()[0], packet->data()[1]);
+        break;
+
+    case STATS_CMD_SET_AUTO:
+        // [enable], the chosen thresholds are reported in the motion stats
+        if (packet->size() != 1) {
+            ESP_LOGE(STATS_TAG, "receive: Invalid auto threshold request");
+
+            return COM_ERROR;
+        }
+        Camera.setMotionAutoThreshold(packet->data()[0]);
+        break;
+
+    case STATS_CMD_SET_ILLUM:
+        // [enable], resets the motion stats so triggers can be compared with and without on the same replay
+        if (packet->size() != 1) {
+            ESP_LOGE(STATS_TAG, "receive: Invalid illumination request");
+
+            return COM_ERROR;
+        }
+        Camera.setMotionIllumination(packet->data()[0]);
+        break;
+
+    case STATS_CMD_SET_CASCADE:
+        // [enable], resets the motion stats so the average decode cost can be compared with and without
+        if (packet->size() != 1) {
+            ESP_LOGE(STATS_TAG, "receive: Invalid cascade request");
+
+            return COM_ERROR;
+        }
+        Camera.setMotionCascade(packet->data()[0]);
+        break;
+
+    case STATS_CMD_SET_BANDS:
+        // [bands], 1 keeps motion on its own task, the split and single task times are in the motion stats
+        if (packet->size() != 1 || !packet->data()[0] || packet->data()[0] > BAND_MAX_WORKERS) {
+            ESP_LOGE(STATS_TAG, "receive: Invalid bands request");
+
+            return COM_ERROR;
+        }
+        Camera.setMotionBands(packet->data()[0]);
+        break;
+
+    case STATS_CMD_SET_DEBUG:
+        // [enable], keeps the change map and its jpeg so the motion result can be looked at
+        if (packet->size() != 1) {
+            ESP_LOGE(STATS_TAG, "receive: Invalid debug request");
+
+            return COM_ERROR;
+        }
+        Camera.setMotionDebug(packet->data()[0]);
+        break;
+    }
+
+    packet->clear();
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandStats::sendLatency(CPacket* packet)
+{
+    // [span count] then count, p50, p95, p99, max in us for every span
+    uint8_t data[1 + sizeof(CTraceSummary) * TRACE_SPAN_COUNT];
+    data[0] = TRACE_SPAN_COUNT;
+    for (uint8_t i = 0; i < TRACE_SPAN_COUNT; i++) {
+        CTraceSummary summary;
+        LatencyTrace.summary(i, &summary);
+        memcpy(data + 1 + sizeof(CTraceSummary) * i, &summary, sizeof(CTraceSummary));
+
+        ESP_LOGD(STATS_TAG, "sendLatency: Span [%u] count %lu p50 %lu p95 %lu p99 %lu max %lu us", i, summary.count, summary.p50, summary.p95, summary.p99, summary.max);
+    }
+
+    packet->clear();
+    packet->copy(data, sizeof(data));
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandStats::sendScheduler(CPacket* packet)
+{
+    CSchedulerStats stats;
+    Camera.getSchedulerStats(&stats);
+
+    packet->clear();
+    packet->copy((uint8_t*)&stats, sizeof(CSchedulerStats));
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandStats::sendStorage(CPacket* packet)
+{
+    CStorageStats stats;
+    Camera.getStorageStats(&stats);
+
+    packet->clear();
+    packet->copy((uint8_t*)&stats, sizeof(CStorageStats));
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandStats::sendWatch(CPacket* packet)
+{
+    CWatchStats stats;
+    Camera.getWatchStats(&stats);
+
+    packet->clear();
+    packet->copy((uint8_t*)&stats, sizeof(CWatchStats));
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandStats::sendBurst(CPacket* packet)
+{
+    CBurstStats stats;
+    Camera.getBurstStats(&stats);
+
+    packet->clear();
+    packet->copy((uint8_t*)&stats, sizeof(CBurstStats));
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandStats::sendMotion(CPacket* packet)
+{
+    CMotionStats stats;
+    Camera.getMotionStats(&stats);
+
+    packet->clear();
+    packet->copy((uint8_t*)&stats, sizeof(CMotionStats));
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandStats::sendTasks(CPacket* packet)
+{
+    // [task count] then priority, core (-1 = any) and stack size for every task
+    uint8_t data[1 + 6 * TASK_ID_COUNT];
+    data[0] = TASK_ID_COUNT;
+    for (uint8_t i = 0; i < TASK_ID_COUNT; i++) {
+        const CTaskEntry* entry = TaskConfig.get(i);
+        uint8_t* pos = data + 1 + 6 * i;
+        pos[0] = entry->priority;
+        pos[1] = entry->core == tskNO_AFFINITY ? 0xFF : entry->core;
+        memcpy(pos + 2, &entry->stackSize, 4);
+    }
+
+    packet->clear();
+    packet->copy(data, sizeof(data));
+
+    return CComsCommand::receive(packet);
+}
+
+COMReturn CComsCommandStats::setTask(CPacket* packet)
+{
+    // [task id] [priority] [core, 0xFF = any]
+    if (packet->size() != 3) {
+        ESP_LOGE(STATS_TAG, "setTask: Invalid request size [%u]", packet->size());
+
+        return COM_ERROR;
+    }
+
+    uint8_t id          = packet->data()[0];
+    uint8_t priority    = packet->data()[1];
+    BaseType_t core     = packet->data()[2] == 0xFF ? tskNO_AFFINITY : packet->data()[2];
+    if (TaskConfig.set(id, priority, core) != TASK_RET_OK) {
+        return COM_ERROR;
+    }
+
+    // camera tasks pick up the new placement when they are created again
+    if ((id == TASK_CAPTURE || id == TASK_STORAGE || id == TASK_MOTION || id == TASK_BAND_0 || id == TASK_BAND_1) && Camera.isRunning()) {
+        Camera.restart();
+    }
+
+    packet->clear();
+
+    return CComsCommand::receive(packet);
+}
@@ -0,0 +1,51 @@
+#ifndef COMMUNICATIONS_COMMAND_STATS_H
+#define COMMUNICATIONS_COMMAND_STATS_H
+
+#include "communications_globals.h"
+#include "communications_command.h"
+#include "camera.h"
+#include "trace.h"
+#include "taskconfig.h"
+
+//stats sub commands
+#define STATS_CMD_LATENCY       0x10
+#define STATS_CMD_RESET         0x11
+#define STATS_CMD_SCHEDULER     0x12
+#define STATS_CMD_STORAGE       0x13
+#define STATS_CMD_TASKS         0x14
+#define STATS_CMD_SET_TASK      0x15
+#define STATS_CMD_WATCH         0x16
+#define STATS_CMD_WATCH_RESET   0x17
+#define STATS_CMD_BURST         0x18
+#define STATS_CMD_MOTION        0x19
+#define STATS_CMD_SET_DECODER   0x1A
+#define STATS_CMD_SET_PREFILTER 0x1B
+#define STATS_CMD_SET_MODEL     0x1C
+#define STATS_CMD_SET_AUTO      0x1D
+#define STATS_CMD_SET_ILLUM     0x1E
+#define STATS_CMD_SET_CASCADE   0x1F
+#define STATS_CMD_SET_BANDS     0x20
+#define STATS_CMD_SET_DEBUG     0x21
+
+class CComsCommandStats : public CComsCommand {
+public:
+    CComsCommandStats(uint8_t cmd, uint32_t timeout);
+    ~CComsCommandStats();
+
+    COMReturn			start(CPacket* packet);
+    COMReturn			end(CPacket* packet);
+    COMReturn			idle(CPacket* packet);
+    COMReturn			receive(CPacket* packet);
+
+private:
+    COMReturn           sendLatency(CPacket* packet);
+    COMReturn           sendScheduler(CPacket* packet);
+    COMReturn           sendStorage(CPacket* packet);
+    COMReturn           sendTasks(CPacket* packet);
+    COMReturn           setTask(CPacket* packet);
+    COMReturn           sendWatch(CPacket* packet);
+    COMReturn           sendBurst(CPacket* packet);
+    COMReturn           sendMotion(CPacket* packet);
+};
+
+#endif
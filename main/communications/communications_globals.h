@@ -11,8 +11,6 @@
 //BLE send queue size
 #define COMS_HEADER_ID					0xBEEF
 #define COM_QUEUE_SIZE                  8
-#define COMS_STACK_SIZE                 3072
-#define COM_TASK_PRIORITY               0
 #define COM_TASK_TICK_TIME				10
 #define COM_PACKET_TIMEOUT				1000
 #define COMS_DEFAULT_PKT_SIZE			(1024 * 8)
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "bluetooth.h"
+#include "taskconfig.h"
 
 #define SPP_PROFILE_NUM                     1
 #define SPP_PROFILE_APP_IDX                 0
@@ -714,7 +715,7 @@ uint16_t CBluetooth::startTask()
         Bluetooth.eventCallbacks.onConnect();
     }
   
-    xTaskCreate(sendTask, "sendTask", BT_STACK_SIZE, NULL, BT_TASK_PRIORITY, NULL);
+    TaskConfig.create(TASK_BT_SEND, sendTask, NULL);
 
     ESP_LOGI(CBT_TAG, "startTask: Complete");
 
@@ -31,8 +31,6 @@
 
 //BLE send queue size
 #define BT_QUEUE_SIZE                   8
-#define BT_STACK_SIZE                   3072
-#define BT_TASK_PRIORITY                2
 
 //BT max congestion
 #define BT_CONGESTION_MAX               3000
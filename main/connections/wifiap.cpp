@@ -1,4 +1,5 @@
 #include "wifiap.h"
+#include "taskconfig.h"
 
 #define AP_TAG              "Wifi_AP"
 #define AP_RECV_BUFFER_SIZE 4128
@@ -486,8 +487,8 @@ uint16_t CWifiAP::startTask()
     if (WifiAP.eventCallbacks.onConnect) {
         WifiAP.eventCallbacks.onConnect();
     }
-    xTaskCreate(WifiAP.sendTask, "sendTask", AP_STACK_SIZE, NULL, AP_TASK_PRIORITY, NULL);
-    xTaskCreate(WifiAP.recvTask, "recvTask", AP_STACK_SIZE, NULL, AP_TASK_PRIORITY, NULL);
+    TaskConfig.create(TASK_AP_SEND, WifiAP.sendTask, NULL);
+    TaskConfig.create(TASK_AP_RECV, WifiAP.recvTask, NULL);
 
     ESP_LOGI(AP_TAG, "startTask: complete");
 
@@ -14,8 +14,6 @@
 #include "globals.h"
 
 #define AP_QUEUE_SIZE					64
-#define AP_STACK_SIZE					3072
-#define AP_TASK_PRIORITY				2
 
 #define AP_WIFI_SSID_KEY                "MY_WIFI_AP"
 #define AP_WIFI_PASS_KEY                "1234"
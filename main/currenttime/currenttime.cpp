@@ -10,6 +10,10 @@ uint32_t CCurrentTime::ms() {
 	return esp_timer_get_time() / 1000;
 }
 
+uint64_t CCurrentTime::ms64() {
+	return esp_timer_get_time() / 1000;
+}
+
 uint32_t CCurrentTime::s() {
 	return esp_timer_get_time() / 1000000;
 }
\ No newline at end of file
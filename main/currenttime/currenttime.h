@@ -7,6 +7,7 @@ class CCurrentTime {
 public:
 	uint32_t	us();
 	uint32_t	ms();
+	uint64_t	ms64();
 	uint32_t	s();
 };
 
@@ -8,6 +8,8 @@
 #include "communications_command_directory.h"
 #include "communications_command_camera.h"
 #include "communications_command_ota.h"
+#include "communications_command_stats.h"
+#include "communications_command_journal.h"
 
 #define MAIN_TAG "Main"
 
@@ -37,12 +39,16 @@ extern "C" void app_main(void)
     CComsCommandSendFile*   pCommandSendFile    = new CComsCommandSendFile(  0x02, 3000);
     CComsCommandDeleteFile* pCommandDeleteFile  = new CComsCommandDeleteFile(0x03, 3000);
     CComsCommandCamera*     pCommandCamera      = new CComsCommandCamera(    0x04, 3000);
+    CComsCommandStats*      pCommandStats       = new CComsCommandStats(     0x05, 3000);
+    CComsCommandJournal*    pCommandJournal     = new CComsCommandJournal(   0x06, 3000);
     CComsCommandOTA*        pCommandOTA         = new CComsCommandOTA(       0xA0, 3000);
     Communications.initComs();
     Communications.addCommand(pCommandDirectory);
     Communications.addCommand(pCommandSendFile);
     Communications.addCommand(pCommandDeleteFile);
     Communications.addCommand(pCommandCamera);
+    Communications.addCommand(pCommandStats);
+    Communications.addCommand(pCommandJournal);
     Communications.addCommand(pCommandOTA);
     Communications.startComs();
     
@@ -0,0 +1,84 @@
+#include "taskconfig.h"
+
+#define CTASK_TAG "CTaskConfig"
+
+CTaskConfig TaskConfig;
+
+//build time placement, changes made with set() apply the next time a task is created
+static const CTaskEntry defaultEntries[TASK_ID_COUNT] = {
+    {"cameraCaptureTask",   TASK_STACK_CAMERA,  TASK_PRIO_CAPTURE,      TASK_CORE_CAPTURE},
+    {"cameraStorageTask",   TASK_STACK_CAMERA,  TASK_PRIO_STORAGE,      TASK_CORE_STORAGE},
+    {"cameraMotionTask",    TASK_STACK_CAMERA,  TASK_PRIO_MOTION,       TASK_CORE_MOTION},
+    {"ComsParseTask",       TASK_STACK_COMS,    TASK_PRIO_COMS_PARSE,   TASK_CORE_COMS_PARSE},
+    {"sendTask",            TASK_STACK_COMS,    TASK_PRIO_BT_SEND,      TASK_CORE_BT_SEND},
+    {"sendTask",            TASK_STACK_COMS,    TASK_PRIO_AP_SEND,      TASK_CORE_AP_SEND},
+    {"recvTask",            TASK_STACK_COMS,    TASK_PRIO_AP_RECV,      TASK_CORE_AP_RECV},
+    {"cameraBurstTask",     TASK_STACK_CAMERA,  TASK_PRIO_BURST,        TASK_CORE_BURST},
+    {"motionBandTask",      TASK_STACK_CAMERA,  TASK_PRIO_BAND,         TASK_CORE_BAND_0},
+    {"motionBandTask",      TASK_STACK_CAMERA,  TASK_PRIO_BAND,         TASK_CORE_BAND_1}
+};
+
+CTaskConfig::CTaskConfig()
+{
+    reset();
+}
+
+int CTaskConfig::create(uint8_t id, TaskFunction_t function, void* arg, TaskHandle_t* handle)
+{
+    if (id >= TASK_ID_COUNT) {
+        ESP_LOGE(CTASK_TAG, "create: Invalid task [%u]", id);
+
+        return TASK_RET_INVALID;
+    }
+
+    CTaskEntry* entry = &entries[id];
+    if (xTaskCreatePinnedToCore(function, entry->name, entry->stackSize, arg, entry->priority, handle, entry->core) != pdPASS) {
+        ESP_LOGE(CTASK_TAG, "create: Unable to create [%s]", entry->name);
+
+        return TASK_RET_CREATE_FAIL;
+    }
+
+    ESP_LOGD(CTASK_TAG, "create: [%s] priority %u core %d", entry->name, entry->priority, entry->core);
+
+    return TASK_RET_OK;
+}
+
+int CTaskConfig::set(uint8_t id, UBaseType_t priority, BaseType_t core, uint32_t stackSize)
+{
+    if (id >= TASK_ID_COUNT || priority >= configMAX_PRIORITIES || (core != tskNO_AFFINITY && (core < 0 || core >= portNUM_PROCESSORS))) {
+        ESP_LOGW(CTASK_TAG, "set: Invalid placement for task [%u]", id);
+
+        return TASK_RET_INVALID;
+    }
+
+    entries[id].priority = priority;
+    entries[id].core     = core;
+    if (stackSize) {
+        entries[id].stackSize = stackSize;
+    }
+
+    ESP_LOGI(CTASK_TAG, "set: [%s] priority %u core %d stack %lu", entries[id].name, priority, core, entries[id].stackSize);
+
+    return TASK_RET_OK;
+}
+
+const CTaskEntry* CTaskConfig::get(uint8_t id)
+{
+    if (id >= TASK_ID_COUNT) {
+        return NULL;
+    }
+
+    return &entries[id];
+}
+
+void CTaskConfig::reset()
+{
+    memcpy(entries, defaultEntries, sizeof(entries));
+}
+
+void CTaskConfig::log()
+{
+    for (uint8_t i = 0; i < TASK_ID_COUNT; i++) {
+        ESP_LOGI(CTASK_TAG, "log: [%s] priority %u core %d stack %lu", entries[i].name, entries[i].priority, entries[i].core, entries[i].stackSize);
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef TASK_CONFIG_H
+#define TASK_CONFIG_H
+
+#include "globals.h"
+
+//Return values
+#define TASK_RET_OK             0
+#define TASK_RET_INVALID        1
+#define TASK_RET_CREATE_FAIL    2
+
+//Core placement, override any of these at build time
+#ifdef CONFIG_FREERTOS_UNICORE
+#define TASK_CORE_COMS          0
+#define TASK_CORE_CAMERA        0
+#else
+#define TASK_CORE_COMS          0 // shared with the WiFi/BT stack
+#define TASK_CORE_CAMERA        1
+#endif
+
+#ifndef TASK_CORE_CAPTURE
+#define TASK_CORE_CAPTURE       TASK_CORE_CAMERA
+#endif
+#ifndef TASK_CORE_STORAGE
+#define TASK_CORE_STORAGE       TASK_CORE_CAMERA
+#endif
+#ifndef TASK_CORE_MOTION
+#define TASK_CORE_MOTION        tskNO_AFFINITY // whichever core is idle
+#endif
+#ifndef TASK_CORE_BURST
+#define TASK_CORE_BURST         TASK_CORE_CAMERA
+#endif
+#ifndef TASK_CORE_BAND_0
+#define TASK_CORE_BAND_0        0
+#endif
+#ifndef TASK_CORE_BAND_1
+#define TASK_CORE_BAND_1        (portNUM_PROCESSORS - 1)
+#endif
+#ifndef TASK_CORE_COMS_PARSE
+#define TASK_CORE_COMS_PARSE    TASK_CORE_COMS
+#endif
+#ifndef TASK_CORE_BT_SEND
+#define TASK_CORE_BT_SEND       TASK_CORE_COMS
+#endif
+#ifndef TASK_CORE_AP_SEND
+#define TASK_CORE_AP_SEND       TASK_CORE_COMS
+#endif
+#ifndef TASK_CORE_AP_RECV
+#define TASK_CORE_AP_RECV       TASK_CORE_COMS
+#endif
+
+//Priorities
+#ifndef TASK_PRIO_CAPTURE
+#define TASK_PRIO_CAPTURE       3
+#endif
+#ifndef TASK_PRIO_STORAGE
+#define TASK_PRIO_STORAGE       2
+#endif
+#ifndef TASK_PRIO_MOTION
+#define TASK_PRIO_MOTION        1
+#endif
+#ifndef TASK_PRIO_BURST
+#define TASK_PRIO_BURST         TASK_PRIO_CAPTURE // drops to the storage priority once the frames are in PSRAM
+#endif
+#ifndef TASK_PRIO_BAND
+#define TASK_PRIO_BAND          TASK_PRIO_MOTION // the motion task waits while they run
+#endif
+#ifndef TASK_PRIO_COMS_PARSE
+#define TASK_PRIO_COMS_PARSE    0
+#endif
+#ifndef TASK_PRIO_BT_SEND
+#define TASK_PRIO_BT_SEND       2
+#endif
+#ifndef TASK_PRIO_AP_SEND
+#define TASK_PRIO_AP_SEND       2
+#endif
+#ifndef TASK_PRIO_AP_RECV
+#define TASK_PRIO_AP_RECV       2
+#endif
+
+//Stack sizes
+#define TASK_STACK_CAMERA       4096
+#define TASK_STACK_COMS         3072
+
+typedef enum {
+    TASK_CAPTURE,
+    TASK_STORAGE,
+    TASK_MOTION,
+    TASK_COMS_PARSE,
+    TASK_BT_SEND,
+    TASK_AP_SEND,
+    TASK_AP_RECV,
+    TASK_BURST,
+    TASK_BAND_0,
+    TASK_BAND_1,
+    TASK_ID_COUNT
+} CTaskId;
+
+typedef struct {
+    const char* name;
+    uint32_t    stackSize;
+    UBaseType_t priority;
+    BaseType_t  core;
+} CTaskEntry;
+
+class CTaskConfig {
+public:
+    CTaskConfig();
+
+    int                 create(uint8_t id, TaskFunction_t function, void* arg, TaskHandle_t* handle = NULL);
+    int                 set(uint8_t id, UBaseType_t priority, BaseType_t core, uint32_t stackSize = 0);
+    const CTaskEntry*   get(uint8_t id);
+    void                reset();
+    void                log();
+
+private:
+    CTaskEntry          entries[TASK_ID_COUNT];
+};
+
+extern CTaskConfig TaskConfig;
+
+#endif
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+#include "framesource.h"
+#include "jpg2rgb.h"
+#include "jpgluma.h"
+#include "testjpeg.h"
+
+// times CJpegLuma against the jpg2rgb path on the same frames at every scale, whole images
+// into caller owned buffers as CMotion decodes them. The frames are read through CReplaySource,
+// so a recording from the card or a directory of its jpegs can be passed:
+//   bench_decode [path.avi | directory]
+// Without one a synthetic 4:2:2 VGA corpus is written to decode_corpus/ and replayed.
+// On the host jpg2rgb is libjpeg's RGB decode averaged to gray, standing in for
+// esp_jpg_decode, so the times only compare the two decoders with each other.
+// Built twice like test_jpgluma, the 1/8 line of bench_decode_idct is the JPL_DC_ONLY=0 path
+
+#define BENCH_WIDTH         640
+#define BENCH_HEIGHT        480
+#define BENCH_FRAMES        24
+#define BENCH_QUALITY       80      // libjpeg scale, near the sensor's default quality of 10
+#define BENCH_MAX_FRAMES    200
+#define BENCH_MIN_US        200000  // each decoder runs the corpus until it has taken this long
+#define BENCH_CORPUS        "decode_corpus"
+
+typedef std::vector<uint8_t> CBenchFrame;
+
+static bool writeCorpus(const char* dirName)
+{
+    mkdir(dirName, 0755);
+
+    std::vector<uint8_t> rgb(BENCH_WIDTH * BENCH_HEIGHT * 3);
+    srand(3);
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        int left = f * 17 % BENCH_WIDTH;
+        for (int y = 0; y < BENCH_HEIGHT; y++) {
+            for (int x = 0; x < BENCH_WIDTH; x++) {
+                int v = 60 + x * 60 / BENCH_WIDTH + y * 40 / BENCH_HEIGHT + ((x * 37 + y * 91) ^ (x * y)) % 50 + rand() % 7;
+                if (x >= left && x < left + 60 && y > 120 && y < 400) {
+                    v = 210 + rand() % 5;
+                }
+                uint8_t* pixel = &rgb[(y * BENCH_WIDTH + x) * 3];
+                pixel[0] = v;
+                pixel[1] = v * 7 / 8 + 10;
+                pixel[2] = v * 3 / 4 + 20;
+            }
+        }
+
+        std::vector<uint8_t> jpg = encodeYCC422(rgb.data(), BENCH_WIDTH, BENCH_HEIGHT, BENCH_QUALITY);
+        char fileName[64];
+        snprintf(fileName, sizeof(fileName), "%s/frame%03d.jpg", dirName, f);
+        FILE* file = fopen(fileName, "wb");
+        if (!file || fwrite(jpg.data(), jpg.size(), 1, file) != 1) {
+            return false;
+        }
+        fclose(file);
+    }
+
+    return true;
+}
+
+static bool readCorpus(const char* path, std::vector<CBenchFrame>* frames, uint16_t* width, uint16_t* height)
+{
+    CReplaySource source;
+    if (source.open(path, false) != SRC_RET_OK || !source.getSize(width, height) || source.start() != SRC_RET_OK) {
+        return false;
+    }
+
+    camera_fb_t* fb;
+    while (frames->size() < BENCH_MAX_FRAMES && (fb = source.get()) != NULL) {
+        frames->push_back(CBenchFrame(fb->buf, fb->buf + fb->len));
+        source.release(fb);
+    }
+    source.close();
+
+    return !frames->empty();
+}
+
+// average us per frame, the corpus is repeated until the total is long enough to time
+template <typename CDecode>
+static uint32_t timeDecoder(const std::vector<CBenchFrame>& frames, CDecode decode, uint32_t* fails)
+{
+    uint32_t count = 0;
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed;
+    do {
+        for (const CBenchFrame& frame : frames) {
+            *fails += !decode(frame);
+        }
+        count += frames.size();
+        elapsed = esp_timer_get_time() - start;
+    } while (elapsed < BENCH_MIN_US);
+
+    return elapsed / count;
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : BENCH_CORPUS;
+    if (argc < 2 && !writeCorpus(BENCH_CORPUS)) {
+        printf("FAIL unable to write %s\n", BENCH_CORPUS);
+
+        return 1;
+    }
+
+    std::vector<CBenchFrame> frames;
+    uint16_t width, height;
+    if (!readCorpus(path, &frames, &width, &height)) {
+        printf("FAIL no frames could be replayed from %s\n", path);
+
+        return 1;
+    }
+
+    size_t bytes = 0;
+    for (const CBenchFrame& frame : frames) {
+        bytes += frame.size();
+    }
+    printf("%zu frames of %ux%u from %s, %zu bytes average, 1/8 scale %s\n",
+        frames.size(), width, height, path, bytes / frames.size(), JPL_DC_ONLY ? "from the DC terms" : "through the IDCT");
+
+    std::vector<uint8_t> out(width * height);
+    uint32_t lumaScaleUs[JPG_SCALE_8X + 1];
+    int fails = 0;
+    for (int scale = JPG_SCALE_NONE; scale <= JPG_SCALE_8X; scale++) {
+        CJpegLuma luma;
+        uint32_t lumaFails = 0, rgbFails = 0;
+        uint32_t lumaUs = timeDecoder(frames, [&](const CBenchFrame& f) {
+            return luma.decode(f.data(), f.size(), out.data(), out.size(), (jpg_scale_t)scale) == JPL_RET_OK;
+        }, &lumaFails);
+        uint32_t rgbUs = timeDecoder(frames, [&](const CBenchFrame& f) {
+            return jpg2rgb(f.data(), f.size(), out.data(), out.size(), (jpg_scale_t)scale);
+        }, &rgbFails);
+        lumaScaleUs[scale] = lumaUs;
+
+        printf("1/%d  CJpegLuma %6u us  jpg2rgb %6u us  %5.2fx", 1 << scale, lumaUs, rgbUs, lumaUs ? (float)rgbUs / lumaUs : 0.0f);
+        if (lumaFails) {
+            printf("  CJpegLuma declined %u decodes", lumaFails);
+        }
+        printf("\n");
+
+        // a frame the luma decoder declines falls back to jpg2rgb, which has to take everything
+        fails += rgbFails != 0;
+    }
+
+    // what the 1/8 motion decode saves over decoding the whole image
+    printf("1/8 CJpegLuma takes %u%% of its full size decode\n", lumaScaleUs[JPG_SCALE_NONE] ? 100 * lumaScaleUs[JPG_SCALE_8X] / lumaScaleUs[JPG_SCALE_NONE] : 0);
+
+    return fails ? 1 : 0;
+}
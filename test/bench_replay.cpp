@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "motion.h"
+#include "testjpeg.h"
+
+// replays synthetic 320x240 scenes through CMotion, prints what each motion option detects
+// and costs, and fails when an option stops doing what it is there for:
+//  - both backgrounds flag fewer frames of a grainy still scene than the previous frame does
+//  - the adaptive background also flags fewer frames of a flickering still scene
+//  - neither background learns a walking subject away before it triggers
+//  - illumination compensation turns lighting steps into illumination events, not motion
+//  - the cascade decodes fewer fine rows and still catches the moving subject
+//  - a split decode finds exactly what the single task decode finds
+//  - the prefilter skips most quiet frames and delays a subject by at most one audit
+//  - the auto threshold settles inside its limits on a quiet floor and again after the grain rises
+// Times are host times, they only compare the options with each other
+
+#define REPLAY_WIDTH        320
+#define REPLAY_HEIGHT       240
+#define REPLAY_FRAMES       120
+#define REPLAY_QUALITY      30      // near what the sensor is set to for motion
+#define REPLAY_RESTART      (REPLAY_WIDTH / 8) // a restart marker every MCU row, like the sensor's DRI
+
+typedef int (*CReplayScene)(int x, int y, int frame);
+
+typedef struct {
+    uint32_t        motion;     // frames checkMotion reported motion for
+    uint32_t        mapHash;    // of every change map fetched, 0 without debug
+    CMotionStats    stats;
+    std::vector<CMotionStats> trace; // stats after every frame
+} CReplayResult;
+
+static int fails = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); fails++; } } while (0)
+
+static int texture(int x, int y)
+{
+    return 70 + ((x * 37 + y * 91) ^ (x * y)) % 60;
+}
+
+static int noise()
+{
+    return rand() % 7 - 3;
+}
+
+// nothing moves, but every 8x8 block jitters by up to GRAIN each frame, the low light
+// grain of the sensor. It stays under the threshold against an average of the frames,
+// but the difference of two frames often does not
+#define GRAIN 12
+
+static int grain(int x, int y, int frame, int amplitude)
+{
+    uint32_t hash = ((x / 8) * 73856093) ^ ((y / 8) * 19349663) ^ (frame * 83492791);
+    hash ^= hash >> 13;
+    hash *= 0x5BD1E995;
+    hash ^= hash >> 15;
+
+    return texture(x, y) + (int)(hash % (2 * amplitude + 1)) - amplitude;
+}
+
+static int grainScene(int x, int y, int frame)
+{
+    return grain(x, y, frame, GRAIN);
+}
+
+// a still scene whose grain rises from under to well over the manual threshold halfway through,
+// the light fading. The auto threshold has to learn both floors
+#define AUTO_FRAMES         320
+#define AUTO_QUIET_GRAIN    3
+#define AUTO_NOISY_GRAIN    14
+#define AUTO_SETTLED        64  // last frames of each half the threshold has to hold still for
+
+static int fadingScene(int x, int y, int frame)
+{
+    return grain(x, y, frame, frame < AUTO_FRAMES / 2 ? AUTO_QUIET_GRAIN : AUTO_NOISY_GRAIN);
+}
+
+// nothing moves, but a tenth of the image is 4x4 patches that flicker far more than
+// the sensor noise, leaves on a tree or a screen
+static int stillScene(int x, int y, int frame)
+{
+    int bx = x / 4, by = y / 4;
+    if ((bx * 7 + by * 13) % 10) {
+        return texture(x, y) + noise();
+    }
+
+    uint32_t hash = (bx * 73856093) ^ (by * 19349663) ^ (frame * 83492791);
+    hash ^= hash >> 13;
+    hash *= 0x5BD1E995;
+    hash ^= hash >> 15;
+
+    return texture(x, y) + (int)(hash % 81) - 40;
+}
+
+// the whole image brightens and darkens every 30 frames, nothing moves
+static int lightsScene(int x, int y, int frame)
+{
+    int v = texture(x, y);
+    if ((frame / 30) % 2) {
+        v = v * 13 / 10 + 30;
+    }
+
+    return v + noise();
+}
+
+static int walkerScene(int x, int y, int frame)
+{
+    int left = (frame * 3) % REPLAY_WIDTH;
+    if (x >= left && x < left + 30 && y > 60 && y < 200) {
+        return 230 + noise() / 4;
+    }
+
+    return texture(x, y) + noise();
+}
+
+// nothing moves, only the sensor noise
+static int quietScene(int x, int y, int)
+{
+    return texture(x, y) + noise();
+}
+
+// still for the first third, then the walker
+static int lateWalkerScene(int x, int y, int frame)
+{
+    return frame < REPLAY_FRAMES / 3 ? quietScene(x, y, frame) : walkerScene(x, y, frame);
+}
+
+// still for the first third, then a small subject crosses the lower half
+static int ballScene(int x, int y, int frame)
+{
+    int left = (frame * 5) % REPLAY_WIDTH;
+    if (frame > REPLAY_FRAMES / 3 && x >= left && x < left + 24 && y > 120 && y < 144) {
+        return 230;
+    }
+
+    return texture(x, y) + noise();
+}
+
+static CReplayResult replay(const char* name, CReplayScene scene, void (*setup)(CMotion* motion), int restartInterval = 0, int frames = REPLAY_FRAMES)
+{
+    CMotion motion;
+    motion.setImageParameters(JPG_SCALE_2X, 1, REPLAY_WIDTH, REPLAY_HEIGHT);
+    motion.setDetectionParameters(3, 6, 15);
+    setup(&motion);
+
+    CReplayResult result = CReplayResult();
+    result.trace.resize(frames);
+
+    std::vector<uint8_t> img(REPLAY_WIDTH * REPLAY_HEIGHT);
+    std::vector<uint8_t> map;
+    srand(7);
+    for (int f = 0; f < frames; f++) {
+        for (int y = 0; y < REPLAY_HEIGHT; y++) {
+            for (int x = 0; x < REPLAY_WIDTH; x++) {
+                int v = scene(x, y, f);
+                img[y * REPLAY_WIDTH + x] = v < 0 ? 0 : (v > 255 ? 255 : v);
+            }
+        }
+
+        std::vector<uint8_t> jpg = encodeGray(img.data(), REPLAY_WIDTH, REPLAY_HEIGHT, REPLAY_QUALITY, restartInterval);
+        camera_fb_t fb;
+        memset(&fb, 0, sizeof(fb));
+        fb.buf      = jpg.data();
+        fb.len      = jpg.size();
+        fb.width    = REPLAY_WIDTH;
+        fb.height   = REPLAY_HEIGHT;
+        fb.format   = PIXFORMAT_JPEG;
+        result.motion += motion.checkMotion(&fb);
+
+        map.resize(motion.getMoveMapSize());
+        size_t len;
+        if (map.size() && motion.fetchMoveMap(map.data(), map.size(), &len)) {
+            for (size_t i = 0; i < len; i++) {
+                result.mapHash = result.mapHash * 31 + map[i];
+            }
+        }
+        motion.getStats(&result.trace[f]);
+    }
+    motion.getStats(&result.stats);
+
+    CMotionStats* s = &result.stats;
+    printf("%-24s motion %3u changed %3u triggers %2u illum %2u fine rows %3u%% decode %5uus split %uus single %uus",
+        name, result.motion, s->changeFrames, s->triggers, s->illumEvents, s->cascade ? s->finePercent : 100, s->avgDecodeUs, s->splitUs, s->singleUs);
+    if (s->prefilter) {
+        printf(" skipped %u/%u audits %u misses %u", s->skipped, s->checked, s->audits, s->misses);
+    }
+    printf("\n");
+
+    return result;
+}
+
+int main()
+{
+    printf("%d frames of %dx%d at quality %d, motion at 1/2 scale\n", REPLAY_FRAMES, REPLAY_WIDTH, REPLAY_HEIGHT, REPLAY_QUALITY);
+
+    // background models
+    CReplayResult grainFrame    = replay("grain frame", grainScene, [](CMotion* m) { m->setModel(MOT_MODEL_FRAME, 0); });
+    CReplayResult grainAverage  = replay("grain average", grainScene, [](CMotion* m) { m->setModel(MOT_MODEL_AVERAGE, 4); });
+    CReplayResult grainAdaptive = replay("grain adaptive", grainScene, [](CMotion* m) { m->setModel(MOT_MODEL_ADAPTIVE, 4); });
+    CHECK(grainAverage.stats.changeFrames < grainFrame.stats.changeFrames && grainAdaptive.stats.changeFrames < grainFrame.stats.changeFrames,
+        "backgrounds flagged %u and %u grainy still frames, the previous frame %u",
+        grainAverage.stats.changeFrames, grainAdaptive.stats.changeFrames, grainFrame.stats.changeFrames);
+
+    // flicker moves the patches as far from their average as from the previous frame, so the
+    // average background flags as much as the previous frame here. Only the adaptive
+    // threshold rises over the flickering pixels
+    CReplayResult stillFrame    = replay("flicker frame", stillScene, [](CMotion* m) { m->setModel(MOT_MODEL_FRAME, 0); });
+    CReplayResult stillAdaptive = replay("flicker adaptive", stillScene, [](CMotion* m) { m->setModel(MOT_MODEL_ADAPTIVE, 4); });
+    CHECK(stillAdaptive.stats.changeFrames < stillFrame.stats.changeFrames,
+        "adaptive background flagged %u flickering still frames, the previous frame %u", stillAdaptive.stats.changeFrames, stillFrame.stats.changeFrames);
+
+    // a background must not learn a subject away before it is reported
+    CReplayResult walkerAverage = replay("walker average", walkerScene, [](CMotion* m) { m->setModel(MOT_MODEL_AVERAGE, 4); });
+    CReplayResult walkerBg      = replay("walker adaptive", walkerScene, [](CMotion* m) { m->setModel(MOT_MODEL_ADAPTIVE, 4); });
+    CHECK(walkerAverage.stats.triggers > 0 && walkerBg.stats.triggers > 0, "backgrounds missed the walker");
+
+    // illumination compensation
+    CReplayResult lightsOff = replay("lights", lightsScene, [](CMotion* m) { m->setModel(MOT_MODEL_ADAPTIVE, 4); m->setIllumination(false); });
+    CReplayResult lightsOn  = replay("lights compensated", lightsScene, [](CMotion* m) { m->setModel(MOT_MODEL_ADAPTIVE, 4); m->setIllumination(true); });
+    CHECK(lightsOn.stats.illumEvents > 0 && lightsOn.stats.changeFrames < lightsOff.stats.changeFrames,
+        "compensation flagged %u frames with %u illumination events, %u without", lightsOn.stats.changeFrames, lightsOn.stats.illumEvents, lightsOff.stats.changeFrames);
+    CReplayResult walkerOn  = replay("walker compensated", walkerScene, [](CMotion* m) { m->setModel(MOT_MODEL_ADAPTIVE, 4); m->setIllumination(true); });
+    CHECK(walkerOn.stats.triggers > 0, "compensation hid the walker");
+
+    // coarse to fine cascade
+    CReplayResult ballFull  = replay("ball", ballScene, [](CMotion* m) { m->setModel(MOT_MODEL_AVERAGE, 4); });
+    CReplayResult ballCasc  = replay("ball cascade", ballScene, [](CMotion* m) { m->setModel(MOT_MODEL_AVERAGE, 4); m->setCascade(true); });
+    CHECK(ballCasc.stats.finePercent < 100 && ballCasc.stats.triggers > 0 && ballFull.stats.triggers > 0,
+        "cascade decoded %u%% of the fine rows with %u triggers, %u without", ballCasc.stats.finePercent, ballCasc.stats.triggers, ballFull.stats.triggers);
+
+    // split decode, the change maps have to match bit for bit
+    CReplayResult single    = replay("walker single", walkerScene, [](CMotion* m) { m->setModel(MOT_MODEL_ADAPTIVE, 4); m->setDebug(true); });
+    CReplayResult split     = replay("walker split", walkerScene, [](CMotion* m) { m->setModel(MOT_MODEL_ADAPTIVE, 4); m->setDebug(true); m->startWorkers(); });
+    CHECK(split.stats.splitFrames > 0, "no frame was split");
+    CHECK(split.motion == single.motion && split.stats.changeFrames == single.stats.changeFrames && split.mapHash == single.mapHash,
+        "split found %u/%u, single %u/%u", split.motion, split.stats.changeFrames, single.motion, single.stats.changeFrames);
+
+    // compressed domain prefilter on frames with restart markers
+    CReplayResult quietPre  = replay("quiet prefilter", quietScene, [](CMotion* m) { m->setModel(MOT_MODEL_AVERAGE, 4); m->setPrefilter(true); }, REPLAY_RESTART);
+    CReplayResult latePre   = replay("late walker prefilter", lateWalkerScene, [](CMotion* m) { m->setModel(MOT_MODEL_AVERAGE, 4); m->setPrefilter(true); }, REPLAY_RESTART);
+    CReplayResult lateFull  = replay("late walker", lateWalkerScene, [](CMotion* m) { m->setModel(MOT_MODEL_AVERAGE, 4); }, REPLAY_RESTART);
+    CHECK(quietPre.stats.skipped * 2 > quietPre.stats.checked && !quietPre.stats.misses,
+        "prefilter skipped %u of %u quiet frames with %u misses", quietPre.stats.skipped, quietPre.stats.checked, quietPre.stats.misses);
+    CHECK(latePre.stats.skipped && latePre.stats.misses <= latePre.stats.audits && latePre.stats.triggers == lateFull.stats.triggers,
+        "prefilter skipped %u frames with %u misses in %u audits and %u triggers, %u without",
+        latePre.stats.skipped, latePre.stats.misses, latePre.stats.audits, latePre.stats.triggers, lateFull.stats.triggers);
+    // a subject arriving in a skipped run is found by the next audit at the latest
+    CHECK(latePre.motion + PRF_AUDIT_EVERY >= lateFull.motion, "prefilter lost %u motion frames", lateFull.motion - latePre.motion);
+
+    // auto threshold
+    CReplayResult fadingManual  = replay("fading manual", fadingScene, [](CMotion* m) { m->setModel(MOT_MODEL_FRAME, 0); }, 0, AUTO_FRAMES);
+    CReplayResult fadingAuto    = replay("fading auto", fadingScene, [](CMotion* m) { m->setModel(MOT_MODEL_FRAME, 0); m->setAutoThreshold(true); }, 0, AUTO_FRAMES);
+    for (int half = 1; half <= 2; half++) {
+        int last = AUTO_FRAMES * half / 2 - 1;
+        CMotionStats* end = &fadingAuto.trace[last];
+        CMotionStats* settled = &fadingAuto.trace[last - AUTO_SETTLED];
+        printf("fading auto half %d     threshold %u move %u%%, %u changed frames in its last %d\n",
+            half, end->threshold, end->movePercent, end->changeFrames - settled->changeFrames, AUTO_SETTLED);
+        CHECK(end->threshold == settled->threshold && end->movePercent == settled->movePercent,
+            "half %d threshold %u move %u%% had not settled from %u %u%%", half, end->threshold, end->movePercent, settled->threshold, settled->movePercent);
+        CHECK(end->changeFrames == settled->changeFrames, "half %d still flagged %u settled frames", half, end->changeFrames - settled->changeFrames);
+    }
+    for (int f = 0; f < AUTO_FRAMES; f++) {
+        CMotionStats* s = &fadingAuto.trace[f];
+        CHECK(s->threshold >= MOT_AUTO_MIN && s->threshold <= MOT_AUTO_MAX && s->movePercent <= MOT_AUTO_MAX_MOVE,
+            "frame %d threshold %u move %u%% outside the auto limits", f, s->threshold, s->movePercent);
+    }
+    CHECK(fadingAuto.trace[AUTO_FRAMES / 2 - 1].threshold < fadingAuto.trace[AUTO_FRAMES - 1].threshold,
+        "threshold did not rise with the grain, %u then %u", fadingAuto.trace[AUTO_FRAMES / 2 - 1].threshold, fadingAuto.trace[AUTO_FRAMES - 1].threshold);
+    CHECK(fadingAuto.stats.changeFrames < fadingManual.stats.changeFrames,
+        "auto threshold flagged %u frames, the manual one %u", fadingAuto.stats.changeFrames, fadingManual.stats.changeFrames);
+
+    printf("replay: %d failures\n", fails);
+
+    return fails ? 1 : 0;
+}
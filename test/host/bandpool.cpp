@@ -0,0 +1,56 @@
+#include <thread>
+#include "bandpool.h"
+
+// band workers as host threads started for each job, band 0 runs on the caller like a busy core would
+
+CBandPool::CBandPool()
+{
+    workerCnt   = 0;
+    allowTasks  = false;
+    job         = NULL;
+    jobArg      = NULL;
+}
+
+CBandPool::~CBandPool()
+{
+    stop();
+}
+
+int CBandPool::start()
+{
+    workerCnt   = BAND_MAX_WORKERS;
+    allowTasks  = true;
+
+    return BAND_RET_OK;
+}
+
+void CBandPool::stop()
+{
+    workerCnt   = 0;
+    allowTasks  = false;
+}
+
+uint8_t CBandPool::size()
+{
+    return workerCnt;
+}
+
+void CBandPool::run(CBandJob newJob, void* arg, uint8_t count)
+{
+    if (count > workerCnt) {
+        for (uint8_t i = 0; i < count; i++) {
+            newJob(arg, i);
+        }
+
+        return;
+    }
+
+    std::thread threads[BAND_MAX_WORKERS];
+    for (uint8_t i = 1; i < count; i++) {
+        threads[i] = std::thread(newJob, arg, i);
+    }
+    newJob(arg, 0);
+    for (uint8_t i = 1; i < count; i++) {
+        threads[i].join();
+    }
+}
@@ -0,0 +1,100 @@
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "globals.h"
+#include "jpg2rgb.h"
+#include "testjpeg.h"
+
+// FreeRTOS, esp_timer and esp32-camera calls the motion sources make, done with the host's own
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return new std::mutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t)
+{
+    ((std::mutex*)sem)->lock();
+
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    ((std::mutex*)sem)->unlock();
+
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    delete (std::mutex*)sem;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    static thread_local int handle;
+
+    return &handle;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+int64_t esp_timer_get_time()
+{
+    static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot).count();
+}
+
+// frames only come from the replay source on the host
+camera_fb_t* esp_camera_fb_get()
+{
+    return NULL;
+}
+
+void esp_camera_fb_return(camera_fb_t*)
+{
+}
+
+// the change map is handed over as raw gray, only its bytes are compared
+bool fmt2jpg_cb(uint8_t* src, size_t src_len, uint16_t, uint16_t, pixformat_t, uint8_t, jpg_out_cb cb, void* arg)
+{
+    return cb(arg, 0, src, src_len) == src_len;
+}
+
+// the esp_jpg_decode path, libjpeg decodes to RGB888 and each pixel is averaged to gray like _rgb_write does
+bool jpg2rgb(const uint8_t* src, uint32_t src_len, uint8_t* out, size_t outSize, jpg_scale_t scale, uint16_t rowStart, uint16_t rowEnd, uint16_t* outWidth, uint16_t* outRows)
+{
+    std::vector<uint8_t> rgb;
+    int width, height;
+    if (!decodeRGB(src, src_len, 1 << scale, &rgb, &width, &height)) {
+        return false;
+    }
+
+    uint16_t first  = rowStart < height ? rowStart : height;
+    uint16_t last   = rowEnd < height ? rowEnd : height;
+    if (first > last) {
+        first = last;
+    }
+    if ((size_t)width * (last - first) > outSize) {
+        return false;
+    }
+
+    const uint8_t* pixel = rgb.data() + (size_t)first * width * 3;
+    for (size_t i = 0; i < (size_t)width * (last - first); i++, pixel += 3) {
+        out[i] = (pixel[0] + pixel[1] + pixel[2]) / 3;
+    }
+    if (outWidth) {
+        *outWidth = width;
+    }
+    if (outRows) {
+        *outRows = last - first;
+    }
+
+    return true;
+}
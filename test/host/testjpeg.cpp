@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <jpeglib.h>
+#include "testjpeg.h"
+
+static std::vector<uint8_t> encode(const uint8_t* src, int width, int height, int components, int quality, int restartInterval)
+{
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    unsigned char* buf = NULL;
+    unsigned long len = 0;
+    jpeg_mem_dest(&cinfo, &buf, &len);
+
+    cinfo.image_width       = width;
+    cinfo.image_height      = height;
+    cinfo.input_components  = components;
+    cinfo.in_color_space    = components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    if (components == 3) {
+        cinfo.comp_info[0].h_samp_factor = 2;
+        cinfo.comp_info[0].v_samp_factor = 1;
+    }
+    cinfo.restart_interval  = restartInterval;
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * width * components);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+
+    std::vector<uint8_t> out(buf, buf + len);
+    free(buf);
+    jpeg_destroy_compress(&cinfo);
+
+    return out;
+}
+
+std::vector<uint8_t> encodeGray(const uint8_t* gray, int width, int height, int quality, int restartInterval)
+{
+    return encode(gray, width, height, 1, quality, restartInterval);
+}
+
+std::vector<uint8_t> encodeYCC422(const uint8_t* rgb, int width, int height, int quality, int restartInterval)
+{
+    return encode(rgb, width, height, 3, quality, restartInterval);
+}
+
+static bool decode(const uint8_t* src, size_t len, int scaleDenom, J_COLOR_SPACE space, std::vector<uint8_t>* out, int* width, int* height)
+{
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+
+    jpeg_mem_src(&cinfo, (unsigned char*)src, len);
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+
+        return false;
+    }
+    cinfo.out_color_space   = space;
+    cinfo.dct_method        = JDCT_FLOAT;
+    cinfo.scale_num         = 1;
+    cinfo.scale_denom       = scaleDenom;
+    jpeg_start_decompress(&cinfo);
+
+    int stride = cinfo.output_width * cinfo.output_components;
+    *width  = cinfo.output_width;
+    *height = cinfo.output_height;
+    out->resize(stride * *height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = out->data() + cinfo.output_scanline * stride;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    return true;
+}
+
+bool decodeGray(const uint8_t* src, size_t len, int scaleDenom, std::vector<uint8_t>* out, int* width, int* height)
+{
+    return decode(src, len, scaleDenom, JCS_GRAYSCALE, out, width, height);
+}
+
+bool decodeRGB(const uint8_t* src, size_t len, int scaleDenom, std::vector<uint8_t>* out, int* width, int* height)
+{
+    return decode(src, len, scaleDenom, JCS_RGB, out, width, height);
+}
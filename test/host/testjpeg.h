@@ -0,0 +1,22 @@
+#ifndef TESTJPEG_H
+#define TESTJPEG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// libjpeg helpers for the host tests, the encoder writes baseline jpegs like the sensor's
+
+// 8 bit gray, one component
+std::vector<uint8_t> encodeGray(const uint8_t* gray, int width, int height, int quality, int restartInterval = 0);
+
+// RGB with 2x1 luma blocks per MCU, the 4:2:2 layout the OV2640 sends
+std::vector<uint8_t> encodeYCC422(const uint8_t* rgb, int width, int height, int quality, int restartInterval = 0);
+
+// luma of any jpeg at 1 / scaleDenom, libjpeg's float IDCT
+bool decodeGray(const uint8_t* src, size_t len, int scaleDenom, std::vector<uint8_t>* out, int* width, int* height);
+
+// RGB888 of any jpeg at 1 / scaleDenom, the chroma is upsampled and converted like esp_jpg_decode does
+bool decodeRGB(const uint8_t* src, size_t len, int scaleDenom, std::vector<uint8_t>* out, int* width, int* height);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// one heap on the host, the capabilities are ignored
+
+#define MALLOC_CAP_8BIT         (1 << 2)
+#define MALLOC_CAP_SPIRAM       (1 << 10)
+#define MALLOC_CAP_INTERNAL     (1 << 11)
+#define MALLOC_CAP_DEFAULT      (1 << 12)
+
+static inline void* heap_caps_malloc(size_t size, uint32_t)
+{
+    return malloc(size);
+}
+
+static inline void heap_caps_free(void* ptr)
+{
+    free(ptr);
+}
+
+#endif
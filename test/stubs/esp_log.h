@@ -0,0 +1,13 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdio.h>
+
+// errors and warnings go to stderr so a failing test shows them, the rest is dropped
+#define ESP_LOGE(tag, fmt, ...)     fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)     fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)     do {} while (0)
+#define ESP_LOGD(tag, fmt, ...)     do {} while (0)
+#define ESP_LOGV(tag, fmt, ...)     do {} while (0)
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_ESP_PM_H
+#define HOST_ESP_PM_H
+
+// nothing from here is used by the host build
+
+#endif
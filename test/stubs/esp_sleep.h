@@ -0,0 +1,6 @@
+#ifndef HOST_ESP_SLEEP_H
+#define HOST_ESP_SLEEP_H
+
+// nothing from here is used by the host build
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// just enough of FreeRTOS for the motion sources to build on the host
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef int         BaseType_t;
+typedef unsigned    UBaseType_t;
+typedef uint32_t    TickType_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  1
+#define portMAX_DELAY           0xFFFFFFFF
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+#define portTICK_PERIOD_MS      1
+#define portNUM_PROCESSORS      2
+#define tskNO_AFFINITY          0x7FFFFFFF
+#define IRAM_ATTR
+
+// a frame is only ever checked on one thread, the critical sections have nothing to guard here
+typedef struct {
+    int         unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    {0}
+#define portENTER_CRITICAL(mux)         (void)(mux)
+#define portEXIT_CRITICAL(mux)          (void)(mux)
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef HOST_QUEUE_H
+#define HOST_QUEUE_H
+
+#include "FreeRTOS.h"
+
+typedef void*   QueueHandle_t;
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef HOST_SEMPHR_H
+#define HOST_SEMPHR_H
+
+#include "queue.h"
+
+typedef void*   SemaphoreHandle_t;
+
+SemaphoreHandle_t   xSemaphoreCreateMutex();
+BaseType_t          xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t          xSemaphoreGive(SemaphoreHandle_t sem);
+void                vSemaphoreDelete(SemaphoreHandle_t sem);
+
+#endif
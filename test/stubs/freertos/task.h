@@ -0,0 +1,12 @@
+#ifndef HOST_TASK_H
+#define HOST_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void*   TaskHandle_t;
+typedef void    (*TaskFunction_t)(void*);
+
+TaskHandle_t    xTaskGetCurrentTaskHandle();
+void            vTaskDelay(TickType_t ticks);
+
+#endif
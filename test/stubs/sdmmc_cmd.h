@@ -0,0 +1,6 @@
+#ifndef SDMMC_CMD_H
+#define SDMMC_CMD_H
+
+typedef struct sdmmc_card_t sdmmc_card_t;
+
+#endif
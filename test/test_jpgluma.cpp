@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "jpgluma.h"
+#include "testjpeg.h"
+
+// CJpegLuma against libjpeg at every scale. The reference is the full size libjpeg
+// decode averaged down the same way, so the only difference is the IDCT rounding.
+// Windows and the split decode have to match the whole image decode exactly. Built
+// twice, with JPL_DC_ONLY on and off, so the 1/8 DC path and the IDCT path are both covered
+
+#define TEST_MAX_DIFF   2   // largest pixel difference to the float IDCT reference
+
+static int fails = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); fails++; } } while (0)
+
+// texture, edges and a gradient that stay clear of 0 and 255, so clipping does not change the averages
+static std::vector<uint8_t> makeImage(int width, int height, int components, int seed)
+{
+    std::vector<uint8_t> img(width * height * components);
+    srand(seed);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int v = 60 + x * 60 / width + y * 40 / height + ((x * 37 + y * 91) ^ (x * y)) % 40 + rand() % 9;
+            if (x > width / 3 && x < width / 2 && y > height / 4 && y < height * 3 / 4) {
+                v = 200;
+            }
+            for (int c = 0; c < components; c++) {
+                img[(y * width + x) * components + c] = (uint8_t)(v + c * 10 - 10);
+            }
+        }
+    }
+
+    return img;
+}
+
+static void checkScale(const char* name, const std::vector<uint8_t>& jpg, const std::vector<uint8_t>& ref, int refWidth, int refHeight, int scale)
+{
+    CJpegLuma luma;
+    int step    = 1 << scale;
+    int width   = refWidth >> scale;
+    int height  = refHeight >> scale;
+    std::vector<uint8_t> out(width * height);
+
+    int ret = luma.decode(jpg.data(), jpg.size(), out.data(), out.size(), (jpg_scale_t)scale);
+    CHECK(ret == JPL_RET_OK, "%s 1/%d decode returned %d", name, step, ret);
+    CHECK(luma.width() == width && luma.height() == height, "%s 1/%d is %ux%u, not %dx%d", name, step, luma.width(), luma.height(), width, height);
+    if (ret != JPL_RET_OK) {
+        return;
+    }
+
+    // only whole blocks, a block past the image edge is averaged over pixels libjpeg does not return
+    int maxDiff = 0;
+    for (int y = 0; y < (refHeight & ~7) >> scale; y++) {
+        for (int x = 0; x < (refWidth & ~7) >> scale; x++) {
+            int sum = 0;
+            for (int iy = 0; iy < step; iy++) {
+                for (int ix = 0; ix < step; ix++) {
+                    sum += ref[(y * step + iy) * refWidth + x * step + ix];
+                }
+            }
+            int diff = abs(sum / (step * step) - out[y * width + x]);
+            maxDiff = diff > maxDiff ? diff : maxDiff;
+        }
+    }
+    CHECK(maxDiff <= TEST_MAX_DIFF, "%s 1/%d differs from libjpeg by %d", name, step, maxDiff);
+
+    // a window is the same rows of the whole image, whatever rows it starts and ends on
+    int windows[][2] = {{0, height}, {height / 4, height * 3 / 4}, {1, 2}, {height - 3, height}, {height / 2, height + 50}};
+    for (auto& w : windows) {
+        int last = w[1] < height ? w[1] : height;
+        if (w[0] < 0 || w[0] > last) {
+            continue;
+        }
+        std::vector<uint8_t> win(width * (last - w[0]) + 1);
+        ret = luma.decode(jpg.data(), jpg.size(), win.data(), win.size(), (jpg_scale_t)scale, w[0], w[1]);
+        CHECK(ret == JPL_RET_OK && luma.height() == last - w[0], "%s 1/%d window %d-%d returned %d with %u rows", name, step, w[0], w[1], ret, luma.height());
+        CHECK(ret != JPL_RET_OK || !memcmp(win.data(), out.data() + w[0] * width, width * (last - w[0])), "%s 1/%d window %d-%d differs", name, step, w[0], w[1]);
+    }
+
+    // entropy decoded once, then two bands output from the blocks, as a split motion frame does
+    int first = height / 5, last = height > 4 ? height - 2 : height, cut = (first + last) / 2;
+    uint32_t blocks = (width + 7) * (height + 8);
+    std::vector<uint32_t> entries(blocks * 64), blockPos(blocks), blockEnd(blocks);
+    CJpegCoefs coefs;
+    memset(&coefs, 0, sizeof(coefs));
+    coefs.entries   = entries.data();
+    coefs.entryCap  = entries.size();
+    coefs.blocks    = blockPos.data();
+    coefs.blockEnd  = blockEnd.data();
+    coefs.blockCap  = blocks;
+    ret = luma.decodeCoefs(jpg.data(), jpg.size(), &coefs, (jpg_scale_t)scale, first, last);
+    CHECK(ret == JPL_RET_OK && coefs.width == width && coefs.rowFirst == first && coefs.rowLast == last, "%s 1/%d decodeCoefs returned %d", name, step, ret);
+
+    std::vector<uint8_t> split(width * (last - first));
+    CJpegLuma top, bottom;
+    int retTop      = top.outputCoefs(&coefs, split.data(), width * (cut - first), first, cut);
+    int retBottom   = bottom.outputCoefs(&coefs, split.data() + width * (cut - first), width * (last - cut), cut, last);
+    CHECK(retTop == JPL_RET_OK && retBottom == JPL_RET_OK, "%s 1/%d outputCoefs returned %d %d", name, step, retTop, retBottom);
+    CHECK(!memcmp(split.data(), out.data() + first * width, split.size()), "%s 1/%d split decode differs", name, step);
+
+    // a store too small for the window fails instead of writing past it
+    coefs.entryCap = 0;
+    ret = luma.decodeCoefs(jpg.data(), jpg.size(), &coefs, (jpg_scale_t)scale, first, last);
+    CHECK(ret == JPL_RET_BUFFER_SIZE, "%s 1/%d small store returned %d", name, step, ret);
+
+    ret = luma.decode(jpg.data(), jpg.size(), out.data(), out.size() - 1, (jpg_scale_t)scale);
+    CHECK(ret == JPL_RET_BUFFER_SIZE, "%s 1/%d small output returned %d", name, step, ret);
+}
+
+static void checkImage(const char* name, const std::vector<uint8_t>& jpg)
+{
+    std::vector<uint8_t> ref;
+    int width, height;
+    if (!decodeGray(jpg.data(), jpg.size(), 1, &ref, &width, &height)) {
+        CHECK(false, "%s libjpeg could not decode it", name);
+
+        return;
+    }
+
+    for (int scale = JPG_SCALE_NONE; scale <= JPG_SCALE_8X; scale++) {
+        checkScale(name, jpg, ref, width, height, scale);
+    }
+
+    // cut short data has to fail or decode garbage, never read past the end
+    std::vector<uint8_t> cut(jpg.begin(), jpg.begin() + jpg.size() / 2);
+    std::vector<uint8_t> out(width * height);
+    CJpegLuma luma;
+    luma.decode(cut.data(), cut.size(), out.data(), out.size(), JPG_SCALE_2X);
+}
+
+int main()
+{
+    static const int sizes[][2] = {{320, 240}, {100, 75}, {17, 9}};
+    static const int qualities[] = {12, 50, 90};
+    static const int restarts[] = {0, 3};
+
+    for (auto& size : sizes) {
+        std::vector<uint8_t> gray  = makeImage(size[0], size[1], 1, size[0]);
+        std::vector<uint8_t> rgb   = makeImage(size[0], size[1], 3, size[0]);
+        for (int quality : qualities) {
+            for (int restart : restarts) {
+                char name[64];
+                snprintf(name, sizeof(name), "gray %dx%d q%d rst%d", size[0], size[1], quality, restart);
+                checkImage(name, encodeGray(gray.data(), size[0], size[1], quality, restart));
+                snprintf(name, sizeof(name), "422 %dx%d q%d rst%d", size[0], size[1], quality, restart);
+                checkImage(name, encodeYCC422(rgb.data(), size[0], size[1], quality, restart));
+            }
+        }
+    }
+
+    printf("CJpegLuma (JPL_DC_ONLY %d): %d failures\n", JPL_DC_ONLY, fails);
+
+    return fails ? 1 : 0;
+}
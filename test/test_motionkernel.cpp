@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include "motionkernel.h"
+
+// motionDiff against motionDiffScalar, every length from 0 to a few words and random
+// longer ones, at every alignment, on random, close, equal and saturated images. Then
+// both are timed on the region sizes motion compares, the times are host times
+
+#define TEST_MAX_PIXELS     4096
+#define TEST_RANDOM_RUNS    2000
+#define BENCH_MAX_PIXELS    (400 * 300)
+#define BENCH_MIN_US        200000  // each kernel runs until it has taken this long
+#define BENCH_THRESHOLD     15
+
+static std::mt19937 rng(1);
+static uint8_t cur[TEST_MAX_PIXELS + 4];
+static uint8_t prev[TEST_MAX_PIXELS + 4];
+static uint8_t bitsSwar[TEST_MAX_PIXELS / 8 + 1];
+static uint8_t bitsScalar[TEST_MAX_PIXELS / 8 + 1];
+
+enum {
+    FILL_RANDOM,
+    FILL_CLOSE,     // within 20 of the current image, most pixels near the threshold
+    FILL_EQUAL,
+    FILL_EXTREME,   // only 0 and 255, the largest differences both ways
+    FILL_COUNT
+};
+
+static void fill(uint8_t* a, uint8_t* b, uint32_t count, int mode)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        a[i] = mode == FILL_EXTREME ? (rng() & 1 ? 255 : 0) : rng();
+        switch (mode) {
+        case FILL_RANDOM:
+            b[i] = rng();
+            break;
+        case FILL_CLOSE:
+            b[i] = (uint8_t)(a[i] + (int)(rng() % 41) - 20);
+            break;
+        case FILL_EQUAL:
+            b[i] = a[i];
+            break;
+        default:
+            b[i] = rng() & 1 ? 255 : 0;
+            break;
+        }
+    }
+}
+
+static int check(uint32_t count, uint32_t align, uint8_t threshold, int mode, bool withBits)
+{
+    fill(cur + align, prev + align, count, mode);
+
+    // different garbage in both so a byte one of them leaves alone shows up
+    memset(bitsSwar, 0xAA, sizeof(bitsSwar));
+    memset(bitsScalar, 0x55, sizeof(bitsScalar));
+
+    CMotionDiff swar, scalar;
+    motionDiff(cur + align, prev + align, count, threshold, withBits ? bitsSwar : NULL, &swar);
+    motionDiffScalar(cur + align, prev + align, count, threshold, withBits ? bitsScalar : NULL, &scalar);
+
+    if (swar.changed != scalar.changed || swar.lux != scalar.lux || (withBits && memcmp(bitsSwar, bitsScalar, (count + 7) / 8))) {
+        printf("FAIL count %u align %u threshold %u mode %d bits %d: changed %u/%u lux %u/%u\n",
+            count, align, threshold, mode, withBits, swar.changed, scalar.changed, swar.lux, scalar.lux);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+// ns per pixel, the kernel is repeated until the total is long enough to time
+static float timeKernel(void (*kernel)(const uint8_t*, const uint8_t*, uint32_t, uint8_t, uint8_t*, CMotionDiff*),
+    const uint8_t* a, const uint8_t* b, uint32_t count, uint8_t* bits, uint32_t* changed)
+{
+    CMotionDiff result;
+    uint64_t pixels = 0;
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed;
+    do {
+        kernel(a, b, count, BENCH_THRESHOLD, bits, &result);
+        pixels += count;
+        elapsed = esp_timer_get_time() - start;
+    } while (elapsed < BENCH_MIN_US);
+    *changed = result.changed;
+
+    return 1000.0f * elapsed / pixels;
+}
+
+static void bench()
+{
+    // QVGA watch mode at 1/2, UXGA at 1/8 and SVGA at 1/2
+    static const uint32_t sizes[] = {160 * 120, 200 * 150, 400 * 300};
+    static uint8_t a[BENCH_MAX_PIXELS];
+    static uint8_t b[BENCH_MAX_PIXELS];
+    static uint8_t bits[BENCH_MAX_PIXELS / 8];
+
+    // most pixels within the sensor noise of the reference, as in a still scene
+    fill(a, b, BENCH_MAX_PIXELS, FILL_CLOSE);
+
+    for (uint32_t count : sizes) {
+        for (int withBits = 0; withBits < 2; withBits++) {
+            uint32_t changedSwar, changedScalar;
+            float swar      = timeKernel(motionDiff, a, b, count, withBits ? bits : NULL, &changedSwar);
+            float scalar    = timeKernel(motionDiffScalar, a, b, count, withBits ? bits : NULL, &changedScalar);
+            printf("%6u pixels %s  motionDiff %5.2f ns/pixel  motionDiffScalar %5.2f ns/pixel  %5.2fx\n",
+                count, withBits ? "with bits   " : "count only  ", swar, scalar, swar > 0 ? scalar / swar : 0.0f);
+        }
+    }
+}
+
+int main()
+{
+    static const uint8_t thresholds[] = {0, 1, 15, 127, 128, 254, 255};
+    int fails = 0;
+
+    // short and odd lengths cover the word loop tail and a part filled last bit byte
+    for (uint32_t count = 0; count <= 67; count++) {
+        for (uint32_t align = 0; align < 4; align++) {
+            for (uint8_t threshold : thresholds) {
+                for (int mode = 0; mode < FILL_COUNT; mode++) {
+                    fails += check(count, align, threshold, mode, true);
+                }
+            }
+        }
+    }
+
+    for (uint32_t run = 0; run < TEST_RANDOM_RUNS; run++) {
+        uint32_t count = rng() % (TEST_MAX_PIXELS + 1);
+        uint8_t threshold = run < sizeof(thresholds) * 50 ? thresholds[run % sizeof(thresholds)] : rng();
+        fails += check(count, rng() % 4, threshold, rng() % FILL_COUNT, rng() % 4);
+    }
+
+    printf("motionDiff: %d failures\n", fails);
+    bench();
+
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "avi.h"
+#include "framesource.h"
+#include "motion.h"
+#include "prebuffer.h"
+#include "currenttime.h"
+#include "testjpeg.h"
+
+// replays a recording through the capture, motion and storage path the way the camera tasks run it:
+// every frame goes to the pre-buffer and CMotion while nothing is recorded, motion starts an AVI
+// with the buffered lead up and every later frame is written until motion has been gone for
+// PIPE_COUNT_DOWN frames. The AVI is replayed back and has to hold an unbroken run of the
+// source frames that starts before the frame motion was found
+//   test_pipeline [path.avi]
+// Without one a still scene a subject then walks through is recorded to pipeline_corpus.avi first.
+// The motion check runs in line, on the camera the motion task can be a frame behind
+
+#define PIPE_WIDTH          320     // QVGA, checked at 1/4 scale like frameData has it
+#define PIPE_HEIGHT         240
+#define PIPE_FPS            30
+#define PIPE_QUALITY        80      // libjpeg scale, near the sensor's default quality of 10
+#define PIPE_STILL          60      // frames before the subject walks in
+#define PIPE_WALK           30      // frames it takes to cross
+#define PIPE_FRAMES         130
+#define PIPE_COUNT_DOWN     10      // CAM_COUNT_DOWN, shortened to fit the corpus
+#define PIPE_PRE_FRAMES     16      // the pre-buffer budget is sized for about this many frames
+#define PIPE_MAX_FRAMES     1000    // CAM_MAX_FRAMES
+#define PIPE_CORPUS         "pipeline_corpus.avi"
+#define PIPE_RECORDING      "pipeline_recording.avi"
+
+typedef std::vector<uint8_t> CPipeFrame;
+
+static int fails = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); fails++; } } while (0)
+
+static int texture(int x, int y)
+{
+    return 70 + ((x * 37 + y * 91) ^ (x * y)) % 60;
+}
+
+static bool writeCorpus(const char* fileName)
+{
+    CAVI avi;
+    if (avi.startFile(fileName, PIPE_WIDTH, PIPE_HEIGHT, PIPE_FPS, false, PIPE_FRAMES) != AVI_RET_OK) {
+        return false;
+    }
+
+    std::vector<uint8_t> rgb(PIPE_WIDTH * PIPE_HEIGHT * 3);
+    srand(5);
+    for (int f = 0; f < PIPE_FRAMES; f++) {
+        int left = (f - PIPE_STILL) * PIPE_WIDTH / PIPE_WALK;
+        bool walking = f >= PIPE_STILL && f < PIPE_STILL + PIPE_WALK;
+        for (int y = 0; y < PIPE_HEIGHT; y++) {
+            for (int x = 0; x < PIPE_WIDTH; x++) {
+                int v = texture(x, y) + rand() % 7 - 3;
+                if (walking && x >= left && x < left + 40 && y > 60 && y < 200) {
+                    v = 230;
+                }
+                uint8_t* pixel = &rgb[(y * PIPE_WIDTH + x) * 3];
+                pixel[0] = v;
+                pixel[1] = v * 7 / 8 + 10;
+                pixel[2] = v * 3 / 4 + 20;
+            }
+        }
+
+        // the writer pads every frame to 4 bytes from the buffer, like a driver buffer there is room past the end
+        CPipeFrame jpg = encodeYCC422(rgb.data(), PIPE_WIDTH, PIPE_HEIGHT, PIPE_QUALITY);
+        size_t len = jpg.size();
+        jpg.resize(len + 4);
+        if (avi.writeFrame(jpg.data(), len) != AVI_RET_OK) {
+            return false;
+        }
+    }
+
+    return avi.closeFile("") == AVI_RET_OK;
+}
+
+static bool readFrames(const char* path, std::vector<CPipeFrame>* frames, uint16_t* width, uint16_t* height)
+{
+    CReplaySource source;
+    if (source.open(path, false) != SRC_RET_OK || !source.getSize(width, height) || source.start() != SRC_RET_OK) {
+        return false;
+    }
+
+    camera_fb_t* fb;
+    while ((fb = source.get()) != NULL) {
+        frames->push_back(CPipeFrame(fb->buf, fb->buf + fb->len));
+        source.release(fb);
+    }
+    source.close();
+
+    return !frames->empty();
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : PIPE_CORPUS;
+    if (argc < 2 && !writeCorpus(PIPE_CORPUS)) {
+        printf("FAIL unable to record %s\n", PIPE_CORPUS);
+
+        return 1;
+    }
+
+    // the source frames, to find the recorded ones in
+    std::vector<CPipeFrame> corpus;
+    uint16_t width, height;
+    if (!readFrames(path, &corpus, &width, &height)) {
+        printf("FAIL no frames could be replayed from %s\n", path);
+
+        return 1;
+    }
+
+    size_t bytes = 0;
+    for (const CPipeFrame& frame : corpus) {
+        bytes += frame.size();
+    }
+
+    CReplaySource source;
+    CMotion motion;
+    CPreBuffer preBuffer;
+    CAVI aviFile;
+    if (source.open(path, false) != SRC_RET_OK || source.start() != SRC_RET_OK || preBuffer.init(PRE_DEFAULT_SECONDS, bytes / corpus.size() * PIPE_PRE_FRAMES) != PRE_RET_OK) {
+        printf("FAIL unable to start the replay\n");
+
+        return 1;
+    }
+    motion.setImageParameters(JPG_SCALE_4X, 1, width, height);
+    motion.setDetectionParameters(3, 6, 15);
+
+    // the capture task, with the storage task's jobs run in place
+    bool recording = false;
+    uint32_t recordCountDown = 0;
+    uint32_t frameIndex = 0;
+    uint32_t triggerFrame = 0;
+    uint32_t recordings = 0;
+    uint32_t written = 0;
+    camera_fb_t* fb;
+    while ((fb = source.get()) != NULL) {
+        if (!recording) {
+            preBuffer.push(fb->buf, fb->len, CurrentTime.ms());
+        }
+
+        motion.checkMotion(fb);
+        if (!motion.getMotion()) {
+            if (recordCountDown) {
+                recordCountDown--;
+            }
+        }
+        else {
+            recordCountDown = PIPE_COUNT_DOWN;
+        }
+
+        if (recording) {
+            if (!recordCountDown) {
+                aviFile.closeFile("");
+                recording = false;
+            }
+            else if (aviFile.writeFrame(fb) == AVI_RET_OK) {
+                written++;
+            }
+        }
+        else if (recordCountDown && !recordings) {
+            triggerFrame = frameIndex;
+            if (aviFile.startFile(PIPE_RECORDING, width, height, PIPE_FPS, false, PIPE_MAX_FRAMES) == AVI_RET_OK && aviFile.writePreBuffer(&preBuffer) == AVI_RET_OK) {
+                recording = true;
+                recordings++;
+            }
+        }
+
+        source.release(fb);
+        frameIndex++;
+    }
+    aviFile.closeFile("");
+    source.close();
+
+    printf("%zu frames of %ux%u from %s, motion at frame %u, %u frames written after it\n",
+        corpus.size(), width, height, path, triggerFrame, written);
+    CHECK(recordings == 1, "%u recordings started", recordings);
+    if (argc < 2) {
+        CHECK(triggerFrame >= PIPE_STILL && triggerFrame < PIPE_STILL + PIPE_WALK, "motion found at frame %u, the subject walks in at %d", triggerFrame, PIPE_STILL);
+    }
+
+    // the recording has to be an unbroken run of the source ending with the last frame written
+    std::vector<CPipeFrame> recorded;
+    uint16_t recWidth = 0, recHeight = 0;
+    CHECK(readFrames(PIPE_RECORDING, &recorded, &recWidth, &recHeight), "no frames could be replayed from %s", PIPE_RECORDING);
+    CHECK(recWidth == width && recHeight == height, "recorded at %ux%u", recWidth, recHeight);
+
+    uint32_t first = 0;
+    while (!recorded.empty() && first < corpus.size() && corpus[first] != recorded[0]) {
+        first++;
+    }
+    uint32_t preFrames = recorded.size() - written;
+    printf("recording of %zu frames starts at frame %u, %u from the pre-buffer\n", recorded.size(), first, preFrames);
+    CHECK(first < corpus.size(), "the first recorded frame is not in the source");
+    CHECK(recorded.size() > written && first + preFrames == triggerFrame + 1,
+        "%u pre-buffered frames from frame %u do not lead up to the trigger at %u", preFrames, first, triggerFrame);
+    CHECK(first > 0 && preFrames <= PIPE_PRE_FRAMES, "the pre-buffer kept %u frames from frame %u, its budget is about %d", preFrames, first, PIPE_PRE_FRAMES);
+    for (uint32_t i = 0; i < recorded.size() && first + i < corpus.size(); i++) {
+        if (recorded[i] != corpus[first + i]) {
+            CHECK(false, "recorded frame %u is not source frame %u", i, first + i);
+            break;
+        }
+    }
+
+    return fails ? 1 : 0;
+}